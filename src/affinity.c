@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * affinity.c - implementation of thread placement and NUMA node support
+ *              for simple RPC system
+ */
+
+#ifdef HAVE_CPU_AFFINITY
+#define _GNU_SOURCE			/* for pthread_setaffinity_np() */
+#endif /* HAVE_CPU_AFFINITY */
+#include "affinity.h"
+#include "srpcdefs.h"
+#include <stdio.h>
+#include <pthread.h>
+#ifdef HAVE_CPU_AFFINITY
+#include <sched.h>
+#endif /* HAVE_CPU_AFFINITY */
+#ifdef HAVE_NUMA
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif /* HAVE_NUMA */
+
+#ifdef HAVE_NUMA
+/* from <numaif.h>, so that libnuma is not needed */
+#define MPOL_PREFERRED 1
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static int nnodes = 1;
+static __thread int thisNode = -1;	/* calling thread's node, if known */
+static __thread unsigned thisGen = 0;	/* value of pinGen when determined */
+static unsigned pinGen = 0;		/* bumped whenever a thread is pinned */
+
+/*
+ * the highest node in /sys/devices/system/node/possible, of the form
+ * "0" or "0-3", determines the number of nodes
+ */
+static void count_nodes(void) {
+    FILE *fd = fopen("/sys/devices/system/node/possible", "r");
+    int lo, hi;
+
+    if (fd == NULL)
+        return;
+    switch (fscanf(fd, "%d-%d", &lo, &hi)) {
+    case 1:
+        nnodes = (lo + 1 < MAX_NODES) ? lo + 1 : MAX_NODES;
+        break;
+    case 2:
+        nnodes = (hi + 1 < MAX_NODES) ? hi + 1 : MAX_NODES;
+        break;
+    }
+    fclose(fd);
+}
+#endif /* HAVE_NUMA */
+
+int affinity_usable(int cpu) {
+#ifdef HAVE_CPU_AFFINITY
+    cpu_set_t set;
+
+    return (cpu >= 0 && cpu < CPU_SETSIZE &&
+            sched_getaffinity(0, sizeof(set), &set) == 0 &&
+            CPU_ISSET(cpu, &set));
+#else
+    (void)cpu;
+    return 0;
+#endif /* HAVE_CPU_AFFINITY */
+}
+
+int affinity_pin(pthread_t thr, int cpu) {
+#ifdef HAVE_CPU_AFFINITY
+    cpu_set_t set;
+
+    if (! affinity_usable(cpu))
+        return 0;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(thr, sizeof(set), &set) != 0)
+        return 0;
+#ifdef HAVE_NUMA
+    __atomic_add_fetch(&pinGen, 1, __ATOMIC_RELEASE);
+#endif /* HAVE_NUMA */
+    return 1;
+#else
+    (void)thr;
+    (void)cpu;
+    return 0;
+#endif /* HAVE_CPU_AFFINITY */
+}
+
+int affinity_nodes(void) {
+#ifdef HAVE_NUMA
+    pthread_once(&once, count_nodes);
+    return nnodes;
+#else
+    return 1;
+#endif /* HAVE_NUMA */
+}
+
+int affinity_node(void) {
+#ifdef HAVE_NUMA
+    unsigned gen = __atomic_load_n(&pinGen, __ATOMIC_ACQUIRE);
+    unsigned c, n;
+
+    if (thisNode < 0 || thisGen != gen) {
+        if (syscall(SYS_getcpu, &c, &n, NULL) != 0 ||
+                (int)n >= affinity_nodes())
+            n = 0;
+        thisNode = (int)n;
+        thisGen = gen;
+    }
+    return thisNode;
+#else
+    return 0;
+#endif /* HAVE_NUMA */
+}
+
+void affinity_bind(void *p, size_t len, int node) {
+#ifdef HAVE_NUMA
+    unsigned long mask = 1UL << node;
+
+    if (affinity_nodes() > 1)
+        (void) syscall(SYS_mbind, p, len, MPOL_PREFERRED, &mask,
+                       8 * sizeof(mask), 0);
+#else
+    (void)p;
+    (void)len;
+    (void)node;
+#endif /* HAVE_NUMA */
+}
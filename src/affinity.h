@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * affinity.h - thread placement and NUMA node support for the SRPC system
+ *
+ * threads of the RPC system may be pinned to particular CPUs; memory that
+ * a thread obtains from the packet arena and the connection record slab
+ * is then taken from regions bound to the NUMA node of that CPU, so that
+ * a context pinned to a core touches only memory local to it
+ *
+ * pinning requires HAVE_CPU_AFFINITY and node placement requires HAVE_NUMA;
+ * otherwise pinning fails and every thread is on node 0
+ */
+
+#ifndef _AFFINITY_H_
+#define _AFFINITY_H_
+
+#include <stddef.h>
+#include <pthread.h>
+
+/*
+ * returns 1 if `cpu' is one on which this process may run, 0 otherwise
+ */
+int affinity_usable(int cpu);
+
+/*
+ * pin `thr' to `cpu'
+ * returns 1 if successful, 0 if the CPU is unusable or pinning unsupported
+ */
+int affinity_pin(pthread_t thr, int cpu);
+
+/*
+ * returns the number of NUMA nodes for which memory is kept, at least 1 and
+ * at most MAX_NODES (see srpcdefs.h)
+ */
+int affinity_nodes(void);
+
+/*
+ * returns the NUMA node on which the calling thread runs, as determined
+ * the first time it asks or after any thread was last pinned
+ */
+int affinity_node(void);
+
+/*
+ * prefer `node' for the pages of the `len' bytes at `p', which must not
+ * yet have been touched
+ */
+void affinity_bind(void *p, size_t len, int node);
+
+#endif /* _AFFINITY_H_ */
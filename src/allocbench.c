@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * allocation-counting benchmark
+ *
+ * usage: ./allocbench [-l ncalls] [-w nwarmup] [-b qbytes] [-z]
+ *
+ * forks a child process that offers an echo service and calls it over
+ * loopback; after `nwarmup' calls, counts the number of malloc()/free()
+ * calls made by the client and by the server during the next `ncalls' calls
+ *
+ * the server reports its counts in response to a MARK query
+ *
+ * `qbytes' is the size of each query and response; values larger than the
+ * fragment size exercise the fragmentation path
+ *
+ * if -z is specified, exits with status 1 unless the measured calls made no
+ * calls to malloc() in either process
+ *
+ * counting relies upon replacing malloc() and friends; this is only done
+ * when built against glibc - otherwise the program reports that counting is
+ * not supported and exits successfully
+ */
+
+#include "srpc.h"
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define SERVICE "AllocBench"
+#define NCALLS 10000
+#define NWARMUP 1000
+#define QBYTES 100
+#define MAXBYTES 65536
+#define USAGE "./allocbench [-l ncalls] [-w nwarmup] [-b qbytes] [-z]"
+#define MARK "MARK"
+
+static unsigned long nmalloc = 0;
+static unsigned long nfree = 0;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size) {
+    __sync_fetch_and_add(&nmalloc, 1);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    __sync_fetch_and_add(&nmalloc, 1);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    __sync_fetch_and_add(&nmalloc, 1);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    if (ptr != NULL)
+        __sync_fetch_and_add(&nfree, 1);
+    __libc_free(ptr);
+}
+#endif /* __GLIBC__ */
+
+/*
+ * echo each query back to the caller; a MARK query is answered with the
+ * allocation counts for this process
+ *
+ * never returns
+ */
+static void server(int fd) {
+    static char query[MAXBYTES], resp[MAXBYTES];
+    char myhost[16];
+    unsigned short myport;
+    RpcService rps;
+    RpcEndpoint sender;
+    unsigned len;
+
+    if (! rpc_init(0) || (rps = rpc_offer(SERVICE)) == NULL) {
+        fprintf(stderr, "Failure offering %s service\n", SERVICE);
+        exit(-1);
+    }
+    rpc_details(myhost, &myport);
+    if (write(fd, &myport, sizeof(myport)) != sizeof(myport))
+        exit(-1);
+    close(fd);
+    while ((len = rpc_query(rps, &sender, query, sizeof(query))) > 0) {
+        if (len == sizeof(MARK) && strcmp(query, MARK) == 0) {
+            sprintf(resp, "%lu %lu", nmalloc, nfree);
+            rpc_response(rps, &sender, resp, strlen(resp) + 1);
+        } else
+            rpc_response(rps, &sender, query, len);
+    }
+    exit(0);
+}
+
+/*
+ * obtain the server's allocation counts
+ */
+static int mark(RpcConnection rpc, unsigned long *m, unsigned long *f) {
+    Q_Decl(query,sizeof(MARK));
+    char resp[100];
+    unsigned len;
+
+    strcpy(query, MARK);
+    if (! rpc_call(rpc, Q_Arg(query), sizeof(MARK), resp, sizeof(resp), &len))
+        return 0;
+    return (sscanf(resp, "%lu %lu", m, f) == 2);
+}
+
+static int calls(RpcConnection rpc, const struct qdecl *q, unsigned qlen,
+                 char *resp, int n) {
+    unsigned len;
+    int i;
+
+    for (i = 0; i < n; i++)
+        if (! rpc_call(rpc, q, qlen, resp, MAXBYTES, &len) || len != qlen)
+            return 0;
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    RpcConnection rpc;
+    Q_Decl(query,MAXBYTES);
+    static char resp[MAXBYTES];
+    unsigned short port;
+    int fds[2];
+    pid_t pid;
+    int status;
+    int ncalls = NCALLS, nwarmup = NWARMUP, qbytes = QBYTES, zero = 0;
+    unsigned long m0, f0, m1, f1, sm0, sf0, sm1, sf1;
+    int i, j;
+
+    for (i = 1; i < argc; ) {
+        if (strcmp(argv[i], "-z") == 0) {
+            zero = 1;
+            i++;
+            continue;
+        }
+        if ((j = i + 1) == argc) {
+            fprintf(stderr, "usage: %s\n", USAGE);
+            exit(1);
+        }
+        if (strcmp(argv[i], "-l") == 0)
+            ncalls = atoi(argv[j]);
+        else if (strcmp(argv[i], "-w") == 0)
+            nwarmup = atoi(argv[j]);
+        else if (strcmp(argv[i], "-b") == 0)
+            qbytes = atoi(argv[j]);
+        else {
+            fprintf(stderr, "Unknown flag: %s %s\n", argv[i], argv[j]);
+        }
+        i = j + 1;
+    }
+#ifndef __GLIBC__
+    printf("allocation counting not supported on this platform\n");
+    return 0;
+#endif /* __GLIBC__ */
+    if (qbytes < 1 || qbytes > MAXBYTES) {
+        fprintf(stderr, "qbytes must be in the range 1..%d\n", MAXBYTES);
+        exit(1);
+    }
+    if (pipe(fds) == -1 || (pid = fork()) == -1) {
+        fprintf(stderr, "Failure to start server process\n");
+        exit(-1);
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        server(fds[1]);
+    }
+    close(fds[1]);
+    if (read(fds[0], &port, sizeof(port)) != sizeof(port)) {
+        fprintf(stderr, "Failure to start server process\n");
+        exit(-1);
+    }
+    close(fds[0]);
+    assert(rpc_init(0));
+    if ((rpc = rpc_connect("localhost", port, SERVICE, 0)) == NULL) {
+        fprintf(stderr, "Failure to connect to %s at localhost:%05u\n",
+                SERVICE, port);
+        kill(pid, SIGTERM);
+        exit(-1);
+    }
+    memset(query, 'x', qbytes);
+    status = calls(rpc, Q_Arg(query), qbytes, resp, nwarmup) &&
+             mark(rpc, &sm0, &sf0);
+    m0 = nmalloc;
+    f0 = nfree;
+    status = status && calls(rpc, Q_Arg(query), qbytes, resp, ncalls);
+    m1 = nmalloc;
+    f1 = nfree;
+    status = status && mark(rpc, &sm1, &sf1);
+    rpc_disconnect(rpc);
+    kill(pid, SIGTERM);
+    (void) waitpid(pid, NULL, 0);
+    if (! status) {
+        fprintf(stderr, "rpc_call() failed\n");
+        exit(-1);
+    }
+    /* the closing MARK call is included in the server's counts */
+    printf("%d calls of %d bytes\n", ncalls, qbytes);
+    printf("client: %lu mallocs, %lu frees, %.3f mallocs/call\n",
+           m1 - m0, f1 - f0,
+           (ncalls > 0) ? (double)(m1 - m0) / (double)ncalls : 0.0);
+    printf("server: %lu mallocs, %lu frees, %.3f mallocs/call\n",
+           sm1 - sm0, sf1 - sf0,
+           (ncalls > 0) ? (double)(sm1 - sm0) / (double)ncalls : 0.0);
+    return (zero && (m1 != m0 || sm1 != sm0)) ? 1 : 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * arena.c - implementation of the mmap-backed arena for simple RPC system
+ */
+
+#include "arena.h"
+#include "affinity.h"
+#include "srpcdefs.h"
+#include "logdefs.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#define ALIGNMENT 64		/* cache line */
+#define HUGE_PAGE (2 * 1024 * 1024)
+
+static size_t regionSize = ARENA_SIZE;
+static int arenaFlags = 0;
+static unsigned char *next[MAX_NODES];	/* next free byte in current region */
+static size_t left[MAX_NODES];		/* bytes left in current region */
+static unsigned long nregions = 0;
+static unsigned long nhuge = 0;
+static size_t mapped = 0;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int arena_config(size_t size, int flags) {
+    if (size < HUGE_PAGE)
+        return 0;
+    pthread_mutex_lock(&mutex);
+    regionSize = ((size - 1) / HUGE_PAGE + 1) * HUGE_PAGE;
+    arenaFlags = flags;
+    pthread_mutex_unlock(&mutex);
+    return 1;
+}
+
+/*
+ * map a new region of at least `size' bytes for `node'
+ * must be called with the arena locked
+ */
+static int grow(size_t size, int node) {
+    size_t len = regionSize;
+    void *p = MAP_FAILED;
+
+    if (len < size)
+        len = ((size - 1) / HUGE_PAGE + 1) * HUGE_PAGE;
+#ifdef MAP_HUGETLB
+    if (arenaFlags & ARENA_HUGEPAGES) {
+        p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            nhuge++;
+        } else {
+            warningf("arena: no huge pages available, using THP advice\n");
+        }
+    }
+#endif /* MAP_HUGETLB */
+    if (p == MAP_FAILED) {
+        p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return 0;
+#ifdef MADV_HUGEPAGE
+        (void) madvise(p, len, MADV_HUGEPAGE);
+#endif /* MADV_HUGEPAGE */
+    }
+    affinity_bind(p, len, node);	/* before mlock() faults it in */
+    if (arenaFlags & ARENA_MLOCK) {
+        if (mlock(p, len) != 0)
+            warningf("arena: unable to lock %zd bytes\n", len);
+    }
+    next[node] = (unsigned char *)p;
+    left[node] = len;
+    nregions++;
+    mapped += len;
+    return 1;
+}
+
+void *arena_alloc(size_t size) {
+    int node = affinity_node();
+    void *p = NULL;
+
+    size = ((size - 1) / ALIGNMENT + 1) * ALIGNMENT;
+    pthread_mutex_lock(&mutex);
+    if (size <= left[node] || grow(size, node)) {
+        p = (void *)next[node];
+        next[node] += size;
+        left[node] -= size;
+    }
+    pthread_mutex_unlock(&mutex);
+    return p;
+}
+
+void arena_dump(void) {
+    pthread_mutex_lock(&mutex);
+    fprintf(stderr, "arena: %lu regions (%lu huge), %zd bytes mapped, "
+            "%zd bytes left in current region of node 0\n",
+            nregions, nhuge, mapped, left[0]);
+    pthread_mutex_unlock(&mutex);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * arena.h - mmap-backed memory arena for packet and message buffers
+ *
+ * the arena hands out blocks carved from large anonymous mappings; a new
+ * region is mapped whenever the current one is exhausted, so the arena
+ * grows on demand and its memory is never returned
+ *
+ * regions may be backed by explicit huge pages (MAP_HUGETLB), falling back
+ * to ordinary pages with transparent huge page advice if none are
+ * available, and may be locked into memory so that the hot path does not
+ * take page faults
+ *
+ * each NUMA node has its own current region, bound to that node, from which
+ * the threads running on the node are served (see affinity.h)
+ */
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+
+#define ARENA_HUGEPAGES 0x1	/* try MAP_HUGETLB before THP advice */
+#define ARENA_MLOCK 0x2		/* lock and prefault each region */
+
+/*
+ * set the size of each region and the flags used when mapping regions;
+ * affects only regions mapped after the call
+ * returns 1 if successful, 0 if the size is unusable
+ */
+int arena_config(size_t regionSize, int flags);
+
+/*
+ * obtain `size' bytes from the arena, aligned to a cache line
+ * returns NULL if error
+ */
+void *arena_alloc(size_t size);
+
+/*
+ * dump statistics for the arena
+ */
+void arena_dump(void);
+
+#endif /* _ARENA_H_ */
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * async.c - completion delivery and completion queues for asynchronous
+ *           calls in the simple RPC system
+ */
+
+#include "async.h"
+#include "srpcmalloc.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+typedef struct cqhead {
+    AsyncCall *head;
+    AsyncCall *tail;
+    pthread_mutex_t mutex;
+    pthread_cond_t nonempty;
+} CQHead;
+
+RpcCQ rpc_cq_create(void) {
+    CQHead *cq = (CQHead *)malloc(sizeof(CQHead));
+
+    if (cq != NULL) {
+        cq->head = NULL;
+        cq->tail = NULL;
+        if (pthread_mutex_init(&(cq->mutex), NULL) ||
+                pthread_cond_init(&(cq->nonempty), NULL)) {
+            free(cq);
+            cq = NULL;
+        }
+    }
+    return (RpcCQ)cq;
+}
+
+void rpc_cq_destroy(RpcCQ q) {
+    CQHead *cq = (CQHead *)q;
+    AsyncCall *ac;
+
+    while ((ac = cq->head) != NULL) {
+        cq->head = ac->next;
+        srpc_free(ac);
+    }
+    pthread_mutex_destroy(&(cq->mutex));
+    pthread_cond_destroy(&(cq->nonempty));
+    free(cq);
+}
+
+static void cq_post(CQHead *cq, AsyncCall *ac) {
+    ac->next = NULL;
+    pthread_mutex_lock(&(cq->mutex));
+    if (cq->head == NULL)
+        cq->head = ac;
+    else
+        cq->tail->next = ac;
+    cq->tail = ac;
+    pthread_cond_signal(&(cq->nonempty));
+    pthread_mutex_unlock(&(cq->mutex));
+}
+
+void async_deliver(AsyncCall *list) {
+    AsyncCall *ac;
+
+    while ((ac = list) != NULL) {
+        list = ac->next;
+        if (ac->cb != NULL) {
+            ac->cb(&(ac->ev));
+            srpc_free(ac);
+        } else if (ac->cq != NULL)
+            cq_post((CQHead *)ac->cq, ac);
+        else
+            srpc_free(ac);
+    }
+}
+
+int rpc_poll(RpcCQ q, RpcEvent *events, int max, int timeout) {
+    CQHead *cq = (CQHead *)q;
+    struct timespec abstime;
+    AsyncCall *ac;
+    int n = 0;
+
+    if (timeout > 0) {
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        abstime.tv_sec = now.tv_sec + timeout / 1000;
+        abstime.tv_nsec = 1000 * now.tv_usec + 1000000 * (timeout % 1000);
+        if (abstime.tv_nsec >= 1000000000) {
+            abstime.tv_sec++;
+            abstime.tv_nsec -= 1000000000;
+        }
+    }
+    pthread_mutex_lock(&(cq->mutex));
+    while (cq->head == NULL && timeout != 0) {
+        if (timeout < 0)
+            pthread_cond_wait(&(cq->nonempty), &(cq->mutex));
+        else if (pthread_cond_timedwait(&(cq->nonempty), &(cq->mutex),
+                                        &abstime) == ETIMEDOUT)
+            break;
+    }
+    while (n < max && (ac = cq->head) != NULL) {
+        cq->head = ac->next;
+        events[n++] = ac->ev;
+        srpc_free(ac);
+    }
+    pthread_mutex_unlock(&(cq->mutex));
+    return n;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * async.h - data structures and entry points for asynchronous calls in the
+ *           RPC system
+ *
+ * an AsyncCall is attached to the connection record while the call is in
+ * progress; the reader and timer threads drive it through its fragments,
+ * and, once it completes or fails, collect it for delivery after they have
+ * released the connection table
+ *
+ * a response sent by one of those threads is carried the same way, so that
+ * they need not wait for its fragments to be acknowledged; it has neither
+ * callback nor completion queue, and is simply freed when done
+ */
+
+#ifndef _ASYNC_H_
+#define _ASYNC_H_
+
+#include "srpc.h"
+
+typedef struct asynccall {
+    struct asynccall *next;
+    RpcEvent ev;		/* reported on completion */
+    RpcCallback cb;		/* if NULL, the event is posted to cq */
+    RpcCQ cq;
+    unsigned char *query;	/* copy of the query, if not sent at once */
+    unsigned qlen;
+    unsigned short last;	/* QUERY or RESPONSE */
+    unsigned char fnum;		/* last packet sent */
+    unsigned char nfrags;
+} AsyncCall;
+
+/*
+ * report each completed call on `list', invoking its callback or posting
+ * it to its completion queue; must be called without the table locked
+ */
+void async_deliver(AsyncCall *list);
+
+#endif /* _ASYNC_H_ */
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * client of the Echo service that keeps a call outstanding on each of
+ * several connections from a single thread, using rpc_call_async()
+ *
+ * completions are collected with rpc_poll(), or, with -k, handled by a
+ * callback that starts the connection's next call
+ */
+#include "srpc.h"
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#define HOST "localhost"
+#define PORT 20000
+#define SERVICE "Echo"
+#define USAGE "./asyncclient [-c nconns] [-l nlines] [-k] [-h host] [-p port] [-s service]"
+#define MAX_CONNS 100
+
+typedef struct conn {
+    RpcConnection rpc;
+    int remaining;		/* calls still to be started */
+    char query[128];
+    char resp[128];
+} Conn;
+
+char *host = HOST;
+char *service = SERVICE;
+unsigned short port = PORT;
+int nlines = 1000;
+int nconns = 4;
+int callbacks = 0;
+
+static Conn conns[MAX_CONNS];
+static RpcCQ cq = NULL;
+static int active = 0;			/* connections with a call in flight */
+static int failures = 0;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t finished = PTHREAD_COND_INITIALIZER;
+
+static const char letters[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+
+static void sgen(char *s) {
+    int i, j, N;
+
+    N = random() % 75 + 1;
+    for (i = 0; i < N; i++) {
+        j = random() % 36;
+        *s++ = letters[j];
+    }
+    *s = '\0';
+}
+
+static void completed(RpcEvent *ev);
+
+/*
+ * start the next call on `c'; returns 1 if one was started
+ */
+static int start(Conn *c) {
+    char buf[76];			/* sgen() writes at most 75 letters */
+    const struct qdecl q = {sizeof(c->query), c->query};
+    RpcCallback cb = callbacks ? completed : NULL;
+
+    if (c->remaining == 0)
+        return 0;
+    c->remaining--;
+    sgen(buf);
+    sprintf(c->query, "ECHO:%s", buf);
+    if (rpc_call_async(c->rpc, &q, strlen(c->query)+1,
+                       c->resp, sizeof(c->resp), cb, cq, c) == NULL) {
+        fprintf(stderr, "rpc_call_async() failed\n");
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * handle a completion; returns 1 if the connection has another call in
+ * flight
+ */
+static int handle(RpcEvent *ev) {
+    Conn *c = (Conn *)ev->arg;
+
+    if (! ev->status || c->resp[0] != '1' ||
+            strcmp(c->query + 5, c->resp + 1) != 0) {	/* skip "ECHO:" */
+        fprintf(stderr, "asynchronous call failed\n");
+        failures++;
+        return 0;
+    }
+    return start(c);
+}
+
+static void completed(RpcEvent *ev) {
+    pthread_mutex_lock(&mutex);
+    if (! handle(ev)) {
+        active--;
+        pthread_cond_signal(&finished);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+int main(int argc, char *argv[]) {
+    int i, j, n;
+    RpcEvent events[MAX_CONNS];
+    struct timeval start_t, stop_t;
+    unsigned long msec, count;
+
+    for (i = 1; i < argc; ) {
+        if (strcmp(argv[i], "-k") == 0) {
+            callbacks = 1;
+            i++;
+            continue;
+        }
+        if ((j = i + 1) == argc) {
+            fprintf(stderr, "usage: %s\n", USAGE);
+            exit(1);
+        }
+        if (strcmp(argv[i], "-h") == 0)
+            host = argv[j];
+        else if (strcmp(argv[i], "-p") == 0)
+            port = atoi(argv[j]);
+        else if (strcmp(argv[i], "-s") == 0)
+            service = argv[j];
+        else if (strcmp(argv[i], "-l") == 0)
+            nlines = atoi(argv[j]);
+        else if (strcmp(argv[i], "-c") == 0) {
+            nconns = atoi(argv[j]);
+            if (nconns > MAX_CONNS)
+                nconns = MAX_CONNS;
+        } else {
+            fprintf(stderr, "Unknown flag: %s %s\n", argv[i], argv[j]);
+        }
+        i = j + 1;
+    }
+    assert(rpc_init(0));
+    if (! callbacks)
+        assert((cq = rpc_cq_create()) != NULL);
+    for (i = 0; i < nconns; i++) {
+        if (!(conns[i].rpc = rpc_connect(host, port, service, 1234l))) {
+            fprintf(stderr, "Failure to connect to %s at %s:%05u\n",
+                    service, host, port);
+            exit(1);
+        }
+        conns[i].remaining = nlines;
+    }
+    gettimeofday(&start_t, NULL);
+    pthread_mutex_lock(&mutex);
+    for (i = 0; i < nconns; i++)
+        active += start(&conns[i]);
+    if (callbacks) {
+        while (active > 0)
+            pthread_cond_wait(&finished, &mutex);
+        pthread_mutex_unlock(&mutex);
+    } else {
+        pthread_mutex_unlock(&mutex);
+        while (active > 0) {
+            n = rpc_poll(cq, events, MAX_CONNS, -1);
+            for (i = 0; i < n; i++)
+                if (! handle(&events[i]))
+                    active--;
+        }
+    }
+    gettimeofday(&stop_t, NULL);
+    if (stop_t.tv_usec < start_t.tv_usec) {
+        stop_t.tv_usec += 1000000;
+        stop_t.tv_sec--;
+    }
+    msec = 1000 * (stop_t.tv_sec - start_t.tv_sec) +
+           (stop_t.tv_usec - start_t.tv_usec) / 1000;
+    count = 0;
+    for (i = 0; i < nconns; i++) {
+        count += nlines - conns[i].remaining;
+        rpc_disconnect(conns[i].rpc);
+    }
+    fprintf(stderr, "%ld lines Echo'd over %d connections in %ld.%03ld seconds, %.3fms/call\n",
+            count, nconns, msec/1000, msec % 1000,
+            (count == 0) ? 0.0 : (double)msec / (double)count);
+    if (cq != NULL)
+        rpc_cq_destroy(cq);
+    exit(failures ? 1 : 0);
+}
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * congestion control benchmark
+ *
+ * serves a Bulk service, whose responses are `len' bytes long and so are
+ * sent as several fragments, from a second RPC context in this process,
+ * and makes `ncalls' calls to it from each of `nthreads' threads, each
+ * with its own connection, while rpc_loss_config() discards `loss'
+ * percent of the packets that either side sends
+ *
+ * the benchmark is run three times: with no congestion control, with a
+ * congestion window for each remote host, and with the window and pacing
+ * (see rpc_congestion_config()); for each run it reports the call rate,
+ * the 50th and 99th percentile and maximum latencies and the calls that
+ * failed, followed by the retransmissions, those put off by the window,
+ * the times senders waited for room in it and the kernel's drops
+ *
+ * -r sets the size of the sockets' receive and send buffers (see
+ * rpc_socket_config()), so that bursts overflow them as well
+ *
+ * -g runs it a fourth time, with no congestion control but with fragments
+ * sent in parity groups of `group' (see rpc_connection_parity()), and also
+ * reports the lost fragments rebuilt from parity
+ */
+#include "srpc.h"
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+
+#define SERVICE "Bulk"
+#define USAGE "./ccbench [-l ncalls] [-n len] [-t nthreads] [-L loss] [-r bytes] [-g group]"
+#define MAX_LEN 65000
+#define MAX_THREADS 64
+
+unsigned short port;
+int ncalls = 200;
+int len = 16384;
+int group = 0;
+int nfailed = 0;
+unsigned long *lats;
+
+static unsigned long now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return 1000000000 * (unsigned long)ts.tv_sec + ts.tv_nsec;
+}
+
+static int cmp(const void *a, const void *b) {
+    unsigned long x = *(const unsigned long *)a;
+    unsigned long y = *(const unsigned long *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * fill `buf' with `n' bytes that differ from fragment to fragment, so that
+ * one rebuilt in the wrong place is noticed
+ */
+static void fill(char *buf, unsigned n) {
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+        buf[i] = 'a' + (i / 7) % 26;
+}
+
+/*
+ * the query is the length of the response wanted, in decimal
+ */
+static unsigned bulk(void *arg, RpcEndpoint *ep, void *qb, unsigned qlen,
+                     void *rb, unsigned rsize) {
+    char n[16];
+    unsigned rlen;
+
+    (void)arg;
+    (void)ep;
+    if (qlen >= sizeof(n))
+        qlen = sizeof(n) - 1;
+    memcpy(n, qb, qlen);
+    n[qlen] = '\0';
+    if ((rlen = (unsigned)atoi(n)) < 1 || rlen > rsize)
+        rlen = 1;
+    fill(rb, rlen);
+    return rlen;
+}
+
+static void *server(void *args) {
+    RpcServeOptions opts = {1, MAX_THREADS, 0, 0, 0};
+
+    (void)rpc_serve((RpcService)args, bulk, NULL, &opts);
+    return NULL;
+}
+
+static RpcConnection connect_bulk(void) {
+    RpcConnection rpc = rpc_connect("localhost", port, SERVICE, 1234l);
+
+    if (rpc != NULL && group > 0)
+        assert(rpc_connection_parity(rpc, group));
+    return rpc;
+}
+
+/*
+ * make `ncalls' calls, recording their latencies in `args'; a call that
+ * fails is counted, and the connection remade, and a response that is
+ * not as sent is counted as a failure
+ */
+static void *client(void *args) {
+    long id = (long)args;
+    unsigned long *lat = lats + id * ncalls;
+    RpcConnection rpc;
+    Q_Decl(query,16);
+    char *resp = (char *)malloc(len);
+    char *want = (char *)malloc(len);
+    unsigned long start;
+    unsigned rlen;
+    int i;
+
+    if (resp == NULL || want == NULL || !(rpc = connect_bulk())) {
+        fprintf(stderr, "Failure to connect to %s on port %05u\n",
+                SERVICE, port);
+        exit(1);
+    }
+    sprintf(query, "%d", len);
+    fill(want, len);
+    for (i = 0; i < ncalls; i++) {
+        start = now();
+        if (!rpc_call(rpc, Q_Arg(query), strlen(query), resp, len,
+                      &rlen) || rlen != (unsigned)len) {
+            __atomic_fetch_add(&nfailed, 1, __ATOMIC_RELAXED);
+            rpc_disconnect(rpc);
+            if (!(rpc = connect_bulk())) {
+                fprintf(stderr, "Failure to reconnect\n");
+                exit(1);
+            }
+        } else if (memcmp(resp, want, len) != 0)
+            __atomic_fetch_add(&nfailed, 1, __ATOMIC_RELAXED);
+        lat[i] = now() - start;
+    }
+    rpc_disconnect(rpc);
+    free(want);
+    free(resp);
+    return NULL;
+}
+
+/*
+ * run the benchmark from `nthreads' threads with congestion control
+ * `flags', reporting each line preceded by `label'
+ */
+static void run(int nthreads, int flags, char *label) {
+    pthread_t th[MAX_THREADS];
+    unsigned long start, wall;
+    RpcStats s0, st;
+    int i, n = ncalls * nthreads;
+
+    assert(rpc_congestion_config(flags));
+    nfailed = 0;
+    rpc_stats(&s0);
+    start = now();
+    for (i = 0; i < nthreads; i++)
+        if (pthread_create(&th[i], NULL, client, (void *)(long)i)) {
+            fprintf(stderr, "Failure to start client thread\n");
+            exit(-1);
+        }
+    for (i = 0; i < nthreads; i++)
+        pthread_join(th[i], NULL);
+    wall = now() - start;
+    rpc_stats(&st);
+    qsort(lats, n, sizeof(unsigned long), cmp);
+    printf("%s%d calls of %d bytes: %.0f calls/s, p50 %.1fms, "
+           "p99 %.1fms, max %.1fms, %d failed\n", label, n, len,
+           n * 1e9 / wall, lats[n / 2] / 1e6, lats[n * 99 / 100] / 1e6,
+           lats[n - 1] / 1e6, nfailed);
+    printf("%s%lu packets retried, %lu deferred by the window; "
+           "%lu waits for the window; %lu dropped by the kernel\n", label,
+           st.pktsRetried - s0.pktsRetried,
+           st.retriesDeferred - s0.retriesDeferred,
+           st.windowWaits - s0.windowWaits,
+           st.pktsDropped - s0.pktsDropped);
+    if (group > 0)
+        printf("%s%lu fragments rebuilt from parity\n", label,
+               st.fragsRepaired - s0.fragsRepaired);
+}
+
+int main(int argc, char *argv[]) {
+    RpcContext sctx;
+    RpcService rps;
+    pthread_t thr;
+    char addr[16];
+    int nthreads = 16;
+    int loss = 2;
+    int bufsize = 0;
+    int g = 0;
+    int i, j;
+
+    for (i = 1; i < argc; ) {
+        if ((j = i + 1) == argc) {
+            fprintf(stderr, "usage: %s\n", USAGE);
+            exit(1);
+        }
+        if (strcmp(argv[i], "-l") == 0)
+            ncalls = atoi(argv[j]);
+        else if (strcmp(argv[i], "-n") == 0)
+            len = atoi(argv[j]);
+        else if (strcmp(argv[i], "-L") == 0)
+            loss = atoi(argv[j]);
+        else if (strcmp(argv[i], "-r") == 0)
+            bufsize = atoi(argv[j]);
+        else if (strcmp(argv[i], "-g") == 0)
+            g = atoi(argv[j]);
+        else if (strcmp(argv[i], "-t") == 0) {
+            nthreads = atoi(argv[j]);
+            if (nthreads > MAX_THREADS)
+                nthreads = MAX_THREADS;
+        } else {
+            fprintf(stderr, "Unknown flag: %s %s\n", argv[i], argv[j]);
+        }
+        i = j + 1;
+    }
+    if (len < 1 || len > MAX_LEN || ncalls < 1 || nthreads < 1 ||
+            loss < 0 || loss > 100 || g < 0 || g > 255) {
+        fprintf(stderr, "usage: %s\n", USAGE);
+        exit(1);
+    }
+    assert((lats = (unsigned long *)malloc(ncalls * nthreads *
+                                           sizeof(unsigned long))));
+    if (bufsize > 0)
+        assert(rpc_socket_config(bufsize, bufsize));
+    assert(rpc_init(0));
+    assert((sctx = rpc_context_create(0, -1)) != NULL);
+    assert((rps = rpc_context_offer(sctx, SERVICE)) != NULL);
+    assert(pthread_create(&thr, NULL, server, rps) == 0);
+    rpc_context_details(sctx, addr, &port);
+    assert(rpc_loss_config(loss));
+    run(nthreads, 0, "none:   ");
+    run(nthreads, RPC_CC_WINDOW, "window: ");
+    run(nthreads, RPC_CC_WINDOW | RPC_CC_PACING, "paced:  ");
+    if ((group = g) > 0)
+        run(nthreads, 0, "parity: ");
+    return 0;
+}
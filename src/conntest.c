@@ -32,11 +32,19 @@
 /*
  * connection test client
  *
- * usage: ./conntest [-a attempts] [-h host] [-p port] [-s service]
+ * usage: ./conntest [-a attempts] [-m count] [-w warm] [-h host] [-p port]
+ *                   [-s service]
  *
  * attempts to connect to the specified host, port, and service the
  * specified number of times; each time, if successful, issues rpc_disconnect
  *
+ * with -m, then establishes `count' connections at once with
+ * rpc_connect_many(), reporting how long that took
+ *
+ * with -w, then creates a pool of `warm' connections and takes, uses and
+ * returns `attempts' connections from it, reporting the mean time to
+ * obtain a connection and make its first call
+ *
  * tests for any memory leaks in the runtime associated with connection
  * records
  */
@@ -53,7 +61,15 @@
 #define PORT 20000
 #define SERVICE "Echo"
 #define ATTEMPTS 10
-#define USAGE "./conntest [-a attempts] [-h host] [-p port] [-s service]"
+#define USAGE "./conntest [-a attempts] [-m count] [-w warm] [-h host] [-p port] [-s service]"
+
+static double elapsed(struct timeval *start) {
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return 1000.0 * (now.tv_sec - start->tv_sec) +
+           (now.tv_usec - start->tv_usec) / 1000.0;
+}
 
 int main(int argc, char *argv[]) {
     RpcConnection rpc;
@@ -61,13 +77,21 @@ int main(int argc, char *argv[]) {
     char *service;
     unsigned short port;
     int i, j;
-    int attempts;
+    int attempts, count, warm;
+    RpcTarget *targets;
+    RpcPool pool;
+    struct timeval start;
+    char resp[100];
+    unsigned rlen;
+    Q_Decl(query, 100);
     struct timespec time_delay = {1, 0};	/* delay one second */
 
     host = HOST;
     service = SERVICE;
     port = PORT;
     attempts = ATTEMPTS;
+    count = 0;
+    warm = 0;
     for (i = 1; i < argc; ) {
         if ((j = i + 1) == argc) {
             fprintf(stderr, "usage: %s\n", USAGE);
@@ -81,12 +105,17 @@ int main(int argc, char *argv[]) {
             service = argv[j];
         else if (strcmp(argv[i], "-a") == 0)
             attempts = atoi(argv[j]);
+        else if (strcmp(argv[i], "-m") == 0)
+            count = atoi(argv[j]);
+        else if (strcmp(argv[i], "-w") == 0)
+            warm = atoi(argv[j]);
         else {
             fprintf(stderr, "Unknown flag: %s %s\n", argv[i], argv[j]);
         }
         i = j + 1;
     }
     assert(rpc_init(0));
+    gettimeofday(&start, NULL);
     for (i = 0; i < attempts; i++) {
         rpc = rpc_connect(host, port, service, 0);
         if (rpc != NULL) {
@@ -98,6 +127,47 @@ int main(int argc, char *argv[]) {
                    host, port, service);
         }
     }
+    printf("mean time to connect: %.3f ms\n", elapsed(&start) / attempts);
+    if (count > 0) {
+        targets = (RpcTarget *)malloc(count * sizeof(RpcTarget));
+        assert(targets != NULL);
+        for (i = 0; i < count; i++) {
+            targets[i].host = host;
+            targets[i].port = port;
+            targets[i].svcName = service;
+        }
+        gettimeofday(&start, NULL);
+        j = rpc_connect_many(targets, count, 0);
+        printf("%d of %d connections established in %.3f ms\n",
+               j, count, elapsed(&start));
+        for (i = 0; i < count; i++)
+            if (targets[i].rpc != NULL)
+                rpc_disconnect(targets[i].rpc);
+        free(targets);
+    }
+    if (warm > 0) {
+        double total = 0.0;
+
+        assert((pool = rpc_pool_create(host, port, service, warm)) != NULL);
+        nanosleep(&time_delay, NULL);		/* let the pool fill */
+        sprintf(query, "ECHO:pool");
+        for (i = 0; i < attempts; i++) {
+            gettimeofday(&start, NULL);
+            rpc = rpc_pool_get(pool);
+            if (rpc == NULL ||
+                    !rpc_call(rpc, Q_Arg(query), strlen(query) + 1,
+                              resp, sizeof(resp), &rlen)) {
+                printf("Failure: pooled call(%s,%05u,%s)\n",
+                       host, port, service);
+                continue;
+            }
+            total += elapsed(&start);
+            rpc_pool_put(pool, rpc);
+        }
+        printf("mean time to first response from pool: %.3f ms\n",
+               total / attempts);
+        rpc_pool_destroy(pool);
+    }
     nanosleep(&time_delay, NULL); /* gives time for harvesting connections
                                     in case running it in valgrind */
     return 0;
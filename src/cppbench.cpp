@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * echo benchmark for the C++ interface (srpc.hpp)
+ *
+ * as a client, makes `nlines' ECHO calls on each of `nconns' connections,
+ * first from one thread per connection using the blocking
+ * Connection::call(), then from one coroutine per connection using
+ * co_await Connection::async_call(), all started from a single thread;
+ * reports the mean latency and the throughput of each
+ *
+ * with -S, instead serves the Echo service from coroutines awaiting
+ * Service::next(), responding as echoserver does
+ */
+
+#include "srpc.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <latch>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#define HOST "localhost"
+#define PORT 20000
+#define SERVICE "Echo"
+#define USAGE "./cppbench [-c nconns] [-l nlines] [-h host] [-p port] [-s service] [-S]"
+#define MAX_CONNS 100
+#define SERVERS 4
+
+using Clock = std::chrono::steady_clock;
+
+static const char *host = HOST;
+static const char *service = SERVICE;
+static unsigned short port = PORT;
+static int nlines = 1000;
+static int nconns = 4;
+
+static const char letters[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+
+/*
+ * what each connection needs for one call at a time
+ */
+struct Line {
+    char query[128];
+    char resp[128];
+    std::size_t qlen;
+    unsigned long calls = 0;
+    double usecs = 0.0;		/* total latency */
+    bool failed = false;
+
+    void sgen() {
+        int i, N = random() % 75 + 1;
+
+        strcpy(query, "ECHO:");
+        for (i = 0; i < N; i++)
+            query[5 + i] = letters[random() % 36];
+        query[5 + i] = '\0';
+        qlen = 5 + N + 1;
+    }
+
+    std::span<const std::byte> q() const {
+        return std::as_bytes(std::span(query, qlen));
+    }
+
+    std::span<std::byte> r() {
+        return std::as_writable_bytes(std::span(resp));
+    }
+
+    bool check(const srpc::Result &res) const {
+        return res && resp[0] == '1' && strcmp(query + 5, resp + 1) == 0;
+    }
+
+    void record(Clock::time_point start) {
+        calls++;
+        usecs += std::chrono::duration<double, std::micro>(Clock::now() -
+                 start).count();
+    }
+};
+
+static void blocking(srpc::Connection *conn, Line *line) {
+    for (int i = 0; i < nlines; i++) {
+        line->sgen();
+        Clock::time_point start = Clock::now();
+        srpc::Result res = conn->call(line->q(), line->r());
+        if (! line->check(res)) {
+            line->failed = true;
+            break;
+        }
+        line->record(start);
+    }
+}
+
+static srpc::Task coroutine(srpc::Connection *conn, Line *line,
+                            std::latch *finished) {
+    for (int i = 0; i < nlines; i++) {
+        line->sgen();
+        Clock::time_point start = Clock::now();
+        srpc::Result res = co_await conn->async_call(line->q(), line->r());
+        if (! line->check(res)) {
+            line->failed = true;
+            break;
+        }
+        line->record(start);
+    }
+    finished->count_down();
+}
+
+static bool report(const char *how, std::vector<Line> &lines,
+                   Clock::time_point start) {
+    double secs = std::chrono::duration<double>(Clock::now() - start).count();
+    unsigned long calls = 0;
+    double usecs = 0.0;
+    bool failed = false;
+
+    for (Line &l : lines) {
+        calls += l.calls;
+        usecs += l.usecs;
+        failed = failed || l.failed;
+    }
+    fprintf(stderr, "%-10s %d conns: %lu calls in %.3f seconds, "
+            "%.1fus/call latency, %.0f calls/s\n", how, nconns, calls, secs,
+            calls ? usecs / calls : 0.0, calls / secs);
+    if (failed)
+        fprintf(stderr, "%s: some calls failed\n", how);
+    return ! failed;
+}
+
+static srpc::Task echo(srpc::Service *svc) {
+    std::vector<char> resp(65536);
+
+    for (;;) {
+        srpc::Query q = co_await svc->next();
+        if (! q)			/* the service has been reset */
+            co_return;
+        std::span<const std::byte> d = q.data();
+        const char *query = reinterpret_cast<const char *>(d.data());
+        std::size_t rlen = 1;
+
+        resp[0] = '0';
+        if (d.size() > 5 && strncmp(query, "ECHO:", 5) == 0 &&
+                d.size() - 5 + 1 <= resp.size()) {
+            resp[0] = '1';
+            memcpy(resp.data() + 1, query + 5, d.size() - 5);
+            rlen += d.size() - 5;
+        }
+        svc->respond(q, std::as_bytes(std::span(resp.data(), rlen)));
+    }
+}
+
+static int serve() {
+    if (! srpc::init(port)) {
+        fprintf(stderr, "Failure to initialize rpc system\n");
+        return 1;
+    }
+    srpc::Service svc(service, srpc::Service::Coroutines);
+    if (! svc) {
+        fprintf(stderr, "Failure offering %s service\n", service);
+        return 1;
+    }
+    for (int i = 0; i < SERVERS; i++)
+        echo(&svc);
+    for (;;)
+        pause();
+}
+
+int main(int argc, char *argv[]) {
+    bool server = false;
+    int i, j;
+
+    for (i = 1; i < argc; ) {
+        if (strcmp(argv[i], "-S") == 0) {
+            server = true;
+            i++;
+            continue;
+        }
+        if ((j = i + 1) == argc) {
+            fprintf(stderr, "usage: %s\n", USAGE);
+            exit(1);
+        }
+        if (strcmp(argv[i], "-h") == 0)
+            host = argv[j];
+        else if (strcmp(argv[i], "-p") == 0)
+            port = atoi(argv[j]);
+        else if (strcmp(argv[i], "-s") == 0)
+            service = argv[j];
+        else if (strcmp(argv[i], "-l") == 0)
+            nlines = atoi(argv[j]);
+        else if (strcmp(argv[i], "-c") == 0) {
+            nconns = atoi(argv[j]);
+            if (nconns > MAX_CONNS)
+                nconns = MAX_CONNS;
+        } else {
+            fprintf(stderr, "Unknown flag: %s %s\n", argv[i], argv[j]);
+        }
+        i = j + 1;
+    }
+    if (server)
+        return serve();
+    if (! srpc::init()) {
+        fprintf(stderr, "Failure to initialize rpc system\n");
+        exit(1);
+    }
+    std::vector<srpc::Connection> conns;
+    for (i = 0; i < nconns; i++) {
+        conns.emplace_back(host, port, service, 1234l);
+        if (! conns.back()) {
+            fprintf(stderr, "Failure to connect to %s at %s:%05u\n",
+                    service, host, port);
+            exit(1);
+        }
+    }
+    bool ok = true;
+    {
+        std::vector<Line> lines(nconns);
+        std::vector<std::thread> threads;
+        Clock::time_point start = Clock::now();
+        for (i = 0; i < nconns; i++)
+            threads.emplace_back(blocking, &conns[i], &lines[i]);
+        for (std::thread &t : threads)
+            t.join();
+        ok = report("blocking", lines, start) && ok;
+    }
+    {
+        std::vector<Line> lines(nconns);
+        std::latch finished(nconns);
+        Clock::time_point start = Clock::now();
+        for (i = 0; i < nconns; i++)
+            coroutine(&conns[i], &lines[i], &finished);
+        finished.wait();
+        ok = report("coroutine", lines, start) && ok;
+    }
+    conns.clear();
+    exit(ok ? 0 : 1);
+}
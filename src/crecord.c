@@ -35,6 +35,12 @@
 
 #include "crecord.h"
 #include "ctable.h"
+#include "fec.h"
+#include "slab.h"
+#include "arena.h"
+#include "affinity.h"
+#include "srpcdefs.h"
+#include "srpcmalloc.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -45,53 +51,165 @@ const char *statenames[] = {
     "FACK_RECEIVED", "FRAGMENT_RECEIVED", "FACK_SENT", "SEQNO_SENT"
 };
 
+#define CRECORDS_PER_BLOCK 256
+
+/*
+ * a record is taken from the slab of the creating thread's NUMA node, whose
+ * blocks come from that node's arena region, and is returned to it; its
+ * active parts come from a second slab of the same node
+ */
+static Slab crSlab[MAX_NODES];
+static Slab actSlab[MAX_NODES];
+static pthread_once_t crOnce = PTHREAD_ONCE_INIT;
+
+static void crslab_init(void) {
+    int i;
+
+    for (i = 0; i < affinity_nodes(); i++) {
+        crSlab[i] = slab_create(sizeof(CRecord), CRECORDS_PER_BLOCK,
+                                arena_alloc);
+        actSlab[i] = slab_create(sizeof(CActive), CRECORDS_PER_BLOCK,
+                                 arena_alloc);
+    }
+}
+
 CRecord *crecord_create(RpcEndpoint *ep, unsigned long seqno) {
-    CRecord *cr = (CRecord *)malloc(sizeof(CRecord));
+    int node = affinity_node();
+    CRecord *cr;
+
+    pthread_once(&crOnce, crslab_init);
+    if (crSlab[node] == NULL || actSlab[node] == NULL)
+        return NULL;
+    cr = (CRecord *)slab_alloc(crSlab[node]);
     if (cr) {
+        cr->node = (unsigned char)node;
         cr->nxt_ep = NULL;
         cr->nxt_id = NULL;
         cr->link = NULL;
-        cr->mutex = ctable_getMutex();
-        pthread_cond_init(&cr->stateChanged, NULL);
-        cr->ep = ep;
+        cr->stateChanged = NULL;
+        spin_init(&cr->spin, spin_default());
+        cr->ep = *ep;
         cr->cid = 0;
         cr->svc = NULL;
-        cr->pl = NULL;
-        cr->resp = NULL;
-        cr->size = 0;
-        cr->nattempts = 0;
-        cr->ticks = 0;
-        cr->ticksLeft = 0;
+        cr->table = NULL;
+        cr->peer = NULL;
+        cr->act = NULL;
         cr->state = 0;
         cr->seqno = seqno;
-        cr->lastFrag = 0;
-        cr->pingsTilPurge = PINGS_BEFORE_PURGE;
-        cr->ticksTilPing = TICKS_BETWEEN_PINGS;
+        cr->group = 0;
+        cr->poll = 0;
     }
     return (cr);
 }
 
 void crecord_dump(CRecord *cr, char *leadString) {
-    endpoint_dump(cr->ep, leadString);
-    fprintf(stderr, "seqno: %ld, state: %s\n", cr->seqno, statenames[cr->state]);
+    endpoint_dump(&cr->ep, leadString);
+    fprintf(stderr, "seqno: %u, state: %s\n", cr->seqno, statenames[cr->state]);
+}
+
+int crecord_unacked(unsigned long st) {
+    return (st == ST_CONNECT_SENT || st == ST_QUERY_SENT ||
+            st == ST_RESPONSE_SENT || st == ST_DISCONNECT_SENT ||
+            st == ST_FRAGMENT_SENT || st == ST_SEQNO_SENT);
+}
+
+/*
+ * a packet is acknowledged when its record leaves an unacked state for
+ * any state but ST_TIMEDOUT; its round trip is only measured if it was
+ * never retransmitted
+ */
+static void account(CRecord *cr, unsigned long state) {
+    CActive *a = cr->act;		/* as an unacked packet is retained */
+    unsigned long now = spin_clock();
+
+    if (crecord_unacked(cr->state))
+        peer_done(cr->peer, state != ST_TIMEDOUT,
+                  (a->nattempts == ATTEMPTS && now > a->sentAt) ?
+                  now - a->sentAt : 0);
+    if (crecord_unacked(state)) {
+        if (a->sentAt < now)		/* unless paced (see peer.h) */
+            a->sentAt = now;
+        peer_sent(cr->peer);
+    }
 }
 
 void crecord_setState(CRecord *cr, unsigned long state) {
+    CActive *a = cr->act;
+
+    if (cr->peer != NULL && state != cr->state)
+        account(cr, state);
     cr->state = state;
-    cr->ticksTilPing = TICKS_BETWEEN_PINGS;
-    cr->pingsTilPurge = PINGS_BEFORE_PURGE;
-    pthread_cond_broadcast(&cr->stateChanged);
+    if (state == ST_IDLE && a != NULL) {
+        srpc_free(a->pl);
+        a->pl = NULL;
+        a->size = 0;
+        if (a->fec) {
+            fec_destroy(a->fec);
+            a->fec = NULL;
+        }
+        crecord_release(cr);
+    }
+    if (cr->stateChanged)
+        pthread_cond_broadcast(cr->stateChanged);
+}
+
+int crecord_activate(CRecord *cr) {
+    CActive *a;
+
+    if (cr->act != NULL)
+        return 1;
+    if ((a = (CActive *)slab_alloc(actSlab[cr->node])) == NULL)
+        return 0;
+    a->pl = NULL;
+    a->resp = NULL;
+    a->async = NULL;
+    a->fec = NULL;
+    a->sentAt = 0;
+    a->ubuf = NULL;
+    a->size = 0;
+    a->ulen = 0;
+    a->nattempts = 0;
+    a->ticks = 0;
+    a->ticksLeft = 0;
+    a->lastFrag = 0;
+    a->firstFrag = 0;
+    a->path = 0;
+    a->held = 0;
+    cr->act = a;
+    return 1;
+}
+
+/*
+ * free the active part `a' of a record on NUMA node `node'
+ */
+static void active_free(CActive *a, unsigned node) {
+    srpc_free(a->pl);
+    srpc_free(a->resp);
+    if (a->fec)
+        fec_destroy(a->fec);
+    slab_free(actSlab[node], a);
+}
+
+void crecord_release(CRecord *cr) {
+    CActive *a = cr->act;
+
+    if (a == NULL || cr->state != ST_IDLE || a->held || a->async != NULL)
+        return;
+    cr->act = NULL;
+    active_free(a, cr->node);
 }
 
 void crecord_setPayload(CRecord *cr, void *pl, unsigned size,
                         unsigned short nattempts, unsigned short ticks) {
-    if (cr->pl)
-        free(cr->pl);
-    cr->pl = pl;
-    cr->size = size;
-    cr->nattempts = nattempts;
-    cr->ticks = ticks;
-    cr->ticksLeft = ticks;
+    CActive *a = cr->act;
+
+    if (a->pl != pl)
+        srpc_free(a->pl);
+    a->pl = pl;
+    a->size = size;
+    a->nattempts = nattempts;
+    a->ticks = ticks;
+    a->ticksLeft = ticks;
 }
 
 void crecord_setService(CRecord *cr, SRecord *sr) {
@@ -111,21 +229,60 @@ static int matchedState(unsigned long st, unsigned long *states, int n) {
     return n;
 }
 
+/*
+ * poll, with the table unlocked, for up to `budget' nanoseconds since
+ * `start' for the state of `cr' to become one of `states'
+ * returns with the table locked
+ */
+static void spinForState(CRecord *cr, unsigned long *states, int n,
+                         unsigned long start, unsigned long budget) {
+    unsigned long i;
+
+    ctable_unlock(cr->table);
+    for (i = 0; spin_clock() - start < budget; i++) {
+        if (matchedState(__atomic_load_n(&cr->state, __ATOMIC_ACQUIRE),
+                         states, n) < n)
+            break;
+        spin_pause(i);
+    }
+    ctable_lock(cr->table);
+}
+
+void crecord_setSpin(CRecord *cr, unsigned usecs) {
+    spin_setLimit(&cr->spin, usecs);
+}
+
 unsigned long crecord_waitForState(CRecord *cr, unsigned long *states, int n) {
+    unsigned long start, budget;
     int i;
-    while ((i = matchedState(cr->state, states, n)) == n)
-        pthread_cond_wait(&cr->stateChanged, cr->mutex);
+
+    if ((i = matchedState(cr->state, states, n)) < n)
+        return states[i];
+    start = spin_clock();
+    if ((budget = spin_budget(&cr->spin)) > 0)
+        spinForState(cr, states, n, start, budget);
+    while ((i = matchedState(cr->state, states, n)) == n) {
+        if (cr->stateChanged == NULL) {
+            pthread_cond_t *c = (pthread_cond_t *)malloc(sizeof(*c));
+            if (c == NULL)
+                return ST_TIMEDOUT;
+            pthread_cond_init(c, NULL);
+            cr->stateChanged = c;
+        }
+        ctable_wait(cr->table, cr->stateChanged);
+    }
+    spin_record(&cr->spin, spin_clock() - start);
     return states[i];
 }
 
 void crecord_destroy(CRecord *cr) {
     if (cr) {
-        if (cr->ep)
-            free(cr->ep);
-        if (cr->pl)
-            free(cr->pl);
-        if (cr->resp)
-            free(cr->resp);
-        free(cr);
+        if (cr->stateChanged) {
+            pthread_cond_destroy(cr->stateChanged);
+            free(cr->stateChanged);
+        }
+        if (cr->act != NULL)
+            active_free(cr->act, cr->node);
+        slab_free(crSlab[cr->node], cr);
     }
 }
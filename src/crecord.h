@@ -37,6 +37,8 @@
 
 #include "endpoint.h"
 #include "stable.h"
+#include "spin.h"
+#include "peer.h"
 #include <pthread.h>
 
 #define ST_IDLE	1
@@ -53,47 +55,101 @@
 #define ST_FACK_SENT 12
 #define ST_SEQNO_SENT 13
 
-#define TICKS_BETWEEN_PINGS (60 * 50)	/* 1 minute */
+#define TICKS_BETWEEN_PINGS (60 * 50)	/* 1 minute, at first (see peer.h) */
 #define PINGS_BEFORE_PURGE 3
 
 extern const char *statenames[];
 
-typedef struct c_record {
-    struct c_record *nxt_ep;
-    struct c_record *nxt_id;
-    struct c_record *link;
-    unsigned long seqno;
-    unsigned long state;
-    pthread_mutex_t *mutex;
-    pthread_cond_t stateChanged;
-    RpcEndpoint *ep;
-    SRecord *svc;
-    unsigned long cid;
+struct ctable;
+struct fec;
+
+/*
+ * the state of the call or response in progress on a connection, attached
+ * to its record when it leaves ST_IDLE, and released when it returns there
+ * unless a caller still holds it to collect the outcome
+ */
+typedef struct c_active {
     void *pl;
     void *resp;
+    void *async;			/* asynchronous call in progress */
+    struct fec *fec;			/* reassembly in parity groups */
+    unsigned long sentAt;		/* when its packet became unacked */
+    unsigned char *ubuf;		/* response buffer posted by caller */
     unsigned size;
+    unsigned ulen;			/* size of ubuf, then of response */
     unsigned short nattempts;
     unsigned short ticks;
     unsigned short ticksLeft;
-    unsigned short pingsTilPurge;
-    unsigned short ticksTilPing;
     unsigned char lastFrag;
+    unsigned char firstFrag;		/* of the parity group sent */
+    unsigned char path;			/* the parity group took, see path.h */
+    unsigned char held;			/* by a caller awaiting the outcome */
+} CActive;
+
+/*
+ * a connection record is laid out so that an idle connection costs a single
+ * slab object: the endpoint is held inline, the condition variable is only
+ * created when a thread first waits on the record, and the state of a call
+ * is only attached while one is in progress; sequence numbers and ids fit
+ * in 32 bits, as they do in packets and in RpcConnection handles
+ */
+typedef struct c_record {
+    struct c_record *nxt_ep;
+    struct c_record *nxt_id;
+    struct c_record *link;
+    RpcEndpoint ep;
+    SRecord *svc;
+    struct ctable *table;		/* set when inserted in a table */
+    Peer *peer;				/* of its host, set likewise, counted */
+    pthread_cond_t *stateChanged;	/* NULL until first waiter */
+    CActive *act;			/* NULL while idle */
+    Spinner spin;			/* how long waiters poll first */
+    unsigned seqno;
+    unsigned cid;
+    unsigned short poll;		/* usecs caller reads for response */
+    unsigned char state;
+    unsigned char group;		/* fragments per parity group sent */
+    unsigned char node;			/* NUMA node of its slab */
 } CRecord;
 
 /*
- * create a new connection record
+ * create a new connection record; the endpoint is copied into the record
  *
  * returns NULL if error
  */
 CRecord *crecord_create(RpcEndpoint *ep, unsigned long seqno);
 
+/*
+ * returns 1 if a record in `state' has a packet awaiting acknowledgement,
+ * which the timer retransmits, 0 otherwise
+ */
+int crecord_unacked(unsigned long state);
+
 /*
  * set the connection record state; signals the condition variable, as well
+ * entering ST_IDLE releases the retained payload, as it is never resent,
+ * and any reassembly state for parity groups, and then the active part, as
+ * crecord_release() does;
+ * entering or leaving an unacked state is accounted to the record's peer
  */
 void crecord_setState(CRecord *cr, unsigned long state);
 
 /*
- * set the connection record payload
+ * attach an active part to `cr', if it has none, before it leaves ST_IDLE
+ * returns 1 if it has one, 0 if it could not be allocated
+ */
+int crecord_activate(CRecord *cr);
+
+/*
+ * release the active part of `cr' if it is in ST_IDLE, and neither a caller
+ * nor an asynchronous call holds it
+ */
+void crecord_release(CRecord *cr);
+
+/*
+ * set the connection record payload; the previous payload, if any, is
+ * returned via srpc_free() unless it is being reused as the new payload
+ * the record must have an active part
  */
 void crecord_setPayload(CRecord *cr, void *payload, unsigned size,
                         unsigned short nattempts, unsigned short ticks);
@@ -109,10 +165,18 @@ void crecord_setService(CRecord *cr, SRecord *sr);
 void crecord_setCID(CRecord *cr, unsigned long id);
 
 /*
- * wait until connection record reaches one of supplied states
+ * wait, with the table locked, for the state of `cr' to become one of
+ * `states'; the waiter first polls with the table unlocked, for a time
+ * calibrated from the record's recent waits
  */
 unsigned long crecord_waitForState(CRecord *cr, unsigned long *states, int n);
 
+/*
+ * set the most microseconds for which a waiter on `cr' polls before
+ * sleeping, keeping the record's history of waits (see spin.h)
+ */
+void crecord_setSpin(CRecord *cr, unsigned usecs);
+
 /*
  * destroy a CRecord
  */
@@ -34,49 +34,133 @@
  */
 
 #include "ctable.h"
+#include "outbox.h"
+#include "peer.h"
+#include "spin.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <sys/types.h>
 #include <unistd.h>
 
-#define CTABLE_SIZE 31
+/*
+ * buckets in each of the two hash tables; must be a power of two.  the
+ * default is sized for a server holding a million idle connections
+ * (chains of 16), and costs 1 MiB per context and a walk of the empty
+ * buckets on each timer tick; build with a smaller -DCTABLE_SIZE for
+ * processes that hold few connections
+ */
+#ifndef CTABLE_SIZE
+#define CTABLE_SIZE 65536
+#endif /* CTABLE_SIZE */
+#if CTABLE_SIZE <= 0 || (CTABLE_SIZE & (CTABLE_SIZE - 1)) != 0
+#error "CTABLE_SIZE must be a power of two"
+#endif
 
-static CRecord *cr_by_ep[CTABLE_SIZE];	/* table by endpoint */
-static CRecord *cr_by_id[CTABLE_SIZE];	/* table by identifier */
-static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-static unsigned short ctr = 0;
+struct ctable {
+    CRecord *by_ep[CTABLE_SIZE];	/* table by endpoint */
+    CRecord *by_id[CTABLE_SIZE];	/* table by identifier */
+    PTable *peers;			/* of the hosts of its records */
+    pthread_mutex_t mutex;
+    unsigned short ctr;
+    /* lock statistics, guarded by the lock itself */
+    unsigned long acquired;		/* when the lock was last taken */
+    unsigned long holds;
+    unsigned long holdNsecs;
+    unsigned long holdMax;
+};
 
-void ctable_lock(void) {
-    pthread_mutex_lock(&mutex);
+/*
+ * a connection identifier is the pid of its client in the upper 16 bits
+ * and a per-process counter in the lower, so fold the one into the other
+ */
+static unsigned id_hash(unsigned long id) {
+    return (unsigned)(id ^ (id >> 16)) & (CTABLE_SIZE - 1);
 }
 
-void ctable_unlock(void) {
-    pthread_mutex_unlock(&mutex);
+static __thread int held = 0;		/* calling thread holds a lock */
+
+static void held_from(CTable *ct, unsigned long now) {
+    held = 1;
+    ct->acquired = now;
 }
 
-pthread_mutex_t *ctable_getMutex(void) {
-    return &mutex;
+static void held_until(CTable *ct, unsigned long now) {
+    unsigned long d = now - ct->acquired;
+
+    ct->holds++;
+    ct->holdNsecs += d;
+    if (d > ct->holdMax)
+        ct->holdMax = d;
+    held = 0;
 }
 
-void ctable_init(void) {
-    int i;
+void ctable_lock(CTable *ct) {
+    pthread_mutex_lock(&ct->mutex);
+    held_from(ct, spin_clock());
+}
 
-    pthread_mutex_init(&mutex, NULL);
-    for (i = 0; i < CTABLE_SIZE; i++) {
-        cr_by_ep[i] = NULL;
-        cr_by_id[i] = NULL;
+void ctable_unlock(CTable *ct) {
+    held_until(ct, spin_clock());
+    pthread_mutex_unlock(&ct->mutex);
+    if (outbox_pending())
+        outbox_flush();
+}
+
+int ctable_held(void) {
+    return held;
+}
+
+void ctable_wait(CTable *ct, pthread_cond_t *cond) {
+    if (outbox_pending()) {		/* transmit what the waiter built */
+        ctable_unlock(ct);
+        ctable_lock(ct);
+        return;
+    }
+    held_until(ct, spin_clock());
+    pthread_cond_wait(cond, &ct->mutex);
+    held_from(ct, spin_clock());
+}
+
+void ctable_stats(CTable *ct, unsigned long *n, unsigned long *nsecs,
+                  unsigned long *max) {
+    *n = ct->holds;
+    *nsecs = ct->holdNsecs;
+    *max = ct->holdMax;
+}
+
+CTable *ctable_create(void) {
+    CTable *ct;
+
+    if ((ct = (CTable *)malloc(sizeof(CTable))) == NULL)
+        return NULL;
+    memset(ct, 0, sizeof(CTable));
+    if ((ct->peers = ptable_create()) == NULL) {
+        free(ct);
+        return NULL;
     }
+    pthread_mutex_init(&ct->mutex, NULL);
+    return ct;
 }
 
-unsigned long ctable_newSubport(void) {
+void ctable_destroy(CTable *ct) {
+    ptable_destroy(ct->peers);
+    pthread_mutex_destroy(&ct->mutex);
+    free(ct);
+}
+
+PTable *ctable_peers(CTable *ct) {
+    return ct->peers;
+}
+
+unsigned long ctable_newSubport(CTable *ct) {
     unsigned long subport;
     pid_t pid;
 
-    if (++ctr > 0x7fff)
-        ctr = 1;
+    if (++ct->ctr > 0x7fff)
+        ct->ctr = 1;
     pid = getpid();
-    subport = (pid & 0xffff) << 16 | ctr;
+    subport = (pid & 0xffff) << 16 | ct->ctr;
     // FIXME: black magic
     // patch to address connection failures on some systems...
     // Not sure what the actual pathology is; assume inconsistency in
@@ -85,27 +169,33 @@ unsigned long ctable_newSubport(void) {
     return subport;
 }
 
-void ctable_insert(CRecord *cr) {
-    unsigned hash = endpoint_hash(cr->ep, CTABLE_SIZE);
-    unsigned indx = cr->cid % CTABLE_SIZE;
+void ctable_insert(CTable *ct, CRecord *cr) {
+    unsigned hash = endpoint_hash(&cr->ep, CTABLE_SIZE);
+    unsigned indx = id_hash(cr->cid);
 #ifdef DEBUG
     crecord_dump(cr, "ctable_insert");
 #endif /* DEBUG */
-    cr->nxt_ep = cr_by_ep[hash];
-    cr_by_ep[hash] = cr;
-    cr->nxt_id = cr_by_id[indx];
-    cr_by_id[indx] = cr;
+    cr->table = ct;
+    if ((cr->peer = ptable_lookup(ct->peers, &cr->ep)) != NULL &&
+            crecord_unacked(cr->state)) {
+        cr->act->sentAt = spin_clock();
+        peer_sent(cr->peer);
+    }
+    cr->nxt_ep = ct->by_ep[hash];
+    ct->by_ep[hash] = cr;
+    cr->nxt_id = ct->by_id[indx];
+    ct->by_id[indx] = cr;
 #ifdef DEBUG
-    ctable_dump("ctable_dump  ");
+    ctable_dump(ct, "ctable_dump  ");
 #endif /* DEBUG */
 }
 
-CRecord *ctable_look_ep(RpcEndpoint *ep) {
+CRecord *ctable_look_ep(CTable *ct, RpcEndpoint *ep) {
     unsigned hash = endpoint_hash(ep, CTABLE_SIZE);
     CRecord *r, *ans = NULL;
 
-    for (r = cr_by_ep[hash]; r != NULL; r = r->nxt_ep)
-        if (endpoint_equal(ep, r->ep)) {
+    for (r = ct->by_ep[hash]; r != NULL; r = r->nxt_ep)
+        if (endpoint_equal(ep, &r->ep)) {
             ans = r;
             break;
         }
@@ -118,11 +208,11 @@ CRecord *ctable_look_ep(RpcEndpoint *ep) {
     return ans;
 }
 
-CRecord *ctable_look_id(unsigned long id) {
-    unsigned indx = id % CTABLE_SIZE;
+CRecord *ctable_look_id(CTable *ct, unsigned long id) {
+    unsigned indx = id_hash(id);
     CRecord *r, *ans = NULL;
 
-    for (r = cr_by_id[indx]; r != NULL; r = r->nxt_id)
+    for (r = ct->by_id[indx]; r != NULL; r = r->nxt_id)
         if (id == r->cid) {
             ans = r;
             break;
@@ -140,36 +230,60 @@ CRecord *ctable_look_id(unsigned long id) {
  * remove from table - storage returned in timer thread
  */
 
-void ctable_remove(CRecord *cr) {
+void ctable_remove(CTable *ct, CRecord *cr) {
     CRecord *pr, *cu;
-    unsigned hash = endpoint_hash(cr->ep, CTABLE_SIZE);
-    unsigned indx = cr->cid % CTABLE_SIZE;
+    unsigned hash = endpoint_hash(&cr->ep, CTABLE_SIZE);
+    unsigned indx = id_hash(cr->cid);
 
-    for (pr = NULL, cu = cr_by_ep[hash]; cu != NULL; pr = cu, cu = pr->nxt_ep) {
+    for (pr = NULL, cu = ct->by_ep[hash]; cu != NULL;
+            pr = cu, cu = pr->nxt_ep) {
         if (cr == cu) {
             if (pr == NULL)
-                cr_by_ep[hash] = cu->nxt_ep;
+                ct->by_ep[hash] = cu->nxt_ep;
             else
                 pr->nxt_ep = cu->nxt_ep;
             break;
         }
     }
-    for (pr = NULL, cu = cr_by_id[indx]; cu != NULL; pr = cu, cu = pr->nxt_id) {
+    for (pr = NULL, cu = ct->by_id[indx]; cu != NULL;
+            pr = cu, cu = pr->nxt_id) {
         if (cr == cu) {
             if (pr == NULL)
-                cr_by_id[indx] = cu->nxt_id;
+                ct->by_id[indx] = cu->nxt_id;
             else
                 pr->nxt_id = cu->nxt_id;
             break;
         }
     }
+    if (cr->peer != NULL) {
+        if (crecord_unacked(cr->state))
+            peer_done(cr->peer, 0, 0);
+        peer_release(cr->peer);
+    }
+    cr->peer = NULL;
 #ifdef DEBUG
     crecord_dump(cr, "ctable_remove");
 #endif /* DEBUG */
 }
 
-void ctable_scan(CRecord **retry, CRecord **timed, CRecord **ping, CRecord **purge) {
+/*
+ * offer the idle connection `cr' to the keepalive `k' of its endpoint,
+ * which PINGs the one with the next subport after the last one PINGed
+ */
+static void offer(Keepalive *k, CRecord *cr) {
+    unsigned long sp = ntohl(cr->ep.subport);
+
+    if (k->first == NULL || sp < ntohl(k->first->ep.subport))
+        k->first = cr;
+    if (sp > k->last &&
+            (k->after == NULL || sp < ntohl(k->after->ep.subport)))
+        k->after = cr;
+}
+
+void ctable_scan(CTable *ct, CRecord **retry, CRecord **timed,
+                 CRecord **ping, CRecord **purge) {
     CRecord *p, *rty, *tmo, *png, *prg;
+    Keepalive *k, *due;
     unsigned long st;
     int i;
 
@@ -177,71 +291,87 @@ void ctable_scan(CRecord **retry, CRecord **timed, CRecord **ping, CRecord **pur
     tmo = NULL;
     png = NULL;
     prg = NULL;
+    due = NULL;
     for (i = 0; i < CTABLE_SIZE; i++) {
-        for (p = cr_by_ep[i]; p != NULL; p = p->nxt_ep) {
+        for (p = ct->by_ep[i]; p != NULL; p = p->nxt_ep) {
             st = p->state;
             if (st == ST_TIMEDOUT) {
                 p->link = prg;
                 prg = p;
-            } else if (st == ST_CONNECT_SENT || st == ST_QUERY_SENT
-                       || st == ST_RESPONSE_SENT || st == ST_DISCONNECT_SENT
-                       || st == ST_FRAGMENT_SENT || st == ST_SEQNO_SENT) {
-                if (--p->ticksLeft <= 0) {
-                    if (--p->nattempts <= 0) {
+            } else if (crecord_unacked(st)) {
+                if (--p->act->ticksLeft <= 0) {
+                    if (--p->act->nattempts <= 0) {
                         p->link = tmo;
                         tmo = p;
                     } else {
-                        p->ticks *= 2;
-                        p->ticksLeft = p->ticks;
+                        p->act->ticks *= 2;
+                        p->act->ticksLeft = p->act->ticks;
                         p->link = rty;
                         rty = p;
                     }
                 }
-            } else {
-                if (--p->ticksTilPing <= 0) {
-                    if (--p->pingsTilPurge <= 0) {
-                        p->link = tmo;
-                        tmo = p;
+            } else if (p->peer != NULL &&
+                       (k = peer_keepalive(p->peer,
+                                           p->ep.addr.sin_port)) != NULL) {
+                if (k->pingsTilPurge == 0) {	/* the endpoint is dead */
+                    p->link = tmo;
+                    tmo = p;
 #ifdef LOG
-                        crecord_dump(p, "No pings: ");
+                    crecord_dump(p, "No pings: ");
 #endif /* LOG */
-                    } else {
-                        p->ticksTilPing = TICKS_BETWEEN_PINGS;
-                        p->link = png;
-                        png = p;
+                } else if (k->due) {		/* one PING for them all */
+                    if (k->due == 1) {
+                        k->due = 2;
+                        k->first = NULL;
+                        k->after = NULL;
+                        k->link = due;
+                        due = k;
                     }
+                    offer(k, p);
                 }
             }
+            /* without a keepalive, for want of memory, it is left alone */
         }
     }
+    for (k = due; k != NULL; k = k->link) {
+        p = (k->after != NULL) ? k->after : k->first;
+        k->last = ntohl(p->ep.subport);
+        k->due = 0;
+        p->link = png;
+        png = p;
+    }
     *retry = rty;
     *timed = tmo;
     *ping = png;
     *purge = prg;
 }
 
-void ctable_purge(void) {
+void ctable_purge(CTable *ct) {
     CRecord *p, *next;
     int i;
 
-    (void)pthread_mutex_trylock(&mutex);	/* lock if not already locked */
-    pthread_mutex_unlock(&mutex);
-    pthread_mutex_destroy(&mutex);
+    (void)pthread_mutex_trylock(&ct->mutex);	/* lock if not already locked */
+    held = 0;
+    pthread_mutex_unlock(&ct->mutex);
+    pthread_mutex_destroy(&ct->mutex);
+    pthread_mutex_init(&ct->mutex, NULL);
     for (i = 0; i < CTABLE_SIZE; i++) {
-        for (p = cr_by_ep[i]; p != NULL; p = next) {
+        for (p = ct->by_ep[i]; p != NULL; p = next) {
             next = p->nxt_ep;
             crecord_destroy(p);
         }
+        ct->by_ep[i] = NULL;
+        ct->by_id[i] = NULL;
     }
-    ctable_init();
+    ptable_purge(ct->peers);
 }
 
-void ctable_dump(char *str) {
+void ctable_dump(CTable *ct, char *str) {
     CRecord *p;
     int i;
 
     for (i = 0; i < CTABLE_SIZE; i++) {
-        for (p = cr_by_ep[i]; p != NULL; p = p->nxt_ep) {
+        for (p = ct->by_ep[i]; p != NULL; p = p->nxt_ep) {
             crecord_dump(p, str);
         }
     }
@@ -30,12 +30,16 @@
  */
 
 /*
- * interface and data structures for table holding connection records
+ * interface and data structures for tables holding connection records
+ * each RPC context (see srpc.h) has its own table, with its own lock
  *
- * ctable_init(), ctable_lock() assume that the table is not locked
- * ctable_getMutex() works independent of lock status
+ * ctable_create(), ctable_lock() assume that the table is not locked
+ * ctable_held() and ctable_stats() work independent of lock status
  * all other methods assume that the table has previously been locked via a
  * call to ctable_lock()
+ *
+ * packets sent while the table is locked are held in the sending thread's
+ * outbox (see outbox.h) and transmitted when it unlocks the table
  */
 #ifndef _CTABLE_H_
 #define _CTABLE_H_
@@ -44,36 +48,65 @@
 #include "crecord.h"
 #include <pthread.h>
 
+typedef struct ctable CTable;
+
 /*
  * lock the connection table
  */
-void ctable_lock(void);
+void ctable_lock(CTable *ct);
+
+/*
+ * unlock the connection table, then transmit the packets in the calling
+ * thread's outbox
+ */
+void ctable_unlock(CTable *ct);
+
+/*
+ * returns 1 if the calling thread holds a table lock, 0 otherwise
+ */
+int ctable_held(void);
+
+/*
+ * wait on `cond', releasing the lock while waiting; if the calling thread
+ * has packets in its outbox, the lock is instead released just long enough
+ * to transmit them, and the caller must recheck its condition, as after a
+ * spurious wakeup; needed by crecord_waitForState()
+ */
+void ctable_wait(CTable *ct, pthread_cond_t *cond);
+
+/*
+ * obtain the number of times the lock has been held, the total time for
+ * which it has been held and the longest single hold, in nanoseconds
+ */
+void ctable_stats(CTable *ct, unsigned long *n, unsigned long *nsecs,
+                  unsigned long *max);
 
 /*
- * unlock the connection table
+ * create an empty table for holding connection records
+ * returns NULL if error
  */
-void ctable_unlock(void);
+CTable *ctable_create(void);
 
 /*
- * return the address of the table mutex
- * needed by crecord_create()
+ * destroy a table that holds no connection records, with its peer records
  */
-pthread_mutex_t *ctable_getMutex(void);
+void ctable_destroy(CTable *ct);
 
 /*
- * initialize the data structures for holding connection records
+ * returns the table's peer records (see peer.h)
  */
-void ctable_init(void);
+PTable *ctable_peers(CTable *ct);
 
 /*
  * issue a new subport for this process
  */
-unsigned long ctable_newSubport(void);
+unsigned long ctable_newSubport(CTable *ct);
 
 /*
- * insert a connection record
+ * insert a connection record, which then refers to the table and to the
+ * table's peer record for its host
  */
-void ctable_insert(CRecord *cr);
+void ctable_insert(CTable *ct, CRecord *cr);
 
 /*
  * lookup the connection record associated with a particular endpoint
@@ -81,7 +114,7 @@ void ctable_insert(CRecord *cr);
  * if successful, returns the associated connection record
  * if not, returns NULL
  */
-CRecord *ctable_look_ep(RpcEndpoint *ep);
+CRecord *ctable_look_ep(CTable *ct, RpcEndpoint *ep);
 
 /*
  * lookup the connection record associated with a particular identifier
@@ -89,31 +122,34 @@ CRecord *ctable_look_ep(RpcEndpoint *ep);
  * if successful, returns the associated connection record
  * if not, returns NULL
  */
-CRecord *ctable_look_id(unsigned long id);
+CRecord *ctable_look_id(CTable *ct, unsigned long id);
 
 /*
  * remove a connection record
  *
  * there is no return value
  */
-void ctable_remove(CRecord *cr);
+void ctable_remove(CTable *ct, CRecord *cr);
 
 /*
  * scan table for timer-based processing
  *
- * return retry, timed, ping and purge linked lists
+ * return retry, timed, ping and purge linked lists; the ping list holds
+ * one idle connection to each remote endpoint with a PING due, taken from
+ * its idle connections in turn, and the idle connections to dead endpoints
+ * are timed out (see peer.h)
  */
-void ctable_scan(CRecord **retry, CRecord **timed,
+void ctable_scan(CTable *ct, CRecord **retry, CRecord **timed,
                  CRecord **ping, CRecord **purge);
 
 /*
  * purge all entries from the table
  */
-void ctable_purge(void);
+void ctable_purge(CTable *ct);
 
 /*
  * dump all entries in the table
  */
-void ctable_dump(char *str);
+void ctable_dump(CTable *ct, char *str);
 
 #endif /* _CTABLE_H_*/
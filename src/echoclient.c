@@ -35,7 +35,19 @@
  * usage: ./echoclient
  *
  * reads each line from standard input, sends it to Echo service on localhost,
- * receives the echo'd line, and writes it to standard output
+ * receives the echo'd line, and writes it to standard output; the time and
+ * the 50th, 99th and 99.9th percentile call latencies are reported on
+ * standard error
+ *
+ * -r sends the input `rounds' times, writing the echoes of the first only,
+ * to gather enough calls for the percentiles; standard input must then be
+ * a file
+ *
+ * -b puts the client's context in busy-poll mode with a backoff of `-B'
+ * microseconds (see rpc_context_busy_poll()) and -P makes the caller read
+ * its own responses for up to `usecs' (see rpc_connection_poll()), for
+ * comparison with the default blocking reader - run against
+ * `echoserver -b usecs' to do the same for the server
  */
 
 #include "srpc.h"
@@ -44,11 +56,26 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <time.h>
 
 #define HOST "localhost"
 #define PORT 20000
 #define SERVICE "Echo"
-#define USAGE "./echoclient [-h host] [-p port] [-s service]"
+#define USAGE "./echoclient [-h host] [-p port] [-s service] [-r rounds] [-b usecs] [-B usecs] [-P usecs]"
+
+static unsigned long now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return 1000000000 * (unsigned long)ts.tv_sec + ts.tv_nsec;
+}
+
+static int cmp(const void *a, const void *b) {
+    unsigned long x = *(const unsigned long *)a;
+    unsigned long y = *(const unsigned long *)b;
+
+    return (x > y) - (x < y);
+}
 
 int main(int argc, char *argv[]) {
     RpcConnection rpc;
@@ -64,6 +91,10 @@ int main(int argc, char *argv[]) {
     unsigned long count = 0;
     unsigned long msec;
     double mspercall;
+    unsigned long *lat = NULL, t0;
+    unsigned long nlat = 0, maxlat = 0;
+    int rounds = 1;
+    int busy = 0, backoff = 0, poll = 0;
     int i, j;
 
     host = HOST;
@@ -80,31 +111,56 @@ int main(int argc, char *argv[]) {
             port = atoi(argv[j]);
         else if (strcmp(argv[i], "-s") == 0)
             service = argv[j];
+        else if (strcmp(argv[i], "-r") == 0)
+            rounds = atoi(argv[j]);
+        else if (strcmp(argv[i], "-b") == 0)
+            busy = atoi(argv[j]);
+        else if (strcmp(argv[i], "-B") == 0)
+            backoff = atoi(argv[j]);
+        else if (strcmp(argv[i], "-P") == 0)
+            poll = atoi(argv[j]);
         else {
             fprintf(stderr, "Unknown flag: %s %s\n", argv[i], argv[j]);
         }
         i = j + 1;
     }
     assert(rpc_init(0));
+    if (busy > 0 && ! rpc_context_busy_poll(rpc_context_default(), busy,
+                                            backoff))
+        fprintf(stderr, "Kernel busy polling unavailable\n");
     if ((rpc = rpc_connect(host, port, service, 0)) == NULL) {
         fprintf(stderr, "Failure to connect to %s at %s:%05u\n",
                 service, host, port);
         exit(-1);
     }
+    if (poll > 0)
+        (void)rpc_connection_poll(rpc, poll);
     gettimeofday(&start, NULL);
-    while (fgets(buf, sizeof(buf), stdin) != NULL) {
-        count++;
-        sprintf(query, "ECHO:%s", buf);
-        n = strlen(query) + 1;
-        if (! rpc_call(rpc, Q_Arg(query), n, resp, sizeof(resp), &len)) {
-            fprintf(stderr, "rpc_call() failed\n");
+    for (i = 0; i < rounds; i++) {
+        if (i > 0 && fseek(stdin, 0L, SEEK_SET) != 0)
             break;
+        while (fgets(buf, sizeof(buf), stdin) != NULL) {
+            count++;
+            sprintf(query, "ECHO:%s", buf);
+            n = strlen(query) + 1;
+            t0 = now();
+            if (! rpc_call(rpc, Q_Arg(query), n, resp, sizeof(resp), &len)) {
+                fprintf(stderr, "rpc_call() failed\n");
+                break;
+            }
+            if (nlat == maxlat) {
+                maxlat = (maxlat > 0) ? 2 * maxlat : 1024;
+                assert((lat = (unsigned long *)realloc(lat, maxlat *
+                                                       sizeof(*lat))));
+            }
+            lat[nlat++] = now() - t0;
+            if (resp[0] != '1') {
+                fprintf(stderr, "Echo server returned ERR\n");
+                break;
+            }
+            if (i == 0)
+                fputs(&resp[1], stdout);
         }
-        if (resp[0] != '1') {
-            fprintf(stderr, "Echo server returned ERR\n");
-            break;
-        }
-        fputs(&resp[1], stdout);
     }
     gettimeofday(&stop, NULL);
     if (stop.tv_usec < start.tv_usec) {
@@ -116,6 +172,13 @@ int main(int argc, char *argv[]) {
     mspercall = (double)msec / (double)count;
     fprintf(stderr, "%ld lines Echo'd in %ld.%03ld seconds, %.3fms/call\n",
             count, msec/1000, msec % 1000, mspercall);
+    if (nlat > 0) {
+        qsort(lat, nlat, sizeof(*lat), cmp);
+        fprintf(stderr, "latency: p50 %.1fus, p99 %.1fus, p999 %.1fus\n",
+                lat[nlat / 2] / 1000.0, lat[nlat * 99 / 100] / 1000.0,
+                lat[nlat * 999 / 1000] / 1000.0);
+    }
+    free(lat);
     rpc_disconnect(rpc);
     return 0;
 }
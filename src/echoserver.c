@@ -32,7 +32,40 @@
 /*
  * Echo server
  *
- * single-threaded provider of the Echo service using SRPC
+ * provider of the Echo service using SRPC; single-threaded by default, or
+ * served by a pool of up to `threads' workers using rpc_serve() with -t;
+ * with -i, queries whose responses fit in a single fragment are answered
+ * directly by the reader thread using rpc_serve_inline(); -w sets how long
+ * idle workers poll for queries before sleeping (see rpc_service_spin())
+ *
+ * -b puts the default context in busy-poll mode, polled by the kernel for
+ * `usecs' and by the reader until idle for the `-B' backoff (see
+ * rpc_context_busy_poll()), for comparison with the blocking reader
+ *
+ * -r sets the size of the receive and send buffers of each socket (see
+ * rpc_socket_config()); queries that arrive while the receive buffer is
+ * full are dropped, and the drops counted by rpc_stats()
+ *
+ * -c pins the reader and timer threads to CPU `cpu', together with the
+ * thread answering queries or, with -t, the workers to CPUs `cpu' onwards
+ * (see rpc_context_pin() and RpcServeOptions), for comparison with an
+ * unpinned server using `latbench -P'
+ *
+ * with -X, the service is offered instead in a context on `port' that
+ * receives through an AF_XDP socket on queue 0 of interface `ifname' (see
+ * rpc_context_create_xdp()), the default context taking a dynamic port;
+ * this requires a build with HAVE_AF_XDP and root privileges, and works
+ * on a veth pair, with the client in a network namespace at the far end
+ *
+ * with -x, the service is also offered in `contexts' further RPC contexts
+ * (see rpc_context_create()) on ports port+1 to port+contexts, the k'th
+ * pinned to CPU k-1; each answers queries from its own reader thread, with
+ * one worker for queries whose responses do not fit in a fragment
+ *
+ * -m stripes the fragments of responses across the comma-separated local
+ * interfaces `ifnames' (see rpc_context_paths()); a client in a network
+ * namespace reached over two veth pairs shows the packets shared between
+ * them, provided that rp_filter is not strict on either end of either pair
  *
  * legal queries and corresponding responses (all characters):
  *   ECHO:EOS-terminated-string --> 1/0
@@ -45,10 +78,11 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <pthread.h>
 
 #define PORT 20000
 #define SERVICE "Echo"
-#define USAGE "./echoserver [-p port] [-s service]"
+#define USAGE "./echoserver [-p port] [-s service] [-t threads] [-i] [-w usecs] [-b usecs] [-B usecs] [-r bytes] [-c cpu] [-x contexts] [-X ifname] [-m ifnames]"
 
 static const char letters[] = "abcdefghijklmnopqrstuvwxyz0123456789";
 
@@ -63,20 +97,95 @@ static void sgen(char *s) {
     *s = '\0';
 }
 
+/*
+ * process one query; the query data is not EOS-terminated in place
+ * returns the length of the response placed in `resp'
+ */
+static unsigned echo(void *arg, RpcEndpoint *ep, void *qb, unsigned len,
+                     void *rb, unsigned rsize) {
+    char *query = (char *)qb;
+    char *resp = (char *)rb;
+    char cmd[64];
+    unsigned i, rlen;
+
+    (void) arg;
+    (void) ep;
+    for (i = 0; i < len && i < sizeof(cmd) - 1; i++) {
+        if (query[i] == ':' || query[i] == '\0')
+            break;
+        cmd[i] = query[i];
+    }
+    cmd[i] = '\0';
+    rlen = (i < len && query[i] == ':') ? len - i - 1 : 0;
+    if (strcmp(cmd, "ECHO") == 0) {
+        if (rlen + 2 > rsize)
+            rlen = rsize - 2;
+        resp[0] = '1';
+        memcpy(&resp[1], &query[i+1], rlen);
+        resp[rlen + 1] = '\0';
+    } else if (strcmp(cmd, "SINK") == 0) {
+        sprintf(resp, "1");
+    } else if (strcmp(cmd, "SGEN") == 0) {
+        resp[0] = '1';
+        sgen(&resp[1]);
+    } else {
+        sprintf(resp, "0Illegal command %s", cmd);
+    }
+    return strlen(resp) + 1;
+}
+
+/*
+ * inline variant of echo(), run by the reader thread; queries whose
+ * response might not fit are left to the worker(s)
+ */
+static int echo_inline(void *arg, RpcEndpoint *ep, void *qb, unsigned len,
+                       void *rb, unsigned rsize, unsigned *rlen) {
+    if (len + 2 > rsize)
+        return 0;
+    *rlen = echo(arg, ep, qb, len, rb, rsize);
+    return 1;
+}
+
+/*
+ * worker for the service offered in a further context; rpc_serve() does not
+ * return
+ */
+static void *serve_context(void *args) {
+    RpcServeOptions opts = {1, 1, 0, 0, 0};
+
+    (void)rpc_serve((RpcService)args, echo, NULL, &opts);
+    return NULL;
+}
+
 int main(int argc, char *argv[]) {
     RpcEndpoint sender;
-    char *query = (char *)malloc(65536);
+    RpcBuffer qbuf;
+    char *query;
     char *resp = (char *)malloc(65536);
-    char cmd[64], rest[65536];
     unsigned len;
     RpcService rps;
+    RpcContext ctx;
     char *service;
+    char *ifname = NULL;
+    char *ifnames = NULL;
     unsigned short port;
+    int threads = 0;
+    int inl = 0;
+    int spin = -1;
+    int contexts = 0;
+    int cpu = -1;
+    int busy = 0, backoff = 0;
+    int bufsize = 0;
     int i, j;
 
     service = SERVICE;
     port = PORT;
     for (i = 1; i < argc; ) {
+        if (strcmp(argv[i], "-i") == 0) {
+            inl = 1;
+            i++;
+            continue;
+        }
         if ((j = i + 1) == argc) {
             fprintf(stderr, "usage: %s\n", USAGE);
             exit(1);
@@ -85,42 +194,87 @@ int main(int argc, char *argv[]) {
             port = atoi(argv[j]);
         else if (strcmp(argv[i], "-s") == 0)
             service = argv[j];
+        else if (strcmp(argv[i], "-t") == 0)
+            threads = atoi(argv[j]);
+        else if (strcmp(argv[i], "-w") == 0)
+            spin = atoi(argv[j]);
+        else if (strcmp(argv[i], "-x") == 0)
+            contexts = atoi(argv[j]);
+        else if (strcmp(argv[i], "-c") == 0)
+            cpu = atoi(argv[j]);
+        else if (strcmp(argv[i], "-b") == 0)
+            busy = atoi(argv[j]);
+        else if (strcmp(argv[i], "-B") == 0)
+            backoff = atoi(argv[j]);
+        else if (strcmp(argv[i], "-r") == 0)
+            bufsize = atoi(argv[j]);
+        else if (strcmp(argv[i], "-X") == 0)
+            ifname = argv[j];
+        else if (strcmp(argv[i], "-m") == 0)
+            ifnames = argv[j];
         else {
             fprintf(stderr, "Unknown flag: %s %s\n", argv[i], argv[j]);
         }
         i = j + 1;
     }
 
-    assert(rpc_init(port));
-    rps = rpc_offer(service);
+    if (bufsize > 0)
+        assert(rpc_socket_config(bufsize, bufsize));
+    assert(rpc_init((ifname == NULL) ? port : 0));
+    ctx = rpc_context_default();
+    if (ifname != NULL &&
+            (ctx = rpc_context_create_xdp(port, cpu, ifname, 0, 0)) == NULL) {
+        fprintf(stderr, "Unable to receive through XDP on %s\n", ifname);
+        exit(-1);
+    }
+    rps = rpc_context_offer(ctx, service);
     if (rps == NULL) {
         fprintf(stderr, "Failure offering Echo service\n");
         exit(-1);
     }
-    while ((len = rpc_query(rps, &sender, query, 65536)) > 0) {
-        int i;
-        query[len] = '\0';
-        rest[0] = '\0';
-        for (i = 0; query[i] != '\0'; i++) {
-            if (query[i] == ':') {
-                strcpy(rest, &query[i+1]);
-                break;
-            } else
-                cmd[i] = query[i];
+    if (ifnames != NULL && ! rpc_context_paths(ctx, ifnames)) {
+        fprintf(stderr, "Unable to stripe across %s\n", ifnames);
+        exit(-1);
+    }
+    if (spin >= 0)
+        (void)rpc_service_spin(rps, spin);
+    if (busy > 0 && ! rpc_context_busy_poll(ctx, busy, backoff))
+        fprintf(stderr, "Kernel busy polling unavailable\n");
+    if (cpu >= 0 && (! rpc_context_pin(ctx, cpu, cpu) ||
+                     (threads == 0 && ! rpc_pin_thread(cpu))))
+        fprintf(stderr, "Unable to pin to CPU %d, continuing unpinned\n",
+                cpu);
+    if (inl && ! rpc_serve_inline(rps, echo_inline, NULL)) {
+        fprintf(stderr, "Failure registering inline handler\n");
+        exit(-1);
+    }
+    if (threads > 0) {
+        RpcServeOptions opts = {1, threads, 0, cpu, (cpu >= 0) ? threads : 0};
+        if (! rpc_serve(rps, echo, NULL, &opts)) {
+            fprintf(stderr, "Failure serving Echo service\n");
+            exit(-1);
         }
-        cmd[i] = '\0';
-        if (strcmp(cmd, "ECHO") == 0) {
-            resp[0] = '1';
-            strcpy(&resp[1], rest);
-        } else if (strcmp(cmd, "SINK") == 0) {
-            sprintf(resp, "1");
-        } else if (strcmp(cmd, "SGEN") == 0) {
-            resp[0] = '1';
-            sgen(&resp[1]);
-        } else {
-            sprintf(resp, "0Illegal command %s", cmd);
+    }
+    for (i = 1; i <= contexts; i++) {
+        RpcContext xctx = rpc_context_create(port + i, i - 1);
+        RpcService cps;
+        pthread_t thr;
+        if (xctx == NULL || (cps = rpc_context_offer(xctx, service)) == NULL ||
+                ! rpc_serve_inline(cps, echo_inline, NULL) ||
+                pthread_create(&thr, NULL, serve_context, cps) != 0) {
+            fprintf(stderr, "Failure offering Echo service on port %d\n",
+                    port + i);
+            exit(-1);
         }
-        rpc_response(rps, &sender, resp, strlen(resp) + 1);
+    }
+    /*
+     * queries are borrowed from the RPC system, so they are not copied
+     */
+    while ((qbuf = rpc_query_borrow(rps, &sender, (void **)&query, &len))
+            != NULL) {
+        unsigned rlen = echo(NULL, &sender, query, len, resp, 65535);
+        rpc_query_release(qbuf);
+        rpc_response(rps, &sender, resp, rlen);
     }
     return 0;
 }
@@ -38,6 +38,10 @@
 
 #include <netinet/in.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /*
  * all data in an endpoint is in NETWORK order;
  * this is true by default for a sockaddr_in
@@ -86,4 +90,8 @@ unsigned endpoint_hash(RpcEndpoint *ep, unsigned limit);
  */
 void endpoint_dump(RpcEndpoint *ep, char *leadString);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* _ENDPOINT_H_ */
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * fec.c - XOR parity for the fragments of messages in simple RPC system
+ */
+
+#include "fec.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define HELD(f,n) ((f)->held[(n) / 8] & (1 << ((n) % 8)))
+
+Fec *fec_create(void) {
+    Fec *f;
+
+    if ((f = (Fec *)malloc(sizeof(Fec))) != NULL)
+        fec_reset(f);
+    return f;
+}
+
+void fec_reset(Fec *f) {
+    f->first = 0;
+    f->last = 0;
+    memset(f->held, 0, sizeof(f->held));
+}
+
+/*
+ * XOR `len' bytes of `src' into `dst'; the compiler vectorizes the loop
+ */
+static void xor_into(unsigned char *dst, unsigned char *src, unsigned len) {
+    unsigned i;
+
+    for (i = 0; i < len; i++)
+        dst[i] ^= src[i];
+}
+
+void fec_parity(unsigned char *parity, unsigned char *data,
+                unsigned char first, unsigned char last) {
+    unsigned n;
+
+    memcpy(parity, data + FR_SIZE * (first - 1), FR_SIZE);
+    for (n = first + 1; n <= last; n++)
+        xor_into(parity, data + FR_SIZE * (n - 1), FR_SIZE);
+}
+
+int fec_mark(Fec *f, unsigned char fnum) {
+    if (HELD(f, fnum))
+        return 1;
+    f->held[fnum / 8] |= 1 << (fnum % 8);
+    return 0;
+}
+
+int fec_hold(Fec *f, unsigned char first, unsigned char last,
+             unsigned char *parity) {
+    if (f->first == first && f->last == last)
+        return 1;
+    f->first = first;
+    f->last = last;
+    memcpy(f->parity, parity, FR_SIZE);
+    return 0;
+}
+
+int fec_repair(Fec *f, unsigned char *data) {
+    unsigned n, missing = 0;
+
+    if (f->last == 0)
+        return 0;
+    for (n = f->first; n <= f->last; n++)
+        if (! HELD(f, n)) {
+            if (missing != 0)
+                return 0;		/* more than one lost */
+            missing = n;
+        }
+    if (missing == 0)
+        return 0;
+    memcpy(data + FR_SIZE * (missing - 1), f->parity, FR_SIZE);
+    for (n = f->first; n <= f->last; n++)
+        if (n != missing)
+            xor_into(data + FR_SIZE * (missing - 1),
+                     data + FR_SIZE * (n - 1), FR_SIZE);
+    (void)fec_mark(f, missing);
+    return 1;
+}
+
+unsigned char fec_received(Fec *f, unsigned char from) {
+    unsigned n = from + 1;
+
+    while (n < 256 && HELD(f, n))
+        n++;
+    return n - 1;
+}
+
+void fec_destroy(Fec *f) {
+    free(f);
+}
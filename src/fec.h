@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * fec.h - parity groups for fragmented messages in the RPC system
+ *
+ * a connection may send the fragments of a message in parity groups: a
+ * group is a run of consecutive FRAGMENT packets, sent without waiting for
+ * each to be acknowledged, followed by a PARITY packet holding the XOR of
+ * their data; every fragment before the final QUERY or RESPONSE is a full
+ * FR_SIZE bytes, so the receiver can rebuild any one fragment of a group
+ * that is lost from the others and the parity, without waiting for the
+ * sender's timer to retransmit it
+ *
+ * a fec record holds the receiver's state for the message being
+ * reassembled on a connection: which of its fragments are held, and the
+ * parity of the last group received
+ */
+
+#ifndef _FEC_H_
+#define _FEC_H_
+
+#include "srpcdefs.h"
+
+typedef struct fec {
+    unsigned char first;		/* fragments covered by the parity */
+    unsigned char last;			/* ... 0 if none held */
+    unsigned char held[32];		/* bitmap of fragments received */
+    unsigned char parity[FR_SIZE];
+} Fec;
+
+/*
+ * create a fec record, with nothing held
+ *
+ * returns NULL if error
+ */
+Fec *fec_create(void);
+
+/*
+ * forget the fragments and parity held, for a new message
+ */
+void fec_reset(Fec *f);
+
+/*
+ * compute into `parity' the XOR of fragments `first' through `last' of
+ * the message `data'
+ */
+void fec_parity(unsigned char *parity, unsigned char *data,
+                unsigned char first, unsigned char last);
+
+/*
+ * record that fragment `fnum' has been received
+ * returns 1 if it was already held, 0 otherwise
+ */
+int fec_mark(Fec *f, unsigned char fnum);
+
+/*
+ * hold `parity', of fragments `first' through `last', in place of any
+ * parity held before
+ * returns 1 if it was already held, 0 otherwise
+ */
+int fec_hold(Fec *f, unsigned char first, unsigned char last,
+             unsigned char *parity);
+
+/*
+ * rebuild in the message `data' the one fragment covered by the parity
+ * held that has not been received, if there is just one
+ * returns 1 if a fragment was rebuilt, 0 otherwise
+ */
+int fec_repair(Fec *f, unsigned char *data);
+
+/*
+ * returns the last of the fragments after `from' that have all been
+ * received, or `from' if the next has not
+ */
+unsigned char fec_received(Fec *f, unsigned char from);
+
+/*
+ * destroy the fec record
+ */
+void fec_destroy(Fec *f);
+
+#endif /* _FEC_H_ */
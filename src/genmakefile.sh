@@ -32,9 +32,11 @@ cat <<!endoftemplate! >>Makefile
 #      make OS=Cygwin 		# makes appropriate binaries for Cygwin
 #      make OS=Darwin 		# makes appropriate binaries for OSX
 #      make OS=Linux 		# makes appropriate binaries for Linux
+#      make XDP=yes		# also builds the AF_XDP transport (Linux)
 
 # base definitions
 CC = gcc
+CXX = g++
 # comment out the next line if you are using valgrind or gdb
 OPT=-O2
 
@@ -53,11 +55,12 @@ else
     EXT=
 endif
 
-OBJECTS = crecord.o ctable.o endpoint.o srpc.o stable.o tslist.o
-PROGRAMS = mthclient\$(EXT) callbackserver\$(EXT) callbackclient\$(EXT) echoserver\$(EXT) echoclient\$(EXT) sinkclient\$(EXT) sgenclient\$(EXT) sinktest\$(EXT) conntest\$(EXT)
+OBJECTS = crecord.o ctable.o endpoint.o srpc.o stable.o tslist.o slab.o srpcmalloc.o arena.o squeue.o serve.o async.o spin.o outbox.o resolve.o pool.o affinity.o transport.o xdp.o peer.o fec.o path.o
+PROGRAMS = mthclient\$(EXT) callbackserver\$(EXT) callbackclient\$(EXT) echoserver\$(EXT) echoclient\$(EXT) sinkclient\$(EXT) sgenclient\$(EXT) sinktest\$(EXT) conntest\$(EXT) allocbench\$(EXT) malloctest\$(EXT) queuebench\$(EXT) asyncclient\$(EXT) cppbench\$(EXT) latbench\$(EXT) ccbench\$(EXT)
 
 LIBS = -lpthread
 CFLAGS=\$(CFL_COMMON) \$(OPT)
+CXXFLAGS=\$(CFLAGS) -std=c++20
 LDFLAGS = \$(LFL_COMMON)
 
 # OS-specific definitions
@@ -67,6 +70,12 @@ endif
 ifeq (\$(OS),Darwin)
     CFLAGS = \$(CFL_COMMON) -DHAVE_SOCKADDR_LEN \$(OPT)
 endif
+ifeq (\$(OS),Linux)
+    CFLAGS = \$(CFL_COMMON) -DHAVE_CPU_AFFINITY -DHAVE_NUMA \$(OPT)
+    ifeq (\$(XDP),yes)
+        CFLAGS += -DHAVE_AF_XDP
+    endif
+endif
 
 all: \$(PROGRAMS)
 
@@ -87,12 +96,35 @@ sinkclient.o: sinkclient.c srpc.h
 sgenclient.o: sgenclient.c srpc.h
 sinktest.o: sinktest.c srpc.h
 conntest.o: conntest.c srpc.h
-crecord.o: crecord.c crecord.h ctable.h endpoint.h stable.h
-ctable.o: ctable.c ctable.h endpoint.h crecord.h
+allocbench.o: allocbench.c srpc.h
+malloctest.o: malloctest.c srpcmalloc.h payload.h
+queuebench.o: queuebench.c tslist.h squeue.h srpcdefs.h
+asyncclient.o: asyncclient.c srpc.h
+cppbench.o: cppbench.cpp srpc.hpp srpc.h
+latbench.o: latbench.c srpc.h
+ccbench.o: ccbench.c srpc.h
+crecord.o: crecord.c crecord.h peer.h path.h fec.h ctable.h endpoint.h stable.h spin.h slab.h arena.h affinity.h srpcdefs.h srpcmalloc.h
+ctable.o: ctable.c ctable.h endpoint.h crecord.h peer.h path.h outbox.h spin.h
 endpoint.o: endpoint.c endpoint.h
-srpc.o: srpc.c srpc.h srpcdefs.h tslist.h endpoint.h ctable.h crecord.h stable.h
-stable.o: stable.c stable.h tslist.h
-tslist.o: tslist.c tslist.h
+srpc.o: srpc.c srpc.h srpcdefs.h payload.h srpcmalloc.h arena.h affinity.h squeue.h endpoint.h ctable.h crecord.h peer.h path.h fec.h stable.h async.h outbox.h transport.h resolve.h
+stable.o: stable.c stable.h squeue.h srpcdefs.h
+tslist.o: tslist.c tslist.h slab.h
+slab.o: slab.c slab.h
+srpcmalloc.o: srpcmalloc.c srpcmalloc.h payload.h srpcdefs.h slab.h arena.h affinity.h
+arena.o: arena.c arena.h affinity.h srpcdefs.h logdefs.h
+squeue.o: squeue.c squeue.h spin.h
+serve.o: serve.c srpc.h stable.h squeue.h
+async.o: async.c async.h srpc.h srpcmalloc.h
+spin.o: spin.c spin.h srpcdefs.h
+outbox.o: outbox.c outbox.h transport.h spin.h payload.h srpcdefs.h
+resolve.o: resolve.c resolve.h srpcdefs.h spin.h
+pool.o: pool.c srpc.h
+affinity.o: affinity.c affinity.h srpcdefs.h
+transport.o: transport.c transport.h srpcdefs.h
+xdp.o: xdp.c transport.h srpcdefs.h
+peer.o: peer.c peer.h path.h ctable.h crecord.h endpoint.h spin.h srpcdefs.h
+fec.o: fec.c fec.h srpcdefs.h
+path.o: path.c path.h srpcdefs.h
 
 mthclient\$(EXT): mthclient.o libsrpc.a
 	gcc -o mthclient\$(EXT) \$(LIBS) mthclient.o libsrpc.a
@@ -121,4 +153,25 @@ sinktest\$(EXT): sinktest.o libsrpc.a
 conntest\$(EXT): conntest.o libsrpc.a
 	gcc -o conntest\$(EXT) \$(LIBS) conntest.o libsrpc.a
 
+allocbench\$(EXT): allocbench.o libsrpc.a
+	gcc -o allocbench\$(EXT) \$(LIBS) allocbench.o libsrpc.a
+
+malloctest\$(EXT): malloctest.o libsrpc.a
+	gcc -o malloctest\$(EXT) \$(LIBS) malloctest.o libsrpc.a
+
+queuebench\$(EXT): queuebench.o libsrpc.a
+	gcc -o queuebench\$(EXT) \$(LIBS) queuebench.o libsrpc.a
+
+asyncclient\$(EXT): asyncclient.o libsrpc.a
+	gcc -o asyncclient\$(EXT) \$(LIBS) asyncclient.o libsrpc.a
+
+cppbench\$(EXT): cppbench.o libsrpc.a
+	g++ -o cppbench\$(EXT) \$(LIBS) cppbench.o libsrpc.a
+
+latbench\$(EXT): latbench.o libsrpc.a
+	gcc -o latbench\$(EXT) \$(LIBS) latbench.o libsrpc.a
+
+ccbench\$(EXT): ccbench.o libsrpc.a
+	gcc -o ccbench\$(EXT) \$(LIBS) ccbench.o libsrpc.a
+
 !endoftemplate!
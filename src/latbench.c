@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * call latency benchmark
+ *
+ * makes `ncalls' ECHO calls of `len' bytes to the Echo service from each of
+ * `nthreads' threads, each with its own connection, timing each call, and
+ * reports the mean and the 50th, 90th and 99th percentile and maximum
+ * latencies, followed by the client's transmission, connection table lock
+ * and reception statistics (see rpc_stats()), its call and packet rates and
+ * its retransmissions and kernel drops
+ *
+ * with -x, each thread makes its calls through its own RPC context (see
+ * rpc_context_create()) instead of sharing the default context; the i'th
+ * thread and its context are pinned to CPU i, modulo the number of CPUs
+ *
+ * -P runs the benchmark twice with per-thread contexts, first with no
+ * thread pinned and then with the threads pinned as for -x, reporting each
+ * run separately, so that the effect of pinning (and of NUMA-local packet
+ * buffers and connection records) may be seen
+ *
+ * -w sets how long each caller polls for its responses before sleeping
+ * (see rpc_connection_spin()), so that spinning and parking may be
+ * compared - run against `echoserver -w usecs' to do the same for the
+ * server's worker
+ */
+#include "srpc.h"
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HOST "localhost"
+#define PORT 20000
+#define SERVICE "Echo"
+#define USAGE "./latbench [-l ncalls] [-n len] [-t nthreads] [-w usecs] [-x] [-P] [-h host] [-p port] [-s service]"
+#define MAX_LEN 1000
+#define MAX_THREADS 100
+
+char *host = HOST;
+char *service = SERVICE;
+unsigned short port = PORT;
+int ncalls = 10000;
+int len = 64;
+int spin = -1;
+int percontext = 0;
+int pinned = 0;
+int ncpus = 1;
+int failed = 0;
+unsigned long *lats;
+
+static unsigned long now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return 1000000000 * (unsigned long)ts.tv_sec + ts.tv_nsec;
+}
+
+static int cmp(const void *a, const void *b) {
+    unsigned long x = *(const unsigned long *)a;
+    unsigned long y = *(const unsigned long *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * make `ncalls' calls, recording their latencies in `args'
+ */
+static void *client(void *args) {
+    long id = (long)args;
+    unsigned long *lat = lats + id * ncalls;
+    RpcContext ctx = rpc_context_default();
+    int cpu = pinned ? (int)(id % ncpus) : -1;
+    RpcConnection rpc;
+    Q_Decl(query,MAX_LEN+8);
+    char resp[MAX_LEN+8];
+    unsigned long start;
+    unsigned rlen;
+    int i;
+
+    if (pinned)
+        (void)rpc_pin_thread(cpu);
+    if (percontext && !(ctx = rpc_context_create(0, cpu))) {
+        fprintf(stderr, "Failure to create context %ld\n", id);
+        failed = 1;
+        return NULL;
+    }
+    if (!(rpc = rpc_context_connect(ctx, host, port, service, 1234l))) {
+        fprintf(stderr, "Failure to connect to %s at %s:%05u\n",
+                service, host, port);
+        failed = 1;
+        return NULL;
+    }
+    if (spin >= 0)
+        (void)rpc_connection_spin(rpc, spin);
+    strcpy(query, "ECHO:");
+    memset(query + 5, 'x', len);
+    query[5 + len] = '\0';
+    for (i = 0; i < ncalls; i++) {
+        start = now();
+        if (!rpc_call(rpc, Q_Arg(query), len + 6, resp, sizeof(resp),
+                      &rlen)) {
+            fprintf(stderr, "%d'th rpc_call() failed\n", i+1);
+            failed = 1;
+            break;
+        }
+        lat[i] = now() - start;
+    }
+    rpc_disconnect(rpc);
+    return NULL;
+}
+
+/*
+ * run the benchmark from `nthreads' threads, reporting the latencies and
+ * the statistics accumulated during the run, each line preceded by `label'
+ */
+static void run(int nthreads, char *label) {
+    pthread_t th[MAX_THREADS];
+    unsigned long total = 0, start, wall;
+    RpcStats s0, st;
+    int i, n = ncalls * nthreads;
+
+    rpc_stats(&s0);
+    start = now();
+    for (i = 0; i < nthreads; i++)
+        if (pthread_create(&th[i], NULL, client, (void *)(long)i)) {
+            fprintf(stderr, "Failure to start client thread\n");
+            exit(-1);
+        }
+    for (i = 0; i < nthreads; i++)
+        pthread_join(th[i], NULL);
+    wall = now() - start;
+    if (failed)
+        exit(1);
+    rpc_stats(&st);
+    st.pktsSent -= s0.pktsSent;
+    st.pktsDeferred -= s0.pktsDeferred;
+    st.lockHolds -= s0.lockHolds;
+    st.lockNsecs -= s0.lockNsecs;
+    st.pktsReceived -= s0.pktsReceived;
+    st.pktsPredicted -= s0.pktsPredicted;
+    st.pktsRetried -= s0.pktsRetried;
+    st.pktsDropped -= s0.pktsDropped;
+    st.sendFailures -= s0.sendFailures;
+    for (i = 0; i < n; i++)
+        total += lats[i];
+    qsort(lats, n, sizeof(unsigned long), cmp);
+    printf("%s%d calls of %d bytes: mean %.1fus, p50 %.1fus, p90 %.1fus, "
+           "p99 %.1fus, max %.1fus\n", label, n, len,
+           total / 1000.0 / n, lats[n / 2] / 1000.0,
+           lats[n * 9 / 10] / 1000.0, lats[n * 99 / 100] / 1000.0,
+           lats[n - 1] / 1000.0);
+    printf("%s%lu packets sent (%lu deferred); table locked %lu times, "
+           "mean %.2fus, max %.1fus\n", label, st.pktsSent, st.pktsDeferred,
+           st.lockHolds, st.lockNsecs / 1000.0 / (st.lockHolds ? st.lockHolds : 1),
+           st.lockMaxNsecs / 1000.0);
+    printf("%s%lu packets received (%lu predicted); %.0f calls/s, "
+           "%.0f packets/s\n", label, st.pktsReceived, st.pktsPredicted,
+           n * 1e9 / wall, (st.pktsSent + st.pktsReceived) * 1e9 / wall);
+    printf("%s%lu packets retried, %lu dropped by the kernel, "
+           "%lu sends failed\n", label, st.pktsRetried, st.pktsDropped,
+           st.sendFailures);
+}
+
+int main(int argc, char *argv[]) {
+    int nthreads = 1;
+    int compare = 0;
+    int i, j;
+
+    for (i = 1; i < argc; ) {
+        if (strcmp(argv[i], "-x") == 0) {
+            percontext = 1;
+            i++;
+            continue;
+        }
+        if (strcmp(argv[i], "-P") == 0) {
+            compare = 1;
+            i++;
+            continue;
+        }
+        if ((j = i + 1) == argc) {
+            fprintf(stderr, "usage: %s\n", USAGE);
+            exit(1);
+        }
+        if (strcmp(argv[i], "-h") == 0)
+            host = argv[j];
+        else if (strcmp(argv[i], "-p") == 0)
+            port = atoi(argv[j]);
+        else if (strcmp(argv[i], "-s") == 0)
+            service = argv[j];
+        else if (strcmp(argv[i], "-l") == 0)
+            ncalls = atoi(argv[j]);
+        else if (strcmp(argv[i], "-n") == 0)
+            len = atoi(argv[j]);
+        else if (strcmp(argv[i], "-w") == 0)
+            spin = atoi(argv[j]);
+        else if (strcmp(argv[i], "-t") == 0) {
+            nthreads = atoi(argv[j]);
+            if (nthreads > MAX_THREADS)
+                nthreads = MAX_THREADS;
+        } else {
+            fprintf(stderr, "Unknown flag: %s %s\n", argv[i], argv[j]);
+        }
+        i = j + 1;
+    }
+    if (len < 1 || len > MAX_LEN || ncalls < 1 || nthreads < 1) {
+        fprintf(stderr, "usage: %s\n", USAGE);
+        exit(1);
+    }
+    assert((lats = (unsigned long *)malloc(ncalls * nthreads *
+                                           sizeof(unsigned long))));
+    if ((ncpus = (int)sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+        ncpus = 1;
+    assert(rpc_init(0));
+    if (compare) {
+        percontext = 1;
+        run(nthreads, "unpinned: ");
+        pinned = 1;
+        run(nthreads, "pinned:   ");
+    } else {
+        pinned = percontext;
+        run(nthreads, "");
+    }
+    return 0;
+}
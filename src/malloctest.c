@@ -29,17 +29,134 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+/*
+ * contention benchmark for srpc_malloc() versus the system malloc()
+ *
+ * usage: ./malloctest [-t nthreads] [-n nops] [-w nlive]
+ *
+ * each of `nthreads' threads performs `nops' allocate/free pairs; each
+ * thread keeps `nlive' buffers allocated at any time, replacing a randomly
+ * chosen one on each operation
+ *
+ * buffer sizes follow the mix seen by the RPC system: mostly control
+ * payloads and single packets, with the occasional reassembled message
+ */
+
 #include "srpcmalloc.h"
+#include "payload.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#define NTHREADS 4
+#define NOPS 1000000
+#define NLIVE 64
+#define MAX_THREADS 64
+#define MAX_LIVE 4096
+#define USAGE "./malloctest [-t nthreads] [-n nops] [-w nlive]"
+
+static int nthreads = NTHREADS;
+static long nops = NOPS;
+static int nlive = NLIVE;
+
+typedef struct allocator {
+    char *name;
+    void *(*mallocf)(size_t);
+    void (*freef)(void *);
+} Allocator;
 
-int main() {
-    void *p;
+static Allocator allocators[] = {
+    {"srpc_malloc", srpc_malloc, srpc_free},
+    {"malloc", malloc, free}
+};
+#define NALLOCATORS (sizeof(allocators) / sizeof(allocators[0]))
+
+/*
+ * 60% control payloads, 35% single packets, 5% 8 kB messages
+ */
+static size_t pick_size(unsigned *seed) {
+    int r = rand_r(seed) % 100;
+
+    if (r < 60)
+        return CP_SIZE;
+    else if (r < 95)
+        return PKT_SIZE;
+    return 8192;
+}
+
+static void *worker(void *args) {
+    Allocator *a = (Allocator *)args;
+    void *live[MAX_LIVE];
+    unsigned seed = (unsigned)(unsigned long)pthread_self();
     long i;
+    int j;
+
+    for (j = 0; j < nlive; j++)
+        live[j] = a->mallocf(pick_size(&seed));
+    for (i = 0; i < nops; i++) {
+        size_t size = pick_size(&seed);
+        j = rand_r(&seed) % nlive;
+        a->freef(live[j]);
+        if ((live[j] = a->mallocf(size)) == NULL) {
+            fprintf(stderr, "%s failed\n", a->name);
+            return NULL;
+        }
+        *(char *)live[j] = '\0';	/* touch the buffer */
+    }
+    for (j = 0; j < nlive; j++)
+        a->freef(live[j]);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    pthread_t th[MAX_THREADS];
+    struct timeval start, stop;
+    unsigned long usec;
+    unsigned k;
+    int i, j;
 
-    for (i = 0; (p = srpc_malloc(1000)) != NULL; i++)
-        ;
-    printf("allocated %ld kB\n", i);
-    srpc_dump();
+    for (i = 1; i < argc; ) {
+        if ((j = i + 1) == argc) {
+            fprintf(stderr, "usage: %s\n", USAGE);
+            exit(1);
+        }
+        if (strcmp(argv[i], "-t") == 0) {
+            nthreads = atoi(argv[j]);
+            if (nthreads > MAX_THREADS)
+                nthreads = MAX_THREADS;
+        } else if (strcmp(argv[i], "-n") == 0)
+            nops = atol(argv[j]);
+        else if (strcmp(argv[i], "-w") == 0) {
+            nlive = atoi(argv[j]);
+            if (nlive > MAX_LIVE)
+                nlive = MAX_LIVE;
+        } else {
+            fprintf(stderr, "Unknown flag: %s %s\n", argv[i], argv[j]);
+        }
+        i = j + 1;
+    }
+    if (nthreads < 1 || nlive < 1 || nops < 1) {
+        fprintf(stderr, "usage: %s\n", USAGE);
+        exit(1);
+    }
+    for (k = 0; k < NALLOCATORS; k++) {
+        gettimeofday(&start, NULL);
+        for (i = 0; i < nthreads; i++)
+            if (pthread_create(&th[i], NULL, worker, &allocators[k])) {
+                fprintf(stderr, "Failure to start worker thread\n");
+                exit(-1);
+            }
+        for (i = 0; i < nthreads; i++)
+            pthread_join(th[i], NULL);
+        gettimeofday(&stop, NULL);
+        usec = 1000000 * (stop.tv_sec - start.tv_sec) +
+               (stop.tv_usec - start.tv_usec);
+        printf("%-12s %d threads x %ld ops: %lu.%03lu seconds, %.1f ns/op\n",
+               allocators[k].name, nthreads, nops, usec / 1000000,
+               (usec / 1000) % 1000,
+               1000.0 * (double)usec / ((double)nops * nthreads));
+    }
     return 0;
 }
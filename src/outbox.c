@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * outbox.c - per-thread deferral of packet transmission in the RPC system
+ *
+ * an outbox is allocated for a thread the first time it defers a packet,
+ * and freed when the thread exits; when it is full, it is doubled in
+ * size, so that deferred packets keep their order and none is paced while
+ * the table is locked; only if there is no memory to grow it are packets
+ * transmitted at once, unpaced, as they were before outboxes existed
+ */
+
+#include "outbox.h"
+#include "payload.h"
+#include "srpcdefs.h"
+#include "transport.h"
+#include "spin.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+typedef struct entry {
+    Transport *tp;
+    struct sockaddr_in addr;
+    unsigned size;
+    unsigned long at;			/* not before, if non-zero */
+    unsigned via;			/* interface index, if non-zero */
+    unsigned char pkt[PKT_SIZE];
+} Entry;
+
+typedef struct outbox {
+    unsigned count;
+    unsigned size;			/* entries allocated */
+    Entry *entries;
+} Outbox;
+
+static pthread_key_t boxKey;
+static pthread_once_t boxOnce = PTHREAD_ONCE_INIT;
+static __thread Outbox *box = NULL;
+
+static void box_free(void *p) {
+    free(((Outbox *)p)->entries);
+    free(p);
+}
+
+static void box_once(void) {
+    (void)pthread_key_create(&boxKey, box_free);
+}
+
+/*
+ * returns the calling thread's outbox, allocating it if necessary
+ */
+static Outbox *box_get(void) {
+    if (box == NULL) {
+        pthread_once(&boxOnce, box_once);
+        if ((box = (Outbox *)malloc(sizeof(Outbox))) == NULL)
+            return NULL;
+        if ((box->entries = (Entry *)malloc(OUTBOX_SLOTS *
+                                            sizeof(Entry))) == NULL) {
+            free(box);
+            box = NULL;
+            return NULL;
+        }
+        box->count = 0;
+        box->size = OUTBOX_SLOTS;
+        (void)pthread_setspecific(boxKey, box);
+    }
+    return box;
+}
+
+/*
+ * double the size of the full outbox `b'
+ * returns 1 if successful, 0 if there is no memory
+ */
+static int box_grow(Outbox *b) {
+    Entry *e = (Entry *)realloc(b->entries, 2 * b->size * sizeof(Entry));
+
+    if (e == NULL)
+        return 0;
+    b->entries = e;
+    b->size *= 2;
+    return 1;
+}
+
+/*
+ * wait until spin_clock() reaches `at', sleeping for all but the last
+ * PACE_SPIN nanoseconds of the wait
+ */
+#define PACE_SPIN 50000
+
+static void wait_until(unsigned long at) {
+    struct timespec ts;
+    unsigned long now, i;
+
+    for (i = 0; (now = spin_clock()) < at; i++)
+        if (at - now > 2 * PACE_SPIN) {
+            ts.tv_sec = 0;
+            ts.tv_nsec = at - now - PACE_SPIN;
+            nanosleep(&ts, NULL);
+        } else
+            spin_pause(i);
+}
+
+static int transmit(Transport *tp, struct sockaddr_in *addr, void *pkt,
+                    unsigned size, unsigned long at, unsigned via) {
+    if (at != 0)
+        wait_until(at);
+    __atomic_fetch_add(&tp->sent, 1, __ATOMIC_RELAXED);
+    if (transport_send_via(tp, addr, pkt, size, via))
+        return 1;
+    __atomic_fetch_add(&tp->failed, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int outbox_send(Transport *tp, struct sockaddr_in *addr, void *pkt,
+                unsigned size, int defer, unsigned long at, unsigned via) {
+    Outbox *b;
+    Entry *e;
+
+    if (! defer || size > PKT_SIZE)
+        return transmit(tp, addr, pkt, size, at, via);
+    if ((b = box_get()) == NULL ||
+            (b->count == b->size && ! box_grow(b)))
+        return transmit(tp, addr, pkt, size, 0, via);	/* never paced */
+    e = &(b->entries[b->count++]);
+    e->tp = tp;
+    e->addr = *addr;
+    e->size = size;
+    e->at = at;
+    e->via = via;
+    memcpy(e->pkt, pkt, size);
+    __atomic_fetch_add(&tp->deferred, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+unsigned outbox_pending(void) {
+    return (box == NULL) ? 0 : box->count;
+}
+
+void outbox_flush(void) {
+    unsigned i;
+
+    if (box == NULL)
+        return;
+    for (i = 0; i < box->count; i++)
+        (void)transmit(box->entries[i].tp, &(box->entries[i].addr),
+                       box->entries[i].pkt, box->entries[i].size,
+                       box->entries[i].at, box->entries[i].via);
+    box->count = 0;
+}
+
+void outbox_stats(Transport *tp, unsigned long *s, unsigned long *d,
+                  unsigned long *f) {
+    *s = __atomic_load_n(&tp->sent, __ATOMIC_RELAXED);
+    *d = __atomic_load_n(&tp->deferred, __ATOMIC_RELAXED);
+    *f = __atomic_load_n(&tp->failed, __ATOMIC_RELAXED);
+}
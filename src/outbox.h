@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * outbox.h - transmission of packets in the RPC system
+ *
+ * each thread has an outbox; a packet sent while the thread holds the
+ * connection table lock is copied into it, and transmitted by
+ * outbox_flush() once the lock has been released, so that no sendto()
+ * lengthens the critical section; other packets are transmitted at once
+ */
+
+#ifndef _OUTBOX_H_
+#define _OUTBOX_H_
+
+#include "transport.h"
+
+/*
+ * transmit `size' bytes at `pkt' to `addr' through `tp', or, if `defer' is
+ * non-zero, queue a copy in the calling thread's outbox, which grows as
+ * needed; if `at' is non-zero, the packet is paced: the thread transmitting
+ * it first waits until spin_clock() reaches `at', but a deferred packet
+ * that cannot be queued is transmitted at once; if `via' is non-zero, the
+ * packet leaves by that interface (see transport_send_via())
+ * returns 1 if transmitted or queued, 0 if transmission failed
+ */
+int outbox_send(Transport *tp, struct sockaddr_in *addr, void *pkt,
+                unsigned size, int defer, unsigned long at, unsigned via);
+
+/*
+ * returns the number of packets queued in the calling thread's outbox
+ */
+unsigned outbox_pending(void);
+
+/*
+ * transmit the packets queued in the calling thread's outbox
+ */
+void outbox_flush(void);
+
+/*
+ * obtain the number of packets transmitted through `tp', how many of them
+ * were deferred, and how many the kernel refused, since it was opened;
+ * each transport keeps its own counts, so that contexts share none
+ */
+void outbox_stats(Transport *tp, unsigned long *sent,
+                  unsigned long *deferred, unsigned long *failed);
+
+#endif /* _OUTBOX_H_ */
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * path.c - weighted striping of packets across paths for simple RPC system
+ */
+
+#include "path.h"
+#include <string.h>
+
+#define RECENT 256			/* groups over which loss is judged */
+#define ONE 1024			/* a delivery ratio of 1 */
+
+void paths_init(Paths *ps, unsigned n) {
+    unsigned i;
+
+    memset(ps, 0, sizeof(Paths));
+    for (i = 0; i < PATH_SLOTS; i++)
+        ps->slot[i] = (n > 0) ? i % n : 0;
+}
+
+void paths_schedule(Paths *ps, unsigned n) {
+    unsigned long w[MAX_PATHS], total = 0, best = 0;
+    long credit[MAX_PATHS];
+    unsigned count[MAX_PATHS], left = PATH_SLOTS - n;
+    unsigned i, j, k;
+
+    if (n < 2 || n > MAX_PATHS)
+        return;
+    for (i = 0; i < n; i++)		/* the fastest path measured */
+        if (ps->stat[i].srtt != 0 &&
+                (best == 0 || ps->stat[i].srtt < best))
+            best = ps->stat[i].srtt;
+    for (i = 0; i < n; i++) {
+        PathStat *s = &ps->stat[i];
+
+        w[i] = ONE * (s->sent - s->lost + 1) / (s->sent + 1);
+        if (s->srtt > best)
+            w[i] = w[i] * best / s->srtt;
+        total += w[i];
+    }
+    /* a slot each, the rest in proportion to weight */
+    for (i = 0; i < n; i++) {
+        count[i] = 1 + ((total > 0) ? left * w[i] / total : 0);
+        credit[i] = 0;
+    }
+    for (i = 0, k = n; i < n; i++)
+        k += count[i] - 1;
+    for (i = 0; k < PATH_SLOTS; i = (i + 1) % n, k++)
+        count[i]++;			/* rounding */
+    /* interleave them, as smooth weighted round robin does */
+    for (k = 0; k < PATH_SLOTS; k++) {
+        for (i = 0, j = 0; i < n; i++) {
+            credit[i] += count[i];
+            if (credit[i] > credit[j])
+                j = i;
+        }
+        credit[j] -= PATH_SLOTS;
+        ps->slot[k] = j;
+    }
+}
+
+unsigned paths_next(Paths *ps) {
+    unsigned i = ps->slot[ps->next];
+    PathStat *s = &ps->stat[i];
+
+    ps->next = (ps->next + 1) % PATH_SLOTS;
+    if (++s->sent > RECENT) {		/* forget the distant past */
+        s->sent /= 2;
+        s->lost /= 2;
+    }
+    return i;
+}
+
+void paths_acked(Paths *ps, unsigned i, unsigned long rtt) {
+    PathStat *s = &ps->stat[i];
+
+    s->srtt = (s->srtt == 0) ? rtt : (7 * s->srtt + rtt) / 8;
+}
+
+void paths_lost(Paths *ps, unsigned i) {
+    PathStat *s = &ps->stat[i];
+
+    if (s->lost < s->sent)
+        s->lost++;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * path.h - striping of fragments across local interfaces in the RPC system
+ *
+ * a context may be given several local interfaces, or paths, across which
+ * the fragments of its messages are spread; each parity group of fragments
+ * (see fec.h), or each fragment if there are none, leaves by the interface
+ * assigned to it, but from the context's own address, so that the receiver
+ * sees one connection whichever path a packet took, and replies come back
+ * by that address's link; since a packet from that address leaving by
+ * another interface looks spoofed, anti-spoofing (uRPF, BCP38, strict
+ * rp_filter) must be disabled along every path; as a group keeps to one
+ * path, its acknowledgement or loss is the measure of that path, and the
+ * loss of a path costs no more than one packet of any other group
+ *
+ * the paths to each remote host are weighted by the share of the groups
+ * recently sent on each that were delivered whole and by their round trip
+ * times, as measured from the acknowledgements; groups are assigned to
+ * paths in turn by a schedule of PATH_SLOTS slots, rebuilt from the weights
+ * on each tick, in which every path keeps at least one slot, so that it is
+ * still measured while it is doing badly
+ *
+ * the path state of a host is kept in its peer record (see peer.h), and is
+ * guarded likewise
+ */
+
+#ifndef _PATH_H_
+#define _PATH_H_
+
+#include "srpcdefs.h"
+
+typedef struct path_stat {
+    unsigned long srtt;			/* nanoseconds, 0 until measured */
+    unsigned sent;			/* groups sent recently */
+    unsigned lost;			/* of those, found to be lost */
+} PathStat;
+
+typedef struct paths {
+    PathStat stat[MAX_PATHS];
+    unsigned char slot[PATH_SLOTS];	/* the path of each slot */
+    unsigned char next;			/* the next slot to be claimed */
+} Paths;
+
+/*
+ * set up `ps' for `n' paths, with an even schedule and no measurements
+ */
+void paths_init(Paths *ps, unsigned n);
+
+/*
+ * rebuild the schedule of `ps', with `n' paths, from their measurements
+ */
+void paths_schedule(Paths *ps, unsigned n);
+
+/*
+ * take the next slot of the schedule for a group about to be sent,
+ * recording that it is sent
+ * returns the path of the slot
+ */
+unsigned paths_next(Paths *ps);
+
+/*
+ * record that a group sent on path `i' was acknowledged after `rtt'
+ * nanoseconds
+ */
+void paths_acked(Paths *ps, unsigned i, unsigned long rtt);
+
+/*
+ * record that a group sent on path `i' was lost in part
+ */
+void paths_lost(Paths *ps, unsigned i);
+
+#endif /* _PATH_H_ */
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * payload.h - command codes and packet layouts for the simple RPC protocol
+ *
+ * all multi-byte fields are in NETWORK order on the wire
+ */
+
+#ifndef _PAYLOAD_H_
+#define _PAYLOAD_H_
+
+#include "srpcdefs.h"
+#include <stdint.h>
+
+#define CONNECT 1
+#define CACK 2
+#define QUERY 3
+#define QACK 4
+#define RESPONSE 5
+#define RACK 6
+#define DISCONNECT 7
+#define DACK 8
+#define FRAGMENT 9
+#define FACK 10
+#define PING 11
+#define PACK 12
+#define SEQNO 13
+#define SACK 14
+#define PARITY 15		/* XOR of a parity group (see fec.h) */
+#define CMD_LOW CONNECT
+#define CMD_HIGH PARITY		/* change this if commands added */
+
+typedef struct ph {
+    uint32_t subport;	/* 3rd piece of identifier triple */
+    uint32_t seqno;	/* sequence number */
+    uint8_t group;	/* see below */
+    uint8_t command;	/* message type */
+    uint8_t fnum;	/* number of this fragment */
+    uint8_t nfrags;	/* number of fragments */
+} PayloadHeader;
+
+/*
+ * `group' and `command' share the 16 bits once given to the command, so a
+ * packet with no `group' is unchanged on the wire; in a FRAGMENT or PARITY
+ * packet, `group' is the last fragment of its parity group, and in a QUERY
+ * it is the size of parity group wanted for the response - 0 for none;
+ * control packets never carry a `group', as endpoints built before it
+ * would read the pair as an illegal command
+ *
+ * a PACK has an `fnum' of 0 rather than 1 if the connection PINGed is
+ * unknown to the endpoint that answered, so that the connection can be
+ * timed out; older endpoints ignore `fnum' in a PACK
+ */
+
+typedef struct dh {
+    uint16_t tlen;	/* total length of the data */
+    uint16_t flen;	/* length of this fragment */
+} DataHeader;
+
+typedef struct cp {		/* control payload */
+    PayloadHeader hdr;
+} ControlPayload;
+
+typedef struct conp {
+    PayloadHeader hdr;
+    char sname[1];		/* EOS-terminated service name */
+} ConnectPayload;
+
+typedef struct dp {		/* template for data payload */
+    PayloadHeader hdr;
+    DataHeader dhdr;
+    unsigned char data[1];	/* data is address of `len' bytes */
+} DataPayload;
+
+#define CP_SIZE sizeof(ControlPayload)
+#define DP_HDR_SIZE (sizeof(PayloadHeader) + sizeof(DataHeader))
+#define PKT_SIZE (DP_HDR_SIZE + FR_SIZE)	/* largest single packet */
+#define MSG_SIZE (DP_HDR_SIZE + 65535)		/* largest reassembled message */
+
+#endif /* _PAYLOAD_H_ */
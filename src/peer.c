@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * peer.c - per-host congestion windows, pacing and liveness for simple RPC
+ *          system
+ */
+
+#include "peer.h"
+#include "ctable.h"
+#include "spin.h"
+#include "srpcdefs.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef PTABLE_SIZE
+#define PTABLE_SIZE 31
+#endif /* PTABLE_SIZE */
+
+#define ONE 256				/* one packet, in units of cwnd */
+#define MAX_PACE 20000000		/* longest pacing delay, a tick */
+
+struct ptable {
+    Peer *peers[PTABLE_SIZE];
+    unsigned long ticks;		/* advanced by ptable_tick() */
+    unsigned long waits;
+    unsigned long deferred;
+    unsigned npaths;			/* see ptable_paths() */
+};
+
+static int flags = PEER_WINDOW | PEER_PACING;
+
+void peer_config(int f) {
+    __atomic_store_n(&flags, f, __ATOMIC_RELAXED);
+}
+
+PTable *ptable_create(void) {
+    PTable *pt;
+
+    if ((pt = (PTable *)malloc(sizeof(PTable))) == NULL)
+        return NULL;
+    memset(pt, 0, sizeof(PTable));
+    return pt;
+}
+
+Peer *ptable_lookup(PTable *pt, RpcEndpoint *ep) {
+    in_addr_t addr = ep->addr.sin_addr.s_addr;
+    unsigned hash = ntohl(addr) % PTABLE_SIZE;
+    Peer *p;
+
+    for (p = pt->peers[hash]; p != NULL; p = p->next)
+        if (p->addr == addr) {
+            p->refs++;
+            return p;
+        }
+    if ((p = (Peer *)malloc(sizeof(Peer))) == NULL)
+        return NULL;
+    memset(p, 0, sizeof(Peer));
+    p->addr = addr;
+    p->cwnd = CC_INITIAL_WINDOW * ONE;
+    p->ssthresh = CC_MAX_WINDOW;
+    paths_init(&p->paths, pt->npaths);
+    p->refs = 1;
+    p->next = pt->peers[hash];
+    pt->peers[hash] = p;
+    return p;
+}
+
+void peer_release(Peer *p) {
+    if (p->refs > 0)
+        p->refs--;
+}
+
+/*
+ * free `p' and its keepalives
+ */
+static void peer_free(Peer *p) {
+    Keepalive *k;
+
+    while ((k = p->alive) != NULL) {
+        p->alive = k->next;
+        free(k);
+    }
+    if (p->room != NULL) {
+        pthread_cond_destroy(p->room);
+        free(p->room);
+    }
+    free(p);
+}
+
+/*
+ * count down the silence of the endpoint of `k'; a PING is due at the end
+ * of each silent interval, the interval halving for each one unanswered
+ */
+static void keepalive_tick(Keepalive *k) {
+    if (--k->ticksTilPing > 0)
+        return;
+    if (k->pingsTilPurge < PINGS_BEFORE_PURGE) {	/* unanswered */
+        k->interval /= 2;
+        if (k->interval < PING_MIN_TICKS)
+            k->interval = PING_MIN_TICKS;
+    }
+    k->ticksTilPing = k->interval;
+    if (--k->pingsTilPurge > 0)
+        k->due = 1;
+}
+
+void ptable_tick(PTable *pt) {
+    Keepalive **kp, *k;
+    Peer **pp, *p;
+    int i;
+
+    pt->ticks++;
+    for (i = 0; i < PTABLE_SIZE; i++)
+        for (pp = &pt->peers[i]; (p = *pp) != NULL; ) {
+            if (p->refs == 0 && p->inflight == 0 && p->waiters == 0) {
+                *pp = p->next;			/* no longer in use */
+                peer_free(p);
+                continue;
+            }
+            if (p->waiters > 0)
+                pthread_cond_broadcast(p->room);
+            paths_schedule(&p->paths, pt->npaths);
+            for (kp = &p->alive; (k = *kp) != NULL; ) {
+                if (k->pingsTilPurge == 0) {
+                    *kp = k->next;
+                    free(k);
+                } else {
+                    keepalive_tick(k);
+                    kp = &k->next;
+                }
+            }
+            pp = &p->next;
+        }
+}
+
+void ptable_paths(PTable *pt, unsigned n) {
+    Peer *p;
+    int i;
+
+    pt->npaths = n;
+    for (i = 0; i < PTABLE_SIZE; i++)
+        for (p = pt->peers[i]; p != NULL; p = p->next)
+            paths_init(&p->paths, n);
+}
+
+void ptable_stats(PTable *pt, unsigned long *waits, unsigned long *deferred) {
+    *waits = pt->waits;
+    *deferred = pt->deferred;
+}
+
+void ptable_purge(PTable *pt) {
+    Peer *p, *next;
+    int i;
+
+    for (i = 0; i < PTABLE_SIZE; i++) {
+        for (p = pt->peers[i]; p != NULL; p = next) {
+            next = p->next;
+            peer_free(p);
+        }
+        pt->peers[i] = NULL;
+    }
+}
+
+Keepalive *peer_keepalive(Peer *p, in_port_t port) {
+    Keepalive *k;
+
+    for (k = p->alive; k != NULL; k = k->next)
+        if (k->port == port)
+            return k;
+    if ((k = (Keepalive *)malloc(sizeof(Keepalive))) == NULL)
+        return NULL;
+    k->port = port;
+    k->link = NULL;
+    k->first = NULL;
+    k->after = NULL;
+    k->last = 0;
+    k->pingsTilPurge = PINGS_BEFORE_PURGE;
+    k->due = 0;
+    k->interval = TICKS_BETWEEN_PINGS;
+    k->ticksTilPing = k->interval;
+    k->next = p->alive;
+    p->alive = k;
+    return k;
+}
+
+void peer_heard(Peer *p, in_port_t port) {
+    Keepalive *k = peer_keepalive(p, port);
+
+    if (k == NULL)
+        return;
+    if (k->pingsTilPurge == PINGS_BEFORE_PURGE - 1) {	/* first PING */
+        k->interval *= 2;
+        if (k->interval > PING_MAX_TICKS)
+            k->interval = PING_MAX_TICKS;
+    }
+    k->ticksTilPing = k->interval;
+    k->pingsTilPurge = PINGS_BEFORE_PURGE;
+    k->due = 0;
+}
+
+void ptable_destroy(PTable *pt) {
+    ptable_purge(pt);
+    free(pt);
+}
+
+void peer_sent(Peer *p) {
+    p->inflight++;
+}
+
+void peer_done(Peer *p, int acked, unsigned long rtt) {
+    if (p->inflight > 0)
+        p->inflight--;
+    if (acked) {
+        if (p->cwnd < p->ssthresh * ONE)
+            p->cwnd += ONE;			/* slow start */
+        else
+            p->cwnd += ONE * ONE / p->cwnd;	/* additive increase */
+        if (p->cwnd > CC_MAX_WINDOW * ONE)
+            p->cwnd = CC_MAX_WINDOW * ONE;
+        if (rtt > 0)
+            p->srtt = (p->srtt == 0) ? rtt : (7 * p->srtt + rtt) / 8;
+    }
+    if (p->waiters > 0)
+        pthread_cond_signal(p->room);
+}
+
+int peer_retry(PTable *pt, Peer *p, unsigned long sentAt) {
+    if (! (__atomic_load_n(&flags, __ATOMIC_RELAXED) & PEER_WINDOW))
+        return 1;
+    if (sentAt >= p->cutAt) {			/* a new loss */
+        p->cutAt = spin_clock();
+        p->cwnd /= 2;				/* multiplicative decrease */
+        if (p->cwnd < ONE)
+            p->cwnd = ONE;
+        p->ssthresh = p->cwnd / ONE;
+        p->tick = pt->ticks - 1;
+    }
+    if (p->tick != pt->ticks) {
+        p->tick = pt->ticks;
+        p->budget = p->cwnd / ONE;
+    }
+    if (p->budget == 0) {
+        pt->deferred++;
+        return 0;
+    }
+    p->budget--;
+    return 1;
+}
+
+int peer_room(Peer *p) {
+    if (! (__atomic_load_n(&flags, __ATOMIC_RELAXED) & PEER_WINDOW))
+        return 1;
+    return (p->inflight * ONE < p->cwnd);
+}
+
+void peer_await(PTable *pt, Peer *p, struct ctable *ct) {
+    unsigned long start = pt->ticks;
+
+    if (p->room == NULL) {
+        pthread_cond_t *c = (pthread_cond_t *)malloc(sizeof(*c));
+        if (c == NULL)
+            return;
+        pthread_cond_init(c, NULL);
+        p->room = c;
+    }
+    pt->waits++;
+    p->waiters++;
+    while (! peer_room(p) && pt->ticks - start < CC_MAX_WAIT)
+        ctable_wait(ct, p->room);
+    p->waiters--;
+}
+
+unsigned long peer_pace(Peer *p) {
+    unsigned long now, gap, at;
+
+    if (! (__atomic_load_n(&flags, __ATOMIC_RELAXED) & PEER_PACING) ||
+            p->srtt == 0)
+        return 0;
+    gap = p->srtt * ONE / p->cwnd;	/* a window per round trip ... */
+    if (p->cwnd < p->ssthresh * ONE)
+        gap /= 2;			/* ... twice that in slow start */
+    else
+        gap = gap * 4 / 5;		/* ... or 5/4 of it */
+    if (gap > MAX_PACE)
+        gap = MAX_PACE;
+    now = spin_clock();
+    at = (p->nextSend > now) ? p->nextSend : now;
+    if (at > now + MAX_PACE)
+        at = now + MAX_PACE;
+    p->nextSend = at + gap;
+    return (at > now) ? at : 0;
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * peer.h - per-host congestion and liveness state for the RPC system
+ *
+ * each connection has at most one packet awaiting acknowledgement, but a
+ * host may be the far end of many connections; the packets outstanding to
+ * each remote host, from all of the connections to it in a context, are
+ * limited by an AIMD congestion window held in a peer record
+ *
+ * the window grows by one packet per acknowledgement until the first
+ * loss (slow start), then by one packet per window's worth (additive
+ * increase); it is halved when the timer must retransmit a packet sent to
+ * the host since the window was last cut (multiplicative decrease), and
+ * the timer retransmits at most a window's worth of packets to the host
+ * per tick
+ *
+ * application threads wait for room in the window before starting a
+ * message, and their data packets are paced at a little more than one
+ * window per smoothed round trip time
+ *
+ * a peer record also holds the state of the paths to its host, where the
+ * context stripes fragments across several local interfaces (see path.h)
+ *
+ * liveness is kept per remote endpoint (the host's address and port) in a
+ * keepalive record hung off the peer, so that one PING/PACK exchange with
+ * the endpoint vouches for all of the connections to it; any packet
+ * received on one of them counts as hearing from it, and a PING is due
+ * only after an interval of silence; the interval doubles, up to
+ * PING_MAX_TICKS, each time the first PING is answered, and halves, down
+ * to PING_MIN_TICKS, each time one goes unanswered, so that steady
+ * endpoints are pinged rarely and flaky ones are found dead sooner; after
+ * PINGS_BEFORE_PURGE silent intervals the endpoint is dead, and the idle
+ * connections to it time out
+ *
+ * each PING is sent on the next of the idle connections to the endpoint,
+ * in order of subport, and the PACK is marked if the endpoint no longer
+ * knows that connection, which then times out alone, so that connections
+ * forgotten by a live endpoint are still found in turn
+ *
+ * a peer record lives as long as there are records in the connection table
+ * for its host: once there are none, and no packets to it are outstanding
+ * and no thread is waiting for room with it, the next tick frees it along
+ * with its keepalives, which serve only those records
+ *
+ * peer records belong to a connection table, and are guarded by its lock
+ */
+
+#ifndef _PEER_H_
+#define _PEER_H_
+
+#include "endpoint.h"
+#include "path.h"
+#include <pthread.h>
+
+struct ctable;
+struct c_record;
+
+typedef struct keepalive {
+    struct keepalive *next;
+    struct keepalive *link;		/* used by ctable_scan() */
+    struct c_record *first;		/* idle connection, lowest subport */
+    struct c_record *after;		/* next idle connection after `last' */
+    unsigned long last;			/* subport last PINGed, host order */
+    in_port_t port;			/* network order */
+    unsigned char pingsTilPurge;	/* 0 once the endpoint is dead */
+    unsigned char due;			/* a PING should be sent */
+    unsigned ticksTilPing;
+    unsigned interval;			/* ticks of silence before a PING */
+} Keepalive;
+
+typedef struct peer {
+    struct peer *next;
+    in_addr_t addr;			/* network order */
+    unsigned cwnd;			/* window, in 1/256ths of a packet */
+    unsigned ssthresh;			/* packets; slow start below this */
+    unsigned inflight;			/* packets awaiting acknowledgement */
+    unsigned budget;			/* retransmissions left this tick */
+    unsigned long tick;			/* of last retransmission */
+    unsigned long cutAt;		/* when the window was last cut */
+    unsigned long srtt;			/* nanoseconds, 0 until measured */
+    unsigned long nextSend;		/* pacing clock, as spin_clock() */
+    unsigned waiters;			/* threads waiting for room */
+    pthread_cond_t *room;		/* NULL until first waiter */
+    Paths paths;			/* to the host, if striping */
+    Keepalive *alive;			/* one per remote port */
+    unsigned refs;			/* connection records referring to it */
+} Peer;
+
+typedef struct ptable PTable;
+
+#define PEER_WINDOW 0x1			/* limit packets outstanding */
+#define PEER_PACING 0x2			/* pace data packets */
+
+/*
+ * select which of the above apply, in all tables; both by default
+ */
+void peer_config(int flags);
+
+/*
+ * create a table of peer records
+ * returns NULL if error
+ */
+PTable *ptable_create(void);
+
+/*
+ * returns the record for the host of `ep', creating it if necessary, with
+ * a reference taken for the caller, or NULL if there is no memory for it
+ */
+Peer *ptable_lookup(PTable *pt, RpcEndpoint *ep);
+
+/*
+ * give up a reference to `p' taken by ptable_lookup()
+ */
+void peer_release(Peer *p);
+
+/*
+ * advance the table's tick count, wake the threads waiting for room with
+ * any peer, so that each can see whether it has waited long enough,
+ * rebuild the path schedule of each peer, and count down the silence of
+ * each remote endpoint, marking a PING as due or the endpoint as dead;
+ * keepalive records found dead on the previous tick are freed, as their
+ * idle connections have since timed out, as are peers no longer in use;
+ * called by the timer on each tick before the connection table is scanned
+ */
+void ptable_tick(PTable *pt);
+
+/*
+ * set the number of paths to each host across which fragments are striped,
+ * starting the path state of every peer afresh
+ */
+void ptable_paths(PTable *pt, unsigned n);
+
+/*
+ * obtain the number of times senders have waited for room, and the number
+ * of retransmissions deferred to a later tick
+ */
+void ptable_stats(PTable *pt, unsigned long *waits, unsigned long *deferred);
+
+/*
+ * destroy every record in the table; no thread may be waiting on one
+ */
+void ptable_purge(PTable *pt);
+
+/*
+ * destroy the table and every record in it
+ */
+void ptable_destroy(PTable *pt);
+
+/*
+ * returns the keepalive record for port `port' (network order) of `p',
+ * creating it if necessary, or NULL if there is no memory for it
+ */
+Keepalive *peer_keepalive(Peer *p, in_port_t port);
+
+/*
+ * note that a packet has been received from port `port' of `p'
+ */
+void peer_heard(Peer *p, in_port_t port);
+
+/*
+ * note that a packet has been sent to `p' and awaits acknowledgement
+ */
+void peer_sent(Peer *p);
+
+/*
+ * note that a packet outstanding to `p' has been acknowledged, after
+ * `rtt' nanoseconds if it was not retransmitted, 0 otherwise, or, if
+ * `acked' is zero, that it has been abandoned
+ */
+void peer_done(Peer *p, int acked, unsigned long rtt);
+
+/*
+ * returns 1 if a packet first sent to `p' at `sentAt' (as spin_clock())
+ * may be retransmitted in the current tick, 0 if it must wait for a later
+ * one; the window is halved if the packet was sent since it was last cut
+ */
+int peer_retry(PTable *pt, Peer *p, unsigned long sentAt);
+
+/*
+ * returns 1 if the window of `p' has room for another packet
+ */
+int peer_room(Peer *p);
+
+/*
+ * wait, with table `ct' locked, until the window of `p' has room for
+ * another packet, but for no more than CC_MAX_WAIT ticks (see srpcdefs.h);
+ * the lock is released while waiting
+ */
+void peer_await(PTable *pt, Peer *p, struct ctable *ct);
+
+/*
+ * returns the time, as spin_clock(), before which the next data packet to
+ * `p' should not be transmitted, 0 if it may be transmitted at once, and
+ * advances the pacing clock past it; the pacing rate is twice the window
+ * per round trip in slow start and 5/4 of it thereafter, as in Linux TCP
+ */
+unsigned long peer_pace(Peer *p);
+
+#endif /* _PEER_H_ */
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pool.c - pools of ready connections in the RPC system
+ *
+ * each pool has a thread that tops it up to `warm' connections with
+ * rpc_connect_many() whenever connections are taken from it; idle
+ * connections in the pool are kept alive by the timer's pings, and any
+ * that the timer has since given up on are discarded when taken
+ */
+
+#include "srpc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define RETRY_SECS 1		/* pause after a round with no success */
+
+typedef struct pool {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;	/* signalled when the pool needs filling */
+    pthread_t filler;
+    char *host;
+    char *svcName;
+    unsigned short port;
+    unsigned warm;
+    unsigned count;		/* number of connections in `conns' */
+    int stopping;
+    RpcConnection *conns;
+} Pool;
+
+static void *filler(void *args) {
+    Pool *p = (Pool *)args;
+    RpcTarget *t;
+    struct timespec until;
+    unsigned i, need;
+
+    if ((t = (RpcTarget *)malloc(p->warm * sizeof(RpcTarget))) == NULL)
+        return NULL;
+    for (i = 0; i < p->warm; i++) {
+        t[i].host = p->host;
+        t[i].port = p->port;
+        t[i].svcName = p->svcName;
+    }
+    pthread_mutex_lock(&p->mutex);
+    while (! p->stopping) {
+        if (p->count >= p->warm) {
+            pthread_cond_wait(&p->cond, &p->mutex);
+            continue;
+        }
+        need = p->warm - p->count;
+        pthread_mutex_unlock(&p->mutex);
+        (void) rpc_connect_many(t, need, 1l);
+        pthread_mutex_lock(&p->mutex);
+        for (i = 0; i < need; i++) {
+            if (t[i].rpc == NULL)
+                continue;
+            if (p->stopping || p->count >= p->warm)
+                rpc_disconnect(t[i].rpc);
+            else
+                p->conns[p->count++] = t[i].rpc;
+        }
+        if (p->count < p->warm && ! p->stopping) {	/* target is down */
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_sec += RETRY_SECS;
+            pthread_cond_timedwait(&p->cond, &p->mutex, &until);
+        }
+    }
+    pthread_mutex_unlock(&p->mutex);
+    free(t);
+    return NULL;
+}
+
+RpcPool rpc_pool_create(char *host, unsigned short port, char *svcName,
+                        unsigned warm) {
+    Pool *p;
+
+    if (warm == 0 || (p = (Pool *)malloc(sizeof(Pool))) == NULL)
+        return NULL;
+    p->host = strdup(host);
+    p->svcName = strdup(svcName);
+    p->conns = (RpcConnection *)malloc(warm * sizeof(RpcConnection));
+    if (p->host == NULL || p->svcName == NULL || p->conns == NULL)
+        goto failure;
+    p->port = port;
+    p->warm = warm;
+    p->count = 0;
+    p->stopping = 0;
+    pthread_mutex_init(&p->mutex, NULL);
+    pthread_cond_init(&p->cond, NULL);
+    if (pthread_create(&p->filler, NULL, filler, p) == 0)
+        return (RpcPool)p;
+    pthread_mutex_destroy(&p->mutex);
+    pthread_cond_destroy(&p->cond);
+failure:
+    free(p->host);
+    free(p->svcName);
+    free(p->conns);
+    free(p);
+    return NULL;
+}
+
+RpcConnection rpc_pool_get(RpcPool pool) {
+    Pool *p = (Pool *)pool;
+    RpcConnection rpc = NULL;
+
+    pthread_mutex_lock(&p->mutex);
+    while (rpc == NULL && p->count > 0) {
+        rpc = p->conns[--p->count];
+        if (! rpc_connection_idle(rpc))		/* the timer will purge it */
+            rpc = NULL;
+    }
+    pthread_cond_signal(&p->cond);
+    pthread_mutex_unlock(&p->mutex);
+    if (rpc == NULL)
+        rpc = rpc_connect(p->host, p->port, p->svcName, 1l);
+    return rpc;
+}
+
+void rpc_pool_put(RpcPool pool, RpcConnection rpc) {
+    Pool *p = (Pool *)pool;
+
+    pthread_mutex_lock(&p->mutex);
+    if (p->count < p->warm && ! p->stopping && rpc_connection_idle(rpc)) {
+        p->conns[p->count++] = rpc;
+        rpc = NULL;
+    }
+    pthread_mutex_unlock(&p->mutex);
+    if (rpc != NULL)
+        rpc_disconnect(rpc);
+}
+
+void rpc_pool_destroy(RpcPool pool) {
+    Pool *p = (Pool *)pool;
+    unsigned i;
+
+    pthread_mutex_lock(&p->mutex);
+    p->stopping = 1;
+    pthread_cond_signal(&p->cond);
+    pthread_mutex_unlock(&p->mutex);
+    pthread_join(p->filler, NULL);
+    for (i = 0; i < p->count; i++)
+        rpc_disconnect(p->conns[i]);
+    pthread_mutex_destroy(&p->mutex);
+    pthread_cond_destroy(&p->cond);
+    free(p->host);
+    free(p->svcName);
+    free(p->conns);
+    free(p);
+}
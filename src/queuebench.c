@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * contention benchmark for service queues: the mutex-protected linked list
+ * (tslist) versus the bounded lock-free ring (squeue)
+ *
+ * usage: ./queuebench [-p nproducers] [-c nconsumers] [-n nitems] [-b batch]
+ *
+ * each of `nproducers' threads puts `nitems' elements on the queue, while
+ * `nconsumers' threads remove them, up to `batch' elements at a time where
+ * the queue supports batched removal; a producer that finds the ring full
+ * yields and retries, as the reader does by leaving the query unacknowledged
+ */
+
+#include "tslist.h"
+#include "squeue.h"
+#include "srpcdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/time.h>
+
+#define NPRODUCERS 1
+#define NCONSUMERS 4
+#define NITEMS 1000000
+#define BATCH 16
+#define MAX_THREADS 64
+#define MAX_BATCH 64
+#define USAGE "./queuebench [-p nproducers] [-c nconsumers] [-n nitems] " \
+              "[-b batch]"
+
+static int nproducers = NPRODUCERS;
+static int nconsumers = NCONSUMERS;
+static long nitems = NITEMS;
+static unsigned batch = BATCH;
+
+static char item;		/* every element refers to this */
+static char pill;		/* tells a consumer to stop */
+
+typedef struct queue {
+    char *name;
+    void *(*create)(void);
+    int (*put)(void *q, void *a, void *b);
+    unsigned (*get)(void *q, void **a, void **b, unsigned max);
+    void *q;
+} Queue;
+
+static void *tsl_new(void) {
+    return tsl_create();
+}
+
+static int tsl_put(void *q, void *a, void *b) {
+    return tsl_append(q, a, b, 0);
+}
+
+static unsigned tsl_get(void *q, void **a, void **b, unsigned max) {
+    int size;
+
+    (void) max;				/* one element per lock round */
+    tsl_remove(q, a, b, &size);
+    return 1;
+}
+
+static void *sq_new(void) {
+    return squeue_create(SQUEUE_SIZE);
+}
+
+static unsigned sq_get(void *q, void **a, void **b, unsigned max) {
+    return squeue_get_batch(q, a, b, NULL, max);
+}
+
+static Queue queues[] = {
+    {"tslist", tsl_new, tsl_put, tsl_get, NULL},
+    {"squeue", sq_new, squeue_put, sq_get, NULL}
+};
+#define NQUEUES (sizeof(queues) / sizeof(queues[0]))
+
+static void put(Queue *qu, void *b) {
+    while (! qu->put(qu->q, NULL, b))
+        sched_yield();			/* full */
+}
+
+static void *producer(void *args) {
+    Queue *qu = (Queue *)args;
+    long i;
+
+    for (i = 0; i < nitems; i++)
+        put(qu, &item);
+    return NULL;
+}
+
+static void *consumer(void *args) {
+    Queue *qu = (Queue *)args;
+    void *a[MAX_BATCH], *b[MAX_BATCH];
+    unsigned i, n;
+    int pills = 0;
+
+    while (! pills) {
+        n = qu->get(qu->q, a, b, batch);
+        for (i = 0; i < n; i++)
+            if (b[i] == &pill)
+                pills++;
+    }
+    while (--pills > 0)			/* pass on the ones meant for others */
+        put(qu, &pill);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    pthread_t pth[MAX_THREADS], cth[MAX_THREADS];
+    struct timeval start, stop;
+    unsigned long usec;
+    unsigned k;
+    int i, j;
+
+    for (i = 1; i < argc; ) {
+        if ((j = i + 1) == argc) {
+            fprintf(stderr, "usage: %s\n", USAGE);
+            exit(1);
+        }
+        if (strcmp(argv[i], "-p") == 0) {
+            nproducers = atoi(argv[j]);
+            if (nproducers > MAX_THREADS)
+                nproducers = MAX_THREADS;
+        } else if (strcmp(argv[i], "-c") == 0) {
+            nconsumers = atoi(argv[j]);
+            if (nconsumers > MAX_THREADS)
+                nconsumers = MAX_THREADS;
+        } else if (strcmp(argv[i], "-n") == 0)
+            nitems = atol(argv[j]);
+        else if (strcmp(argv[i], "-b") == 0) {
+            batch = atoi(argv[j]);
+            if (batch > MAX_BATCH)
+                batch = MAX_BATCH;
+        } else {
+            fprintf(stderr, "Unknown flag: %s %s\n", argv[i], argv[j]);
+        }
+        i = j + 1;
+    }
+    if (nproducers < 1 || nconsumers < 1 || nitems < 1 || batch < 1) {
+        fprintf(stderr, "usage: %s\n", USAGE);
+        exit(1);
+    }
+    for (k = 0; k < NQUEUES; k++) {
+        Queue *qu = &queues[k];
+        if ((qu->q = qu->create()) == NULL) {
+            fprintf(stderr, "Failure to create %s\n", qu->name);
+            exit(-1);
+        }
+        gettimeofday(&start, NULL);
+        for (i = 0; i < nconsumers; i++)
+            if (pthread_create(&cth[i], NULL, consumer, qu)) {
+                fprintf(stderr, "Failure to start consumer thread\n");
+                exit(-1);
+            }
+        for (i = 0; i < nproducers; i++)
+            if (pthread_create(&pth[i], NULL, producer, qu)) {
+                fprintf(stderr, "Failure to start producer thread\n");
+                exit(-1);
+            }
+        for (i = 0; i < nproducers; i++)
+            pthread_join(pth[i], NULL);
+        for (i = 0; i < nconsumers; i++)
+            put(qu, &pill);
+        for (i = 0; i < nconsumers; i++)
+            pthread_join(cth[i], NULL);
+        gettimeofday(&stop, NULL);
+        usec = 1000000 * (stop.tv_sec - start.tv_sec) +
+               (stop.tv_usec - start.tv_usec);
+        printf("%-8s %dP/%dC x %ld items: %lu.%03lu seconds, %.1f ns/item\n",
+               qu->name, nproducers, nconsumers, nitems, usec / 1000000,
+               (usec / 1000) % 1000,
+               1000.0 * (double)usec / ((double)nitems * nproducers));
+    }
+    return 0;
+}
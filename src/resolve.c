@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * resolve.c - thread-safe, cached host name resolution for the RPC system
+ *
+ * the cache is a small hash table guarded by its own mutex, which is never
+ * held across a call to getaddrinfo(); if two threads miss on the same host
+ * at once, both consult the resolver and the later result is kept
+ */
+
+#include "resolve.h"
+#include "srpcdefs.h"
+#include "spin.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+#define NBUCKETS 64
+#define NSECS_PER_SEC 1000000000UL
+
+typedef struct entry {
+    struct entry *next;
+    struct in_addr addr;
+    unsigned long expires;	/* spin_clock() value after which stale */
+    char host[1];		/* allocated to fit */
+} Entry;
+
+static pthread_mutex_t cacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static Entry *buckets[NBUCKETS];
+
+static unsigned hash(const char *s) {
+    unsigned h = 5381;
+
+    while (*s)
+        h = 33 * h + (unsigned char)*s++;
+    return h % NBUCKETS;
+}
+
+/*
+ * returns 1 and fills in `addr' if `host' is cached and fresh, 0 otherwise
+ */
+static int cache_find(const char *host, struct in_addr *addr) {
+    Entry *p;
+    int ans = 0;
+    unsigned long now = spin_clock();
+
+    pthread_mutex_lock(&cacheMutex);
+    for (p = buckets[hash(host)]; p != NULL; p = p->next)
+        if (strcmp(p->host, host) == 0) {
+            if (p->expires > now) {
+                *addr = p->addr;
+                ans = 1;
+            }
+            break;
+        }
+    pthread_mutex_unlock(&cacheMutex);
+    return ans;
+}
+
+static void cache_insert(const char *host, struct in_addr *addr) {
+    Entry *p;
+    unsigned h = hash(host);
+    unsigned long expires = spin_clock() + RESOLVE_TTL * NSECS_PER_SEC;
+
+    pthread_mutex_lock(&cacheMutex);
+    for (p = buckets[h]; p != NULL; p = p->next)
+        if (strcmp(p->host, host) == 0)
+            break;
+    if (p == NULL &&
+            (p = (Entry *)malloc(sizeof(Entry) + strlen(host))) != NULL) {
+        strcpy(p->host, host);
+        p->next = buckets[h];
+        buckets[h] = p;
+    }
+    if (p != NULL) {
+        p->addr = *addr;
+        p->expires = expires;
+    }
+    pthread_mutex_unlock(&cacheMutex);
+}
+
+int resolve_host(const char *host, struct sockaddr_in *addr) {
+    struct addrinfo hints, *res;
+    struct in_addr in;
+
+    if (cache_find(host, &in)) {
+        addr->sin_addr = in;
+        return 1;
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host, NULL, &hints, &res) != 0)
+        return 0;
+    in = ((struct sockaddr_in *)res->ai_addr)->sin_addr;
+    freeaddrinfo(res);
+    cache_insert(host, &in);
+    addr->sin_addr = in;
+    return 1;
+}
+
+/*
+ * state shared by the threads of a call to resolve_many()
+ */
+typedef struct batch {
+    pthread_mutex_t mutex;
+    char **hosts;
+    int *ok;
+    int n;
+    int next;			/* index of next host to look up */
+} Batch;
+
+static void *resolver(void *args) {
+    Batch *b = (Batch *)args;
+    struct sockaddr_in addr;
+    int i, ans;
+
+    for (;;) {
+        pthread_mutex_lock(&b->mutex);
+        i = b->next++;
+        pthread_mutex_unlock(&b->mutex);
+        if (i >= b->n)
+            break;
+        ans = resolve_host(b->hosts[i], &addr);
+        if (b->ok != NULL)
+            b->ok[i] = ans;
+    }
+    return NULL;
+}
+
+void resolve_many(char *hosts[], int n, int ok[]) {
+    Batch b;
+    pthread_t thr[RESOLVE_THREADS];
+    int i, nthr = (n < RESOLVE_THREADS) ? n : RESOLVE_THREADS;
+
+    pthread_mutex_init(&b.mutex, NULL);
+    b.hosts = hosts;
+    b.ok = ok;
+    b.n = n;
+    b.next = 0;
+    for (i = 0; i < nthr; i++)
+        if (pthread_create(&thr[i], NULL, resolver, &b) != 0)
+            break;
+    nthr = i;
+    if (nthr == 0)		/* no threads to be had - do it ourselves */
+        (void) resolver(&b);
+    for (i = 0; i < nthr; i++)
+        pthread_join(thr[i], NULL);
+    pthread_mutex_destroy(&b.mutex);
+}
+
+typedef struct request {
+    int n;
+    char *hosts[1];		/* allocated to fit, names follow */
+} Request;
+
+static void *background(void *args) {
+    Request *r = (Request *)args;
+
+    resolve_many(r->hosts, r->n, NULL);
+    free(r);
+    return NULL;
+}
+
+int resolve_async(char *hosts[], int n) {
+    Request *r;
+    pthread_t thr;
+    pthread_attr_t attr;
+    size_t size = sizeof(Request) + n * sizeof(char *);
+    char *s;
+    int i, ans;
+
+    for (i = 0; i < n; i++)
+        size += strlen(hosts[i]) + 1;
+    if ((r = (Request *)malloc(size)) == NULL)
+        return 0;
+    r->n = n;
+    s = (char *)&r->hosts[n + 1];
+    for (i = 0; i < n; i++) {
+        r->hosts[i] = strcpy(s, hosts[i]);
+        s += strlen(s) + 1;
+    }
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    ans = (pthread_create(&thr, &attr, background, r) == 0);
+    pthread_attr_destroy(&attr);
+    if (! ans)
+        free(r);
+    return ans;
+}
+
+void resolve_flush(void) {
+    Entry *p, *q;
+    int i;
+
+    pthread_mutex_lock(&cacheMutex);
+    for (i = 0; i < NBUCKETS; i++) {
+        for (p = buckets[i]; p != NULL; p = q) {
+            q = p->next;
+            free(p);
+        }
+        buckets[i] = NULL;
+    }
+    pthread_mutex_unlock(&cacheMutex);
+}
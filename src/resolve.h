@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * resolve.h - thread-safe, cached host name resolution for the RPC system
+ *
+ * names are resolved with getaddrinfo() by the calling thread, without any
+ * of the library's locks held; successful lookups are remembered for
+ * RESOLVE_TTL seconds, so that repeated connections to the same host do
+ * not each consult the resolver
+ */
+
+#ifndef _RESOLVE_H_
+#define _RESOLVE_H_
+
+#include <netinet/in.h>
+
+/*
+ * look up the IPv4 address of `host', consulting the cache first
+ * returns 1 and fills in addr->sin_addr if successful, 0 otherwise
+ */
+int resolve_host(const char *host, struct sockaddr_in *addr);
+
+/*
+ * look up `n' hosts concurrently, using up to RESOLVE_THREADS threads, and
+ * leave the results in the cache; if `ok' is non-NULL, ok[i] is set to 1
+ * if hosts[i] was resolved, 0 otherwise
+ * returns once every lookup has completed
+ */
+void resolve_many(char *hosts[], int n, int ok[]);
+
+/*
+ * as resolve_many(), but returns at once, the lookups being performed by a
+ * background thread; the host names are copied
+ * returns 1 if the lookups were started, 0 otherwise
+ */
+int resolve_async(char *hosts[], int n);
+
+/*
+ * forget all cached lookups
+ */
+void resolve_flush(void);
+
+#endif /* _RESOLVE_H_ */
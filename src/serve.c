@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * serve.c - managed worker pools for services offered by the simple RPC
+ *           system
+ *
+ * rpc_serve() makes the calling thread the first worker of a pool for the
+ * service; one worker at a time waits on the service queue and takes a fair
+ * share of the queries waiting there into its own deque, and a worker whose
+ * deque is empty steals the oldest query from another worker; the others
+ * sleep until that worker has a batch, so a slow query holds up only the
+ * worker processing it
+ *
+ * the pool is sized from the time queries spend in the service queue: when
+ * the smoothed wait exceeds the target, a worker is added; when it falls
+ * well below the target, a worker retires; at most one change is made in
+ * each adjustment interval
+ */
+
+#include "srpc.h"
+#include "stable.h"
+#include "squeue.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#define MAX_WORKERS 64
+#define DEQUE_SIZE 16		/* queries held by a worker */
+#define RESP_SIZE 65535		/* largest response, as rpc_response() */
+#define TARGET_WAIT 1000	/* default target queue wait, usecs */
+#define ADJUST_INTERVAL 10000	/* usecs between changes in pool size */
+
+struct pool;
+
+typedef struct worker {
+    struct pool *pool;
+    unsigned id;
+    int active;
+    unsigned head;		/* next query to process */
+    unsigned count;		/* queries in the deque */
+    RpcQuery dq[DEQUE_SIZE];
+    pthread_mutex_t mutex;
+} Worker;
+
+typedef struct pool {
+    RpcService rps;
+    SRecord *sr;
+    RpcHandler handler;
+    void *arg;
+    unsigned minw;
+    unsigned maxw;
+    unsigned long target;
+    int firstCpu;
+    unsigned ncpus;		/* 0 if workers are not pinned */
+    unsigned nworkers;		/* workers currently active */
+    unsigned long ewma;		/* smoothed queue wait, usecs */
+    unsigned long lastAdjust;
+    int receiving;		/* a worker is waiting on the service queue */
+    pthread_mutex_t mutex;
+    pthread_cond_t ready;	/* signalled when a batch has been taken */
+    Worker workers[MAX_WORKERS];
+} Pool;
+
+/*
+ * take the oldest query from a worker's deque
+ * returns 1 if successful, 0 if the deque is empty
+ */
+static int take(Worker *w, RpcQuery *q) {
+    int ans = 0;
+
+    pthread_mutex_lock(&(w->mutex));
+    if (w->count > 0) {
+        *q = w->dq[w->head];
+        w->head = (w->head + 1) % DEQUE_SIZE;
+        w->count--;
+        ans = 1;
+    }
+    pthread_mutex_unlock(&(w->mutex));
+    return ans;
+}
+
+/*
+ * take the oldest query held by any other worker
+ * returns 1 if successful, 0 if there is nothing to steal
+ */
+static int steal(Pool *p, Worker *self, RpcQuery *q) {
+    unsigned i;
+
+    for (i = 1; i < p->maxw; i++) {
+        Worker *w = &(p->workers[(self->id + i) % p->maxw]);
+        if (__atomic_load_n(&(w->count), __ATOMIC_RELAXED) > 0 && take(w, q))
+            return 1;
+    }
+    return 0;
+}
+
+static void push(Worker *w, RpcQuery *qs, unsigned n) {
+    unsigned i;
+
+    pthread_mutex_lock(&(w->mutex));
+    for (i = 0; i < n; i++)
+        w->dq[(w->head + w->count++) % DEQUE_SIZE] = qs[i];
+    pthread_mutex_unlock(&(w->mutex));
+}
+
+static void *work(void *args);
+
+/*
+ * start a new worker in a free slot
+ * must be called with the pool locked
+ */
+static void spawn(Pool *p) {
+    pthread_t th;
+    unsigned i;
+
+    for (i = 1; i < p->maxw; i++)
+        if (! p->workers[i].active)
+            break;
+    if (i == p->maxw)
+        return;
+    p->workers[i].active = 1;
+    p->workers[i].head = 0;
+    p->workers[i].count = 0;
+    if (pthread_create(&th, NULL, work, &(p->workers[i]))) {
+        p->workers[i].active = 0;
+        return;
+    }
+    pthread_detach(th);
+    p->nworkers++;
+}
+
+/*
+ * fold the wait of the oldest query in a batch into the smoothed wait,
+ * adding a worker if the target is exceeded
+ */
+static void account(Pool *p, unsigned long wait) {
+    unsigned long now = squeue_clock();
+
+    pthread_mutex_lock(&(p->mutex));
+    p->ewma = (7 * p->ewma + wait) / 8;
+    if (p->ewma > p->target && p->nworkers < p->maxw &&
+            now - p->lastAdjust >= ADJUST_INTERVAL) {
+        spawn(p);
+        p->lastAdjust = now;
+    }
+    pthread_mutex_unlock(&(p->mutex));
+}
+
+/*
+ * decide whether a worker with an empty deque should retire
+ * returns 1 if so, in which case the worker's slot has been released
+ */
+static int retire(Pool *p, Worker *w) {
+    unsigned long now;
+    int ans = 0;
+
+    if (w->id == 0)			/* the thread that called rpc_serve() */
+        return 0;
+    if (__atomic_load_n(&(p->nworkers), __ATOMIC_RELAXED) <= p->minw)
+        return 0;
+    now = squeue_clock();
+    pthread_mutex_lock(&(p->mutex));
+    if (p->nworkers > p->minw && p->ewma < p->target / 4 &&
+            now - p->lastAdjust >= ADJUST_INTERVAL) {
+        pthread_mutex_lock(&(w->mutex));
+        if (w->count == 0) {
+            w->active = 0;
+            p->nworkers--;
+            p->lastAdjust = now;
+            ans = 1;
+        }
+        pthread_mutex_unlock(&(w->mutex));
+    }
+    pthread_mutex_unlock(&(p->mutex));
+    return ans;
+}
+
+/*
+ * take a batch of queries from the service queue, keeping the first in `q'
+ * and pushing the rest onto the worker's deque, then wake the sleeping
+ * workers to steal from it; if another worker is already waiting on the
+ * service queue, sleep until it has a batch instead
+ * returns 1 if `q' holds a query, 0 if the caller should look again
+ */
+static int fetch(Pool *p, Worker *w, RpcQuery *q) {
+    RpcQuery qs[DEQUE_SIZE];
+    unsigned n;
+
+    pthread_mutex_lock(&(p->mutex));
+    if (p->receiving) {
+        pthread_cond_wait(&(p->ready), &(p->mutex));
+        pthread_mutex_unlock(&(p->mutex));
+        return 0;
+    }
+    p->receiving = 1;
+    pthread_mutex_unlock(&(p->mutex));
+    /* a fair share of what is waiting, so others have work too */
+    n = squeue_count(p->sr->s_queue) /
+        __atomic_load_n(&(p->nworkers), __ATOMIC_RELAXED) + 1;
+    if (n > DEQUE_SIZE)
+        n = DEQUE_SIZE;
+    n = rpc_query_batch(p->rps, qs, n);
+    account(p, qs[0].wait);
+    push(w, &qs[1], n - 1);
+    pthread_mutex_lock(&(p->mutex));
+    p->receiving = 0;
+    pthread_cond_broadcast(&(p->ready));
+    pthread_mutex_unlock(&(p->mutex));
+    *q = qs[0];
+    return 1;
+}
+
+static void *work(void *args) {
+    Worker *w = (Worker *)args;
+    Pool *p = w->pool;
+    char *resp;
+    RpcQuery q;
+    unsigned len;
+
+    /* pinned first, so that the response buffer is local to the CPU */
+    if (p->ncpus > 0)
+        (void) rpc_pin_thread(p->firstCpu + (int)(w->id % p->ncpus));
+    resp = (char *)malloc(RESP_SIZE);
+    if (resp == NULL) {
+        fprintf(stderr, "rpc_serve() - unable to allocate response buffer\n");
+        pthread_mutex_lock(&(p->mutex));
+        w->active = 0;
+        p->nworkers--;
+        pthread_mutex_unlock(&(p->mutex));
+        return NULL;
+    }
+    for (;;) {
+        if (! take(w, &q) && ! steal(p, w, &q)) {
+            if (retire(p, w))
+                break;
+            if (! fetch(p, w, &q))
+                continue;
+        }
+        len = p->handler(p->arg, &q.ep, q.data, q.len, resp, RESP_SIZE);
+        rpc_query_release(q.buf);
+        if (len > 0)
+            (void) rpc_response(p->rps, &q.ep, resp, len);
+    }
+    free(resp);
+    return NULL;
+}
+
+int rpc_serve(RpcService rps, RpcHandler handler, void *arg,
+              RpcServeOptions *opts) {
+    Pool *p;
+    unsigned i;
+
+    if (rps == NULL || handler == NULL)
+        return 0;
+    if ((p = (Pool *)malloc(sizeof(Pool))) == NULL)
+        return 0;
+    p->rps = rps;
+    p->sr = (SRecord *)rps;
+    p->handler = handler;
+    p->arg = arg;
+    p->minw = (opts != NULL && opts->minThreads > 0) ? opts->minThreads : 1;
+    p->maxw = (opts != NULL && opts->maxThreads > 0) ? opts->maxThreads :
+              p->minw;
+    p->target = (opts != NULL && opts->targetWait > 0) ? opts->targetWait :
+                TARGET_WAIT;
+    p->firstCpu = (opts != NULL) ? opts->firstCpu : 0;
+    p->ncpus = (opts != NULL) ? opts->ncpus : 0;
+    if (p->maxw > MAX_WORKERS)
+        p->maxw = MAX_WORKERS;
+    if (p->minw > p->maxw)
+        p->minw = p->maxw;
+    p->nworkers = 1;			/* the calling thread */
+    p->ewma = 0;
+    p->lastAdjust = squeue_clock();
+    p->receiving = 0;
+    pthread_mutex_init(&(p->mutex), NULL);
+    pthread_cond_init(&(p->ready), NULL);
+    for (i = 0; i < MAX_WORKERS; i++) {
+        p->workers[i].pool = p;
+        p->workers[i].id = i;
+        p->workers[i].active = 0;
+        p->workers[i].head = 0;
+        p->workers[i].count = 0;
+        pthread_mutex_init(&(p->workers[i].mutex), NULL);
+    }
+    p->workers[0].active = 1;
+    pthread_mutex_lock(&(p->mutex));
+    while (p->nworkers < p->minw) {
+        unsigned before = p->nworkers;
+        spawn(p);
+        if (p->nworkers == before)
+            break;
+    }
+    pthread_mutex_unlock(&(p->mutex));
+    (void) work(&(p->workers[0]));		/* never returns */
+    return 0;
+}
@@ -32,9 +32,12 @@
 /*
  * client for the Echo service
  *
- * usage: ./sinktest
+ * usage: ./sinktest [-e] [-b] [-m maxlen]
  *
- * generates ever longer buffers to sink
+ * generates ever longer buffers, up to maxlen bytes, to sink; with -e, the
+ * buffers are echoed, so that responses grow as well; with -b, responses
+ * are borrowed from the RPC system using rpc_call_borrow() rather than
+ * copied into `resp'
  */
 
 #include "srpc.h"
@@ -47,14 +50,19 @@
 #define HOST "localhost"
 #define PORT 20000
 #define SERVICE "Echo"
-#define USAGE "./sinktest [-h host] [-p port] [-s service]"
+#define USAGE "./sinktest [-h host] [-p port] [-s service] [-e] [-b] " \
+              "[-m maxlen]"
 
 char asc[] = "0123456789abcdefghijklmnopqrstuvwxyz";
 
 int main(int argc, char *argv[]) {
     RpcConnection rpc;
     Q_Decl(query,65536);
-    char resp[251];
+    static char resp[65536];
+    RpcBuffer rbuf;
+    void *rdata;
+    int echo = 0, borrow = 0;
+    int maxlen = 65530;
     int n;
     unsigned len;
     char *host;
@@ -72,6 +80,16 @@ int main(int argc, char *argv[]) {
     service = SERVICE;
     port = PORT;
     for (i = 1; i < argc; ) {
+        if (strcmp(argv[i], "-e") == 0) {
+            echo = 1;
+            i++;
+            continue;
+        }
+        if (strcmp(argv[i], "-b") == 0) {
+            borrow = 1;
+            i++;
+            continue;
+        }
         if ((j = i + 1) == argc) {
             fprintf(stderr, "usage: %s\n", USAGE);
             exit(1);
@@ -82,6 +100,8 @@ int main(int argc, char *argv[]) {
             port = atoi(argv[j]);
         else if (strcmp(argv[i], "-s") == 0)
             service = argv[j];
+        else if (strcmp(argv[i], "-m") == 0)
+            maxlen = atoi(argv[j]);
         else {
             fprintf(stderr, "Unknown flag: %s %s\n", argv[i], argv[j]);
         }
@@ -95,9 +115,9 @@ int main(int argc, char *argv[]) {
     }
     gettimeofday(&start, NULL);
     plen = 0;
-    while (++plen < 65530) {
+    while (++plen < maxlen) {
         int k;
-        sprintf(query, "SINK:");
+        sprintf(query, echo ? "ECHO:" : "SINK:");
         next = query + 5;
         for (k = 0; k < plen; k++)
             *next++ = asc[k % 36];
@@ -106,7 +126,16 @@ int main(int argc, char *argv[]) {
         n = strlen(query) + 1;
         if ((plen % 100) == 0)
             printf("%5d\n", plen);
-        if (! rpc_call(rpc, Q_Arg(query), n, resp, sizeof(resp), &len)) {
+        if (borrow) {
+            rbuf = rpc_call_borrow(rpc, Q_Arg(query), n, &rdata, &len);
+            if (rbuf == NULL) {
+                fprintf(stderr, "rpc_call_borrow() failed\n");
+                break;
+            }
+            resp[0] = *(char *)rdata;
+            rpc_call_release(rbuf);
+        } else if (! rpc_call(rpc, Q_Arg(query), n, resp, sizeof(resp),
+                              &len)) {
             fprintf(stderr, "rpc_call() failed\n");
             break;
         }
@@ -123,8 +152,9 @@ int main(int argc, char *argv[]) {
     msec = 1000 * (stop.tv_sec - start.tv_sec) +
            (stop.tv_usec - start.tv_usec) / 1000;
     mspercall = (double)msec / (double)count;
-    fprintf(stderr, "%ld lines Sink'd in %ld.%03ld seconds, %.3fms/call\n",
-            count, msec/1000, msec%1000, mspercall);
+    fprintf(stderr, "%ld lines %s in %ld.%03ld seconds, %.3fms/call\n",
+            count, echo ? "Echo'd" : "Sink'd", msec/1000, msec%1000,
+            mspercall);
     rpc_disconnect(rpc);
     return 0;
 }
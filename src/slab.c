@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * slab.c - implementation of fixed-size object slabs for simple RPC system
+ */
+
+#include "slab.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+typedef struct block {
+    struct block *next;
+} Block;
+
+typedef struct freeobj {
+    struct freeobj *next;
+} FreeObj;
+
+/*
+ * a thread cache holds at most CACHE_SIZE objects, and never more than one
+ * block's worth; objects move to and from the free list half a cache at a
+ * time
+ */
+#define CACHE_SIZE 64
+
+typedef struct slabhead {
+    size_t size;		/* object size, rounded for alignment */
+    unsigned nperblock;		/* objects carved from each block */
+    Block *blocks;		/* all blocks obtained from blkalloc() */
+    void *(*blkalloc)(size_t);	/* source of new blocks */
+    FreeObj *freel;		/* objects available for reuse */
+    unsigned long nblocks;
+    unsigned long inuse;
+    unsigned ccap;		/* capacity of each thread cache */
+    unsigned batch;		/* objects moved per refill or flush */
+    pthread_key_t key;		/* locates this thread's cache */
+    pthread_mutex_t mutex;
+} SlabHead;
+
+typedef struct tcache {
+    SlabHead *sh;
+    unsigned n;
+    void *objs[CACHE_SIZE];
+} TCache;
+
+#define ALIGNMENT __alignof__(max_align_t)	/* as malloc() */
+#define BLOCK_HDR (((sizeof(Block) - 1) / ALIGNMENT + 1) * ALIGNMENT)
+
+/*
+ * return the objects in a thread cache to the free list
+ * invoked as the key destructor when a thread exits
+ */
+static void tcache_flush(void *arg) {
+    TCache *tc = (TCache *)arg;
+    SlabHead *sh = tc->sh;
+
+    pthread_mutex_lock(&(sh->mutex));
+    while (tc->n > 0) {
+        FreeObj *f = (FreeObj *)tc->objs[--tc->n];
+        f->next = sh->freel;
+        sh->freel = f;
+        sh->inuse--;
+    }
+    pthread_mutex_unlock(&(sh->mutex));
+    free(tc);
+}
+
+Slab slab_create(size_t size, unsigned nperblock,
+                 void *(*blkalloc)(size_t)) {
+    SlabHead *sh = (SlabHead *)malloc(sizeof(SlabHead));
+    if (sh != NULL) {
+        if (size < sizeof(FreeObj))
+            size = sizeof(FreeObj);
+        sh->size = ((size - 1) / ALIGNMENT + 1) * ALIGNMENT;
+        sh->nperblock = (nperblock > 0) ? nperblock : 1;
+        sh->ccap = (sh->nperblock < CACHE_SIZE) ? sh->nperblock : CACHE_SIZE;
+        sh->batch = (sh->ccap > 1) ? sh->ccap / 2 : 1;
+        sh->blkalloc = (blkalloc != NULL) ? blkalloc : malloc;
+        sh->blocks = NULL;
+        sh->freel = NULL;
+        sh->nblocks = 0;
+        sh->inuse = 0;
+        if (pthread_key_create(&(sh->key), tcache_flush)) {
+            free(sh);
+            sh = NULL;
+        } else if (pthread_mutex_init(&(sh->mutex), NULL)) {
+            pthread_key_delete(sh->key);
+            free(sh);
+            sh = NULL;
+        }
+    }
+    return (Slab)sh;
+}
+
+/*
+ * obtain a new block and thread its objects onto the free list
+ * must be called with the slab locked
+ */
+static int grow(SlabHead *sh) {
+    Block *b = (Block *)sh->blkalloc(BLOCK_HDR + sh->size * sh->nperblock);
+    unsigned char *p;
+    unsigned i;
+
+    if (b == NULL)
+        return 0;
+    b->next = sh->blocks;
+    sh->blocks = b;
+    sh->nblocks++;
+    p = (unsigned char *)b + BLOCK_HDR;
+    for (i = 0; i < sh->nperblock; i++, p += sh->size) {
+        FreeObj *f = (FreeObj *)p;
+        f->next = sh->freel;
+        sh->freel = f;
+    }
+    return 1;
+}
+
+/*
+ * return the calling thread's cache for this slab, creating it if necessary
+ * returns NULL if the cache cannot be created
+ */
+static TCache *tcache(SlabHead *sh) {
+    TCache *tc = (TCache *)pthread_getspecific(sh->key);
+
+    if (tc == NULL) {
+        tc = (TCache *)malloc(sizeof(TCache));
+        if (tc != NULL) {
+            tc->sh = sh;
+            tc->n = 0;
+            if (pthread_setspecific(sh->key, tc)) {
+                free(tc);
+                tc = NULL;
+            }
+        }
+    }
+    return tc;
+}
+
+void *slab_alloc(Slab s) {
+    SlabHead *sh = (SlabHead *)s;
+    TCache *tc = tcache(sh);
+    FreeObj *f = NULL;
+
+    if (tc != NULL && tc->n > 0)
+        return tc->objs[--tc->n];
+    pthread_mutex_lock(&(sh->mutex));
+    if (tc == NULL) {			/* no cache, hand out a single object */
+        if (sh->freel != NULL || grow(sh)) {
+            f = sh->freel;
+            sh->freel = f->next;
+            sh->inuse++;
+        }
+    } else {				/* refill cache with a batch */
+        while (tc->n < sh->batch && (sh->freel != NULL || grow(sh))) {
+            f = sh->freel;
+            sh->freel = f->next;
+            sh->inuse++;
+            tc->objs[tc->n++] = f;
+        }
+        f = (tc->n > 0) ? (FreeObj *)tc->objs[--tc->n] : NULL;
+    }
+    pthread_mutex_unlock(&(sh->mutex));
+    return (void *)f;
+}
+
+void slab_free(Slab s, void *p) {
+    SlabHead *sh = (SlabHead *)s;
+    TCache *tc;
+    FreeObj *f;
+
+    if (p == NULL)
+        return;
+    tc = tcache(sh);
+    if (tc != NULL && tc->n < sh->ccap) {
+        tc->objs[tc->n++] = p;
+        return;
+    }
+    pthread_mutex_lock(&(sh->mutex));
+    if (tc != NULL) {			/* return a batch from full cache */
+        while (tc->n > sh->ccap - sh->batch) {
+            f = (FreeObj *)tc->objs[--tc->n];
+            f->next = sh->freel;
+            sh->freel = f;
+            sh->inuse--;
+        }
+        tc->objs[tc->n++] = p;
+    } else {
+        f = (FreeObj *)p;
+        f->next = sh->freel;
+        sh->freel = f;
+        sh->inuse--;
+    }
+    pthread_mutex_unlock(&(sh->mutex));
+}
+
+void slab_dump(Slab s, char *leadString) {
+    SlabHead *sh = (SlabHead *)s;
+
+    pthread_mutex_lock(&(sh->mutex));
+    fprintf(stderr, "%s: %zd-byte objects, %lu blocks of %u, %lu in use\n",
+            leadString, sh->size, sh->nblocks, sh->nperblock, sh->inuse);
+    pthread_mutex_unlock(&(sh->mutex));
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * slab.h - public data structures and entry points for fixed-size object
+ *          slabs used in RPC system
+ *
+ * objects are carved from large blocks obtained from malloc() or from a
+ * caller-supplied block allocator (e.g. the packet arena); freed objects
+ * are threaded onto a free list and reused, so there is no per-object malloc
+ * header and no per-object call to malloc() in the steady state
+ *
+ * each thread keeps a small cache of objects for each slab it uses; objects
+ * move between a thread cache and the shared free list in batches, so most
+ * calls to slab_alloc() and slab_free() do not take the slab mutex
+ */
+
+#ifndef _SLAB_H_
+#define _SLAB_H_
+
+#include <stddef.h>
+
+typedef void *Slab;
+
+/*
+ * constructor - objects are `size' bytes, `nperblock' objects are obtained
+ * from `blkalloc' each time the slab needs to grow; if `blkalloc' is NULL,
+ * malloc() is used
+ * blocks are never returned, so `blkalloc' need not have a matching free
+ * returns NULL if error
+ */
+Slab slab_create(size_t size, unsigned nperblock,
+                 void *(*blkalloc)(size_t));
+
+/*
+ * obtain an object from the slab
+ * returns NULL if error (malloc failure)
+ */
+void *slab_alloc(Slab s);
+
+/*
+ * return an object to the slab
+ */
+void slab_free(Slab s, void *p);
+
+/*
+ * dump statistics for the slab; objects held in thread caches are counted
+ * as in use
+ */
+void slab_dump(Slab s, char *leadString);
+
+#endif /* _SLAB_H_ */
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * spin.c - adaptive spin-then-park waiting in the RPC system
+ *
+ * the average is updated without a lock; waiters sharing a Spinner may
+ * lose each other's samples, which only slows the calibration
+ */
+
+#include "spin.h"
+#include "srpcdefs.h"
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SPIN_YIELD 64		/* polls between yields of the processor */
+
+#define load_rlx(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define store_rlx(p,v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+
+static unsigned spinDefault = 0;
+static pthread_once_t spinOnce = PTHREAD_ONCE_INIT;
+
+static void spin_once(void) {
+    if (sysconf(_SC_NPROCESSORS_ONLN) > 1)
+        spinDefault = SPIN_USECS;
+}
+
+unsigned spin_default(void) {
+    pthread_once(&spinOnce, spin_once);
+    return spinDefault;
+}
+
+/*
+ * `usecs' in nanoseconds, saturating as a Spinner does
+ */
+static unsigned nsecs(unsigned usecs) {
+    return (usecs > UINT_MAX / 1000) ? UINT_MAX : 1000 * usecs;
+}
+
+void spin_init(Spinner *s, unsigned usecs) {
+    s->limit = nsecs(usecs);
+    s->avg = 0;
+}
+
+void spin_setLimit(Spinner *s, unsigned usecs) {
+    store_rlx(&s->limit, nsecs(usecs));
+}
+
+unsigned long spin_budget(Spinner *s) {
+    unsigned long limit = load_rlx(&s->limit);
+    unsigned long avg = load_rlx(&s->avg);
+
+    if (limit == 0 || avg > limit)
+        return 0;
+    if (avg == 0 || 2 * avg > limit)	/* no history yet, or near limit */
+        return limit;
+    return 2 * avg;
+}
+
+void spin_record(Spinner *s, unsigned long waited) {
+    unsigned long avg = load_rlx(&s->avg);
+
+    if (waited > UINT_MAX)
+        waited = UINT_MAX;
+    store_rlx(&s->avg, (unsigned)(avg - avg / 8 + waited / 8));
+}
+
+unsigned long spin_clock(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return 1000000000 * (unsigned long)ts.tv_sec + ts.tv_nsec;
+}
+
+void spin_pause(unsigned long i) {
+    if (i % SPIN_YIELD == SPIN_YIELD - 1) {
+        sched_yield();
+        return;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
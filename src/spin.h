@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * spin.h - adaptive spin-then-park waiting in the RPC system
+ *
+ * a thread that expects to be woken soon polls for its condition for a
+ * while before sleeping, saving a futex sleep and wakeup on both sides; how
+ * long it polls is calibrated from a moving average of its recent waits,
+ * and bounded by a limit - waits that are usually longer than the limit go
+ * straight to sleep
+ */
+
+#ifndef _SPIN_H_
+#define _SPIN_H_
+
+/*
+ * both are kept in 32 bits, so that a connection record stays small; they
+ * saturate at about 4 seconds, far beyond any useful spin
+ */
+typedef struct spinner {
+    unsigned limit;		/* most nanoseconds to spin, 0 if never */
+    unsigned avg;		/* moving average of waits, in nanoseconds */
+} Spinner;
+
+/*
+ * initialize `s' to spin for at most `usecs' microseconds
+ */
+void spin_init(Spinner *s, unsigned usecs);
+
+/*
+ * change the limit of `s', keeping its history
+ */
+void spin_setLimit(Spinner *s, unsigned usecs);
+
+/*
+ * nanoseconds for which the next waiter should spin before sleeping
+ */
+unsigned long spin_budget(Spinner *s);
+
+/*
+ * fold a completed wait of `waited' nanoseconds into the average
+ */
+void spin_record(Spinner *s, unsigned long waited);
+
+/*
+ * current value of a fine-grained monotonic clock, in nanoseconds
+ */
+unsigned long spin_clock(void);
+
+/*
+ * pause between the `i'th and next polls of a spinning waiter
+ */
+void spin_pause(unsigned long i);
+
+/*
+ * the default limit, in microseconds: SPIN_USECS, or 0 on a uniprocessor,
+ * where spinning only delays the thread that would end the wait
+ */
+unsigned spin_default(void);
+
+#endif /* _SPIN_H_ */
@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * squeue.c - implementation of bounded service queues for simple RPC system
+ *
+ * the ring follows Vyukov's bounded MPMC queue: each cell carries a
+ * sequence number that tells producers and consumers whether the cell is
+ * free for the current lap or holds an element; producers and consumers
+ * claim cells by advancing `tail' and `head' with compare-and-swap
+ *
+ * a consumer claims a run of ready cells with a single compare-and-swap,
+ * so a batched get costs no more synchronization than a single get
+ */
+
+#include "squeue.h"
+#include "spin.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#define CACHE_LINE 64
+
+typedef struct cell {
+    unsigned long seq;
+    void *a;
+    void *b;
+    unsigned long stamp;
+} Cell;
+
+typedef struct squeuehead {
+    Cell *cells;
+    unsigned long mask;
+    char pad0[CACHE_LINE];
+    unsigned long tail;		/* next cell to fill */
+    char pad1[CACHE_LINE];
+    unsigned long head;		/* next cell to empty */
+    char pad2[CACHE_LINE];
+    unsigned long sleepers;	/* consumers waiting on nonempty */
+    Spinner spin;		/* how long consumers poll before sleeping */
+    pthread_mutex_t mutex;
+    pthread_cond_t nonempty;
+} SQueueHead;
+
+#ifdef CLOCK_MONOTONIC_COARSE
+#define SQ_CLOCK CLOCK_MONOTONIC_COARSE		/* no syscall, tick resolution */
+#else
+#define SQ_CLOCK CLOCK_MONOTONIC
+#endif /* CLOCK_MONOTONIC_COARSE */
+
+#define load_acq(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define load_rlx(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define store_rel(p,v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define cas(p,e,v) __atomic_compare_exchange_n((p), (e), (v), 1, \
+                                                __ATOMIC_RELAXED, \
+                                                __ATOMIC_RELAXED)
+
+SQueue squeue_create(unsigned capacity) {
+    SQueueHead *sq = (SQueueHead *)malloc(sizeof(SQueueHead));
+    unsigned long n, i;
+
+    if (sq == NULL)
+        return NULL;
+    for (n = 2; n < capacity; n <<= 1)
+        ;
+    sq->cells = (Cell *)malloc(n * sizeof(Cell));
+    if (sq->cells == NULL) {
+        free(sq);
+        return NULL;
+    }
+    for (i = 0; i < n; i++)
+        sq->cells[i].seq = i;
+    sq->mask = n - 1;
+    sq->tail = 0;
+    sq->head = 0;
+    sq->sleepers = 0;
+    spin_init(&(sq->spin), spin_default());
+    if (pthread_mutex_init(&(sq->mutex), NULL) ||
+            pthread_cond_init(&(sq->nonempty), NULL)) {
+        free(sq->cells);
+        free(sq);
+        return NULL;
+    }
+    return (SQueue)sq;
+}
+
+unsigned long squeue_clock(void) {
+    struct timespec ts;
+
+    clock_gettime(SQ_CLOCK, &ts);
+    return 1000000 * (unsigned long)ts.tv_sec + ts.tv_nsec / 1000;
+}
+
+int squeue_put(SQueue q, void *a, void *b) {
+    SQueueHead *sq = (SQueueHead *)q;
+    unsigned long pos = load_rlx(&sq->tail);
+    unsigned long stamp = squeue_clock();
+    Cell *c;
+
+    for (;;) {
+        long dif;
+        c = &sq->cells[pos & sq->mask];
+        dif = (long)(load_acq(&c->seq) - pos);
+        if (dif == 0) {
+            if (cas(&sq->tail, &pos, pos + 1))
+                break;
+        } else if (dif < 0)
+            return 0;			/* full */
+        else
+            pos = load_rlx(&sq->tail);
+    }
+    c->a = a;
+    c->b = b;
+    c->stamp = stamp;
+    store_rel(&c->seq, pos + 1);
+    /*
+     * the fence orders the publication above before the check of
+     * `sleepers'; a consumer increments `sleepers' before its final check
+     * of the ring, so either it sees the element or we see the consumer
+     */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (load_rlx(&sq->sleepers) > 0) {
+        pthread_mutex_lock(&(sq->mutex));
+        pthread_cond_signal(&(sq->nonempty));
+        pthread_mutex_unlock(&(sq->mutex));
+    }
+    return 1;
+}
+
+/*
+ * claim up to `max' ready cells starting at the head of the ring
+ * returns the number claimed
+ */
+static unsigned take(SQueueHead *sq, void **a, void **b,
+                     unsigned long *stamps, unsigned max) {
+    unsigned long pos = load_rlx(&sq->head);
+    unsigned n, i;
+
+    for (;;) {
+        long dif;
+        Cell *c = &sq->cells[pos & sq->mask];
+        dif = (long)(load_acq(&c->seq) - (pos + 1));
+        if (dif < 0)
+            return 0;			/* empty */
+        if (dif > 0) {
+            pos = load_rlx(&sq->head);
+            continue;
+        }
+        for (n = 1; n < max; n++) {
+            c = &sq->cells[(pos + n) & sq->mask];
+            if (load_acq(&c->seq) != pos + n + 1)
+                break;
+        }
+        if (cas(&sq->head, &pos, pos + n))
+            break;
+    }
+    for (i = 0; i < n; i++) {
+        Cell *c = &sq->cells[(pos + i) & sq->mask];
+        a[i] = c->a;
+        b[i] = c->b;
+        if (stamps != NULL)
+            stamps[i] = c->stamp;
+        store_rel(&c->seq, pos + i + sq->mask + 1);
+    }
+    return n;
+}
+
+unsigned squeue_get_batch(SQueue q, void **a, void **b,
+                          unsigned long *stamps, unsigned max) {
+    SQueueHead *sq = (SQueueHead *)q;
+    unsigned long start, budget, i;
+    unsigned n;
+
+    if (max == 0)
+        return 0;
+    if ((n = take(sq, a, b, stamps, max)) > 0)
+        return n;
+    start = spin_clock();
+    budget = spin_budget(&(sq->spin));
+    for (i = 0; spin_clock() - start < budget; i++) {
+        spin_pause(i);
+        if ((n = take(sq, a, b, stamps, max)) > 0) {
+            spin_record(&(sq->spin), spin_clock() - start);
+            return n;
+        }
+    }
+    pthread_mutex_lock(&(sq->mutex));
+    for (;;) {
+        __atomic_fetch_add(&sq->sleepers, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        n = take(sq, a, b, stamps, max);
+        if (n == 0)
+            pthread_cond_wait(&(sq->nonempty), &(sq->mutex));
+        __atomic_fetch_sub(&sq->sleepers, 1, __ATOMIC_SEQ_CST);
+        if (n > 0 || (n = take(sq, a, b, stamps, max)) > 0)
+            break;
+    }
+    pthread_mutex_unlock(&(sq->mutex));
+    spin_record(&(sq->spin), spin_clock() - start);
+    return n;
+}
+
+void squeue_get(SQueue sq, void **a, void **b) {
+    (void) squeue_get_batch(sq, a, b, NULL, 1);
+}
+
+int squeue_get_nb(SQueue sq, void **a, void **b) {
+    return (int)take((SQueueHead *)sq, a, b, NULL, 1);
+}
+
+void squeue_spin(SQueue q, unsigned usecs) {
+    spin_setLimit(&(((SQueueHead *)q)->spin), usecs);
+}
+
+unsigned squeue_count(SQueue q) {
+    SQueueHead *sq = (SQueueHead *)q;
+
+    return (unsigned)(load_rlx(&sq->tail) - load_rlx(&sq->head));
+}
+
+void squeue_destroy(SQueue q) {
+    SQueueHead *sq = (SQueueHead *)q;
+
+    pthread_mutex_destroy(&(sq->mutex));
+    pthread_cond_destroy(&(sq->nonempty));
+    free(sq->cells);
+    free(sq);
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * squeue.h - public data structures and entry points for the bounded
+ *            service queues used in RPC system
+ *
+ * a service queue is a fixed-size multi-producer/multi-consumer ring; each
+ * element consists of two parts: the endpoint of the sender and the buffer
+ * holding the query; each element is also stamped with the time at which it
+ * was queued, taken from a coarse monotonic clock (see squeue_clock())
+ *
+ * puts and gets do not take a lock; a consumer that finds the queue empty
+ * polls it for a time calibrated from its recent waits (see spin.h), then
+ * sleeps on a condition variable, and producers signal only when a consumer
+ * is known to be asleep, so that wakeups are not issued per element
+ */
+
+#ifndef _SQUEUE_H_
+#define _SQUEUE_H_
+
+typedef void *SQueue;
+
+/*
+ * constructor - the capacity is rounded up to a power of two
+ * returns NULL if error
+ */
+SQueue squeue_create(unsigned capacity);
+
+/*
+ * append element to the queue
+ * returns 0 if the queue is full, otherwise 1
+ */
+int squeue_put(SQueue sq, void *a, void *b);
+
+/*
+ * remove first element of the queue; thread blocks until successful
+ */
+void squeue_get(SQueue sq, void **a, void **b);
+
+/*
+ * remove up to `max' elements from the queue into `a[]' and `b[]'; thread
+ * blocks until at least one element is available
+ * if `stamps' is not NULL, the time at which each element was queued is
+ * returned in `stamps[]'
+ * returns the number of elements removed
+ */
+unsigned squeue_get_batch(SQueue sq, void **a, void **b,
+                          unsigned long *stamps, unsigned max);
+
+/*
+ * remove first element of the queue if there, do not block, return 1/0
+ */
+int squeue_get_nb(SQueue sq, void **a, void **b);
+
+/*
+ * limit the time for which consumers poll an empty queue before sleeping
+ * to `usecs' microseconds; 0 makes them sleep at once
+ */
+void squeue_spin(SQueue sq, unsigned usecs);
+
+/*
+ * number of elements currently in the queue (approximate if the queue is
+ * being modified concurrently)
+ */
+unsigned squeue_count(SQueue sq);
+
+/*
+ * current value of the clock used to stamp elements, in microseconds; the
+ * clock is monotonic, but only as fine-grained as the kernel tick
+ */
+unsigned long squeue_clock(void);
+
+/*
+ * destroy the queue; any elements remaining in it are discarded
+ */
+void squeue_destroy(SQueue sq);
+
+#endif /* _SQUEUE_H_ */
@@ -34,12 +34,25 @@
  * originally created to support the Homework event cache
  */
 
+#ifdef HAVE_CPU_AFFINITY
+#define _GNU_SOURCE			/* for pthread_attr_setaffinity_np() */
+#endif /* HAVE_CPU_AFFINITY */
 #include "srpc.h"
 #include "srpcdefs.h"
-#include "tslist.h"
+#include "payload.h"
+#include "srpcmalloc.h"
+#include "arena.h"
+#include "affinity.h"
+#include "async.h"
+#include "outbox.h"
+#include "transport.h"
+#include "resolve.h"
+#include "squeue.h"
 #include "endpoint.h"
 #include "ctable.h"
 #include "crecord.h"
+#include "peer.h"
+#include "fec.h"
 #include "stable.h"
 #include <ifaddrs.h>
 #include <stdlib.h>
@@ -53,86 +66,103 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <time.h>
+#include <errno.h>
 #include <unistd.h>
-
-#define CONNECT 1
-#define CACK 2
-#define QUERY 3
-#define QACK 4
-#define RESPONSE 5
-#define RACK 6
-#define DISCONNECT 7
-#define DACK 8
-#define FRAGMENT 9
-#define FACK 10
-#define PING 11
-#define PACK 12
-#define SEQNO 13
-#define SACK 14
-#define CMD_LOW CONNECT
-#define CMD_HIGH SACK		/* change this if commands added */
+#ifdef HAVE_CPU_AFFINITY
+#include <sched.h>
+#endif /* HAVE_CPU_AFFINITY */
 
 #define UNUSED __attribute__ ((unused))
 
+/*
+ * the largest parity group, whose fragments and parity packet must fit an
+ * outbox as first allocated, so that none is paced with the table locked
+ */
+#define MAX_GROUP ((OUTBOX_SLOTS - 1 < 255) ? OUTBOX_SLOTS - 1 : 255)
+
 static const char *cmdnames[] = {"", "CONNECT", "CACK", "QUERY", "QACK",
                                  "RESPONSE", "RACK", "DISCONNECT", "DACK",
                                  "FRAGMENT", "FACK", "PING", "PACK", "SEQNO",
-                                 "SACK"
+                                 "SACK", "PARITY"
                                 };
 
-typedef struct ph {
-    uint32_t subport;	/* 3rd piece of identifier triple */
-    uint32_t seqno;	/* sequence number */
-    uint16_t command;	/* message type */
-    uint8_t fnum;	/* number of this fragment */
-    uint8_t nfrags;	/* number of fragments */
-} PayloadHeader;
-
-typedef struct dh {
-    uint16_t tlen;	/* total length of the data */
-    uint16_t flen;	/* length of this fragment */
-} DataHeader;
-
-typedef struct cp {		/* control payload */
-    PayloadHeader hdr;
-} ControlPayload;
-
-typedef struct conp {
-    PayloadHeader hdr;
-    char sname[1];		/* EOS-terminated service name */
-} ConnectPayload;
-
-typedef struct dp {		/* template for data payload */
-    PayloadHeader hdr;
-    DataHeader dhdr;
-    unsigned char data[1];	/* data is address of `len' bytes */
-} DataPayload;
-
-#define CP_SIZE sizeof(ControlPayload)
-
-static struct sockaddr_in my_addr;	/* our address information */
-static int my_sock;
 static char my_address[16];
-static unsigned short my_port;
 static const struct timespec one_tick = {0, 20000000}; /* one tick is 20 ms */
-static pthread_t readThread = NULL;
-static pthread_t timerThread = NULL;
 
-#define MAX_CONN_ID 0x7fffffff
-#define MIN_CONN_ID 0x10000000
+/*
+ * an RPC context is a transport (see transport.h) with its own connection
+ * and service tables and its own reader and timer threads; contexts[0] is
+ * the default context, created by rpc_init() and used by those calls that
+ * do not name a context
+ */
+typedef struct context {
+    unsigned index;		/* in contexts[] */
+    int cpu;			/* to which its threads are pinned, or -1 */
+    Transport *tp;		/* through which its packets pass */
+    unsigned short port;
+    pthread_t readThread;
+    pthread_t timerThread;
+    CTable *ct;
+    STable *st;
+    /* the following are guarded by the table lock */
+    AsyncCall *done;		/* completed asynchronous calls (see below) */
+    unsigned long serial;	/* of last connection identifier issued */
+    unsigned long received;	/* packets read by the reader */
+    unsigned long predicted;	/* of those, taken the fast path */
+    unsigned long retried;	/* packets retransmitted by the timer */
+    unsigned long repaired;	/* fragments rebuilt from parity */
+    unsigned long pinged;	/* keepalives sent by the timer */
+    unsigned npaths;		/* interfaces striped across, see path.h */
+    unsigned ifindex[MAX_PATHS];	/* ... and their indexes */
+    /* the following are read by the reader without the table lock */
+    unsigned busy;		/* SO_BUSY_POLL usecs, 0 if reader blocks */
+    unsigned backoff;		/* usecs idle before a busy reader blocks */
+} Context;
+
+#ifdef DROP_1_IN_20
+#define LOSS_PERCENT 5
+#else
+#define LOSS_PERCENT 0
+#endif /* DROP_1_IN_20 */
 
-static unsigned long gen_conn_id(void) {
-    static unsigned long id = MIN_CONN_ID;
-    unsigned long ans = ++id;
-    if (id == MAX_CONN_ID)
-        id = MIN_CONN_ID;
-    return ans;
+static unsigned lossPercent = LOSS_PERCENT;	/* see rpc_loss_config() */
+static __thread unsigned lossSeed = 0;
+static __thread SRecord *dispatching = NULL;	/* see dispatched() */
+static int rcvBuf = SOCKET_RCVBUF;	/* sizes for new sockets, 0 if default */
+static int sndBuf = SOCKET_SNDBUF;
+static Context *contexts[MAX_CONTEXTS];
+static unsigned ncontexts = 0;
+static pthread_mutex_t ctxMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * a connection identifier carries the index of its context, plus one, above
+ * CTX_SHIFT bits of serial number, so that the calls that take a connection
+ * can find its context
+ */
+#define CTX_SHIFT 24
+#define SERIAL_MAX ((1UL << CTX_SHIFT) - 1)
+
+static unsigned long gen_conn_id(Context *cx) {
+    if (++cx->serial > SERIAL_MAX)
+        cx->serial = 1;
+    return ((unsigned long)(cx->index + 1) << CTX_SHIFT) | cx->serial;
+}
+
+/*
+ * returns the context of connection `rpc', or NULL if there is none
+ */
+static Context *conn_context(RpcConnection rpc) {
+    unsigned long i = (unsigned long)rpc >> CTX_SHIFT;
+
+    if (i == 0 || i > __atomic_load_n(&ncontexts, __ATOMIC_ACQUIRE))
+        return NULL;
+    return contexts[i - 1];
 }
 
 #ifdef LOG
 static void dumpsockNpacket(struct sockaddr_in *s, DataPayload *p, char *lstr) {
     unsigned long subport = ntohl(p->hdr.subport);
-    unsigned short command = ntohs(p->hdr.command);
+    unsigned short command = p->hdr.command;
     unsigned long seqno = ntohl(p->hdr.seqno);
     unsigned char fnum = p->hdr.fnum;
     unsigned char nfrags = p->hdr.nfrags;
@@ -158,343 +188,972 @@ static void dumpsockNpacket(struct sockaddr_in *s, DataPayload *p, char *lstr) {
  * all others are in host order
  */
 #define cp_complete(cp,sp,cmd,sn,fn,nfs) {(cp)->hdr.subport=(sp); \
-                                          (cp)->hdr.command=htons(cmd); \
+                                          (cp)->hdr.group=0; \
+                                          (cp)->hdr.command=(cmd); \
                                           (cp)->hdr.seqno=htonl(sn); \
                                           (cp)->hdr.fnum=(fn); \
                                           (cp)->hdr.nfrags=(nfs); }
 
 /*
- * write message to UDP port
+ * returns 1 if the packet about to be sent should be discarded to simulate
+ * loss, as configured by rpc_loss_config()
+ */
+static int inject_loss(void) {
+    unsigned pc = __atomic_load_n(&lossPercent, __ATOMIC_RELAXED);
+
+    if (pc == 0)
+        return 0;
+    if (lossSeed == 0)
+        lossSeed = (unsigned)spin_clock() | 1;
+    return (unsigned)(rand_r(&lossSeed) % 100) < pc;
+}
+
+/*
+ * write message to UDP port, paced so that it is not transmitted before
+ * `at' (see outbox.h) if that is non-zero, and out of interface `via' if
+ * that is non-zero
  * returns 1 if successful, or 0 if not
  */
-static int send_payload(RpcEndpoint *ep, void *p, int size) {
+static int send_at(Context *cx, RpcEndpoint *ep, void *p, int size,
+                   unsigned long at, unsigned via) {
     struct sockaddr_in d_addr;
-    int n, len;
-    char *b = (char *)p;
+    int len;
 
-#ifdef DROP_1_IN_20
-    if ((random() % 20) == 0)
+    if (inject_loss())
         return 1;
-#endif /* DROP_1_IN_20 */
     len = sizeof(d_addr);
     memcpy(&d_addr, &(ep->addr), len);
 #ifdef LOG
     dumpsockNpacket(&d_addr, p, "send");
 #endif /* LOG */
-    n = sendto(my_sock, b, size, 0, (struct sockaddr *)&d_addr, len);
-    if (n == -1)
+    /* deferred until the table is unlocked, if it is held */
+    return outbox_send(cx->tp, &d_addr, p, size, ctable_held(), at, via);
+}
+
+static int send_payload(Context *cx, RpcEndpoint *ep, void *p, int size) {
+    return send_at(cx, ep, p, size, 0, 0);
+}
+
+/*
+ * copy a response fragment directly into the buffer posted by the caller
+ * returns 1 if copied, 0 if no buffer was posted or the response does not
+ * fit, in which case the response is assembled in a library buffer
+ */
+static int posted_copy(CRecord *cr, DataPayload *dp, unsigned char fnum) {
+    unsigned tlen = ntohs(dp->dhdr.tlen);
+    unsigned flen = ntohs(dp->dhdr.flen);
+    unsigned off = FR_SIZE * (fnum - 1);
+
+    if (cr->act->ubuf == NULL || tlen > cr->act->ulen || off + flen > tlen)
         return 0;
-    else
+    memcpy(cr->act->ubuf + off, dp->data, flen);
+    cr->act->ulen = tlen;
+    return 1;
+}
+
+/*
+ * run the service's inline handler on a newly accepted query, sending its
+ * response immediately; must be called with the table locked
+ * returns 1 if the handler responded, 0 if the query should be queued
+ */
+static int respond_inline(Context *cx, CRecord *cr, DataPayload *q,
+                          unsigned long seqno) {
+    SRecord *sr = cr->svc;
+    DataPayload *rp;
+    unsigned len;
+    int size;
+
+    if ((rp = (DataPayload *)srpc_malloc(PKT_SIZE)) == NULL)
+        return 0;
+    if (! sr->s_inline(sr->s_inlineArg, &cr->ep, q->data,
+                       ntohs(q->dhdr.tlen), rp->data, FR_SIZE, &len)) {
+        srpc_free(rp);
+        return 0;
+    }
+    if (len > FR_SIZE) {		/* overran `resp'; let the workers answer */
+        warningf("inline handler returned %u bytes, more than %d\n",
+                 len, FR_SIZE);
+        srpc_free(rp);
+        return 0;
+    }
+    size = sizeof(PayloadHeader) + sizeof(DataHeader) + len;
+    cp_complete((ControlPayload *)rp, cr->ep.subport, RESPONSE, seqno, 1, 1);
+    rp->dhdr.tlen = htons(len);
+    rp->dhdr.flen = htons(len);
+    crecord_setPayload(cr, rp, size, ATTEMPTS, TICKS);
+    (void)send_payload(cx, &cr->ep, rp, size);
+    crecord_setState(cr, ST_RESPONSE_SENT);
+    return 1;
+}
+
+/*
+ * fill `buf' with packet `fnum' of `nfrags' carrying `len' bytes of data from
+ * `data': a FRAGMENT, or, for the final packet, a `last' (QUERY or RESPONSE)
+ * returns the size of the packet
+ */
+static int data_packet(DataPayload *buf, unsigned long subport,
+                       unsigned short last, unsigned long seqno,
+                       unsigned char *data, unsigned len,
+                       unsigned char fnum, unsigned char nfrags) {
+    unsigned blen = (fnum < nfrags) ? FR_SIZE : len - FR_SIZE * (nfrags - 1);
+
+    cp_complete((ControlPayload *)buf, subport,
+                (fnum < nfrags) ? FRAGMENT : last, seqno, fnum, nfrags);
+    buf->dhdr.tlen = htons(len);
+    buf->dhdr.flen = htons(blen);
+    memcpy(buf->data, &(data[FR_SIZE * (fnum - 1)]), blen);
+    return sizeof(PayloadHeader) + sizeof(DataHeader) + blen;
+}
+
+/*
+ * returns 1 if the caller is the reader or timer thread, which must not
+ * wait for acknowledgements that only the reader can process
+ */
+static int on_system_thread(Context *cx) {
+    pthread_t self = pthread_self();
+
+    return pthread_equal(self, cx->readThread) ||
+           pthread_equal(self, cx->timerThread);
+}
+
+/*
+ * send a data packet of a message on `cr', paced according to the
+ * congestion state of its host unless sent by the reader or timer, and
+ * out of interface `via' if that is non-zero
+ */
+static int send_data(Context *cx, CRecord *cr, void *p, int size,
+                     unsigned via) {
+    unsigned long at = 0;
+
+    if (cr->peer != NULL && ! on_system_thread(cx))
+        cr->act->sentAt = at = peer_pace(cr->peer);
+    return send_at(cx, &cr->ep, p, size, at, via);
+}
+
+/*
+ * returns the paths to the host of `cr' if `cx' stripes fragments across
+ * several interfaces (see path.h), NULL otherwise
+ */
+static Paths *striped(Context *cx, CRecord *cr) {
+    return (cx->npaths > 1 && cr->peer != NULL) ? &cr->peer->paths : NULL;
+}
+
+/*
+ * returns the interface by which to send the group last sent on `cr', or
+ * 0 if it is not striped
+ */
+static unsigned stripe_via(Context *cx, CRecord *cr) {
+    Paths *ps = striped(cx, cr);
+
+    return (ps == NULL) ? 0 : cx->ifindex[cr->act->path];
+}
+
+/*
+ * account the acknowledgement of the fragments of the group last sent on
+ * `cr' as far as `fnum' to the path that carried it: if the group is not
+ * complete, some of it was lost, and otherwise the round trip is that of
+ * the group's last packet
+ */
+static void stripe_acked(Context *cx, CRecord *cr, unsigned char fnum) {
+    Paths *ps = striped(cx, cr);
+    unsigned long now = spin_clock();
+
+    if (ps == NULL)
+        return;
+    if (fnum < cr->act->lastFrag)
+        paths_lost(ps, cr->act->path);
+    else if (cr->act->nattempts == ATTEMPTS && now > cr->act->sentAt)
+        paths_acked(ps, cr->act->path, now - cr->act->sentAt);
+}
+
+/*
+ * account the retransmission by the timer of the group last sent on `cr'
+ * as a loss on the path that carried it
+ */
+static void stripe_lost(Context *cx, CRecord *cr) {
+    Paths *ps = striped(cx, cr);
+
+    if (ps != NULL)
+        paths_lost(ps, cr->act->path);
+}
+
+/*
+ * fill `buf' with the PARITY packet of fragments `first' through `last' of
+ * the `len'-byte message `data' of `nfrags' packets
+ * returns the size of the packet
+ */
+static int parity_packet(DataPayload *buf, unsigned long subport,
+                         unsigned long seqno, unsigned char *data,
+                         unsigned len, unsigned char first,
+                         unsigned char last, unsigned char nfrags) {
+    cp_complete((ControlPayload *)buf, subport, PARITY, seqno, first, nfrags);
+    buf->hdr.group = last;
+    buf->dhdr.tlen = htons(len);
+    buf->dhdr.flen = htons(FR_SIZE);
+    fec_parity(buf->data, data, first, last);
+    return DP_HDR_SIZE + FR_SIZE;
+}
+
+/*
+ * send the fragments of a message on `cr' from fragment `first', building
+ * each packet in `buf' as data_packet() does: with no parity groups, just
+ * fragment `first'; otherwise a group of up to cr->group fragments and its
+ * PARITY packet, which is then kept for the timer to retransmit - the
+ * receiver acknowledges the last fragment it then holds in order; if `cx'
+ * stripes, the group leaves by the next path in its host's schedule
+ * must be called with the table locked
+ */
+static void send_group(Context *cx, CRecord *cr, DataPayload *buf,
+                       unsigned short last, unsigned char *data,
+                       unsigned len, unsigned char first,
+                       unsigned char nfrags) {
+    unsigned char end = first;
+    unsigned char fnum;
+    Paths *ps = striped(cx, cr);
+    unsigned via;
+    int size = 0;
+
+    if (cr->group > 0)
+        end = (nfrags - first > cr->group) ? first + cr->group - 1
+                                           : nfrags - 1;
+    if (ps != NULL)
+        cr->act->path = paths_next(ps);
+    via = stripe_via(cx, cr);
+    for (fnum = first; fnum <= end; fnum++) {
+        size = data_packet(buf, cr->ep.subport, last, cr->seqno, data, len,
+                           fnum, nfrags);
+        if (cr->group > 0)
+            buf->hdr.group = end;
+        (void)send_data(cx, cr, buf, size, via);
+    }
+    if (cr->group > 0) {
+        size = parity_packet(buf, cr->ep.subport, cr->seqno, data, len,
+                             first, end, nfrags);
+        (void)send_data(cx, cr, buf, size, via);
+    }
+    cr->act->firstFrag = first;
+    cr->act->lastFrag = end;
+    crecord_setPayload(cr, buf, size, ATTEMPTS, TICKS);
+    crecord_setState(cr, ST_FRAGMENT_SENT);
+}
+
+/*
+ * send packet `fnum' of an asynchronous call or response, or the parity
+ * group that it starts (see send_group()); the transmit buffer is the
+ * record's payload from the first packet on
+ * a response is complete once its last packet is sent
+ * must be called with the table locked
+ */
+static void async_send(Context *cx, CRecord *cr, DataPayload *buf,
+                       unsigned char fnum) {
+    AsyncCall *ac = (AsyncCall *)cr->act->async;
+    int size;
+
+    ac->fnum = fnum;
+    if (fnum < ac->nfrags) {
+        send_group(cx, cr, buf, ac->last, ac->query, ac->qlen, fnum,
+                   ac->nfrags);
+        return;
+    }
+    size = data_packet(buf, cr->ep.subport, ac->last, cr->seqno, ac->query,
+                       ac->qlen, fnum, ac->nfrags);
+    if (ac->last == QUERY)
+        buf->hdr.group = cr->group;
+    cr->act->lastFrag = fnum;
+    crecord_setPayload(cr, buf, size, ATTEMPTS, TICKS);
+    (void)send_payload(cx, &cr->ep, buf, size);
+    if (ac->last == QUERY)
+        crecord_setState(cr, ST_QUERY_SENT);
+    else {
+        crecord_setState(cr, ST_RESPONSE_SENT);
+        cr->act->async = NULL;
+        srpc_free(ac->query);
+        srpc_free(ac);
+    }
+}
+
+/*
+ * start an asynchronous call from ST_IDLE
+ * returns 1 if started, 0 if no transmit buffer could be obtained
+ * must be called with the table locked
+ */
+static int async_begin(Context *cx, CRecord *cr) {
+    DataPayload *buf = (DataPayload *)srpc_malloc(PKT_SIZE);
+
+    if (buf == NULL)
+        return 0;
+    cr->seqno++;
+    async_send(cx, cr, buf, 1);
+    return 1;
+}
+
+/*
+ * detach a completed (or failed) asynchronous call from its record, and
+ * add it to the context's list of calls to be delivered once the table has
+ * been unlocked
+ * must be called with the table locked
+ */
+static void async_finish(Context *cx, CRecord *cr, int ok) {
+    AsyncCall *ac = (AsyncCall *)cr->act->async;
+
+    cr->act->async = NULL;
+    if (ok && cr->act->resp != NULL) {	/* did not fit in the posted buffer */
+        srpc_free(cr->act->resp);
+        cr->act->resp = NULL;
+        ok = 0;
+    }
+    ac->ev.status = ok;
+    ac->ev.rlen = ok ? cr->act->ulen : 0;
+    cr->act->ubuf = NULL;
+    crecord_release(cr);
+    srpc_free(ac->query);
+    ac->query = NULL;
+    ac->next = cx->done;
+    cx->done = ac;
+}
+
+/*
+ * wait, before an application thread starts a message on `cr', for room
+ * in the congestion window of its host (see peer.h); the record may be
+ * purged while the table is unlocked, so it is then looked up again
+ * must be called with the table locked
+ * returns the record, or NULL if it has gone
+ */
+static CRecord *await_window(Context *cx, CRecord *cr) {
+    unsigned long id = cr->cid;
+
+    if (cr->peer == NULL || peer_room(cr->peer))
+        return cr;
+    peer_await(ctable_peers(cx->ct), cr->peer, cx->ct);
+    return ctable_look_id(cx->ct, id);
+}
+
+/*
+ * send a fragmented response without waiting; each FACK sends the next
+ * packet from a copy of the response, using `buf' as the transmit buffer
+ * returns 1 if the first fragment was sent, 0 otherwise
+ * must be called with the table locked
+ */
+static int respond_async(Context *cx, CRecord *cr, DataPayload *buf,
+                         unsigned char *rb, unsigned len,
+                         unsigned char nfrags) {
+    AsyncCall *ac;
+
+    if (cr->act->async != NULL ||
+            (ac = (AsyncCall *)srpc_malloc(sizeof(AsyncCall))) == NULL) {
+        srpc_free(buf);
+        return 0;
+    }
+    if ((ac->query = (unsigned char *)srpc_malloc(len)) == NULL) {
+        srpc_free(ac);
+        srpc_free(buf);
+        return 0;
+    }
+    memcpy(ac->query, rb, len);
+    ac->cb = NULL;
+    ac->cq = NULL;
+    ac->qlen = len;
+    ac->last = RESPONSE;
+    ac->nfrags = nfrags;
+    cr->act->async = ac;
+    async_send(cx, cr, buf, 1);
+    return 1;
+}
+
+/*
+ * hand the query `dq' to `dispatch', as the service `sr' was set up to do
+ * when the query was accepted, with the table unlocked; the call is
+ * counted, so that rpc_serve_async() can wait for it to return
+ */
+static void dispatched(SRecord *sr, RpcDispatch dispatch, void *darg,
+                       RpcQuery *dq) {
+    SRecord *outer = dispatching;
+
+    dispatching = sr;
+    dispatch(darg, dq);
+    dispatching = outer;
+    __atomic_sub_fetch(&sr->s_dispatching, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * the reader's handling of a new, complete query `p' on `cr', whose
+ * sequence number has just been advanced from `oseqno': the service's
+ * inline handler answers it at once, or it is acknowledged and either left
+ * in `dq' for the service's dispatcher, whose service is returned via
+ * `dsvc' to be called once the table is unlocked (see dispatched()), or
+ * queued for a worker; if the
+ * service queue is full, the query is not acknowledged, so the client
+ * retries it
+ * `p' is either the packet just received, `dp', or a query reassembled
+ * from fragments; must be called with the table locked
+ * returns 1 if `p' has been taken over, 0 otherwise
+ */
+static int accept_query(Context *cx, CRecord *cr, DataPayload *p,
+                        DataPayload *dp, unsigned long oseqno, RpcQuery *dq,
+                        SRecord **dsvc) {
+    ControlPayload *cp;
+
+    if (! crecord_activate(cr)) {	/* not acknowledged, so retried */
+        cr->seqno = oseqno;
+        return 0;
+    }
+    /* for the response, in groups no larger than this side allows */
+    cr->group = (dp->hdr.group > MAX_GROUP) ? MAX_GROUP : dp->hdr.group;
+    /* no QACK - the response itself acknowledges the query */
+    if (cr->svc->s_inline != NULL && respond_inline(cx, cr, p, cr->seqno)) {
+        if (p != dp)
+            srpc_free(p);
+        return 0;
+    }
+    if (cr->svc->s_dispatch != NULL) {
+        /* handed over once the table is unlocked */
+        *dsvc = cr->svc;
+        __atomic_add_fetch(&cr->svc->s_dispatching, 1, __ATOMIC_RELAXED);
+        dq->ep = cr->ep;
+        dq->buf = (RpcBuffer)p;
+        dq->data = (void *)p->data;
+        dq->len = ntohs(p->dhdr.tlen);
+        dq->wait = 0;
+    } else if (! squeue_put(cr->svc->s_queue, &cr->ep, p)) {
+        /* service queue full - no QACK, so the client retries */
+        if (p == dp) {
+            cr->seqno = oseqno;
+            crecord_release(cr);
+        } else
+            cr->act->resp = p;
+        return 0;
+    }
+    cp = (ControlPayload *)srpc_malloc(CP_SIZE);
+    cp_complete(cp, cr->ep.subport, QACK, cr->seqno,
+                dp->hdr.fnum, dp->hdr.nfrags);
+    crecord_setPayload(cr, cp, CP_SIZE, ATTEMPTS, TICKS);
+    (void)send_payload(cx, &cr->ep, cp, CP_SIZE);
+    crecord_setState(cr, ST_QACK_SENT);
+    return 1;
+}
+
+/*
+ * the reader's handling of the last packet of the response to the call
+ * outstanding on `cr', once its data has been stored: the response is
+ * acknowledged, and the call completed; must be called with the table locked
+ */
+static void response_done(Context *cx, CRecord *cr, unsigned char fnum,
+                          unsigned char nfrags) {
+    ControlPayload cp;
+
+    cp_complete(&cp, cr->ep.subport, RACK, cr->seqno, fnum, nfrags);
+    (void)send_payload(cx, &cr->ep, &cp, CP_SIZE);
+    crecord_setState(cr, ST_IDLE);
+    if (cr->act != NULL && cr->act->async != NULL)
+        async_finish(cx, cr, 1);
+}
+
+/*
+ * start reassembling on `cr' a message sent in parity groups, of which
+ * `dp' is the first packet to arrive, in the caller's posted buffer if it
+ * is a response that fits, otherwise in a library buffer
+ * returns 1 if successful, 0 otherwise
+ */
+static int group_begin(CRecord *cr, DataPayload *dp, int isR) {
+    unsigned tlen = ntohs(dp->dhdr.tlen);
+
+    if (! crecord_activate(cr))
+        return 0;
+    if (cr->act->fec == NULL && (cr->act->fec = fec_create()) == NULL) {
+        crecord_release(cr);
+        return 0;
+    }
+    fec_reset(cr->act->fec);
+    if (isR && cr->act->ubuf != NULL && tlen <= cr->act->ulen) {
+        cr->act->ulen = tlen;
         return 1;
+    }
+    if ((cr->act->resp = srpc_malloc(DP_HDR_SIZE + tlen)) == NULL) {
+        crecord_release(cr);
+        return 0;
+    }
+    memcpy(cr->act->resp, dp, DP_HDR_SIZE);
+    return 1;
+}
+
+/*
+ * the reader's handling of the `n'-byte FRAGMENT or PARITY packet `dp' of
+ * a parity group: fragments are stored as they arrive, in any order, and
+ * the one fragment of a group that is missing is rebuilt once its parity
+ * has arrived; a FACK for the fragments held in order is sent when that
+ * completes the group, when the parity of an incomplete group arrives, so
+ * that the sender resumes from the first that is missing, and when a
+ * packet is repeated, as it is by the sender's timer
+ * must be called with the table locked
+ */
+static void group_receive(Context *cx, CRecord *cr, DataPayload *dp, int n) {
+    unsigned long seqno = ntohl(dp->hdr.seqno);
+    unsigned char fnum = dp->hdr.fnum;
+    unsigned char nfrags = dp->hdr.nfrags;
+    unsigned char last = dp->hdr.group;
+    unsigned tlen = ntohs(dp->dhdr.tlen);
+    unsigned long st = cr->state;
+    int isQ, isR, again;
+    unsigned char *msg;
+    unsigned char had;
+    ControlPayload *cp;
+
+    if (n < (int)(DP_HDR_SIZE + FR_SIZE) || fnum == 0 || fnum > last ||
+            last >= nfrags || tlen == 0 || (tlen - 1) / FR_SIZE + 1 != nfrags)
+        return;
+    isQ = (st == ST_IDLE || st == ST_RESPONSE_SENT) &&
+          (seqno - cr->seqno) == 1;
+    isR = (st == ST_QUERY_SENT || st == ST_AWAITING_RESPONSE) &&
+          seqno == cr->seqno;
+    if (isQ || isR) {
+        if (! group_begin(cr, dp, isR))
+            return;
+        cr->seqno = seqno;
+        cr->act->lastFrag = 0;
+        crecord_setState(cr, ST_FACK_SENT);
+    } else if (st != ST_FACK_SENT || seqno != cr->seqno ||
+               cr->act->fec == NULL ||
+               tlen != ((cr->act->resp != NULL) ?
+                        ntohs(((DataPayload *)cr->act->resp)->dhdr.tlen) :
+                        cr->act->ulen))
+        return;
+    msg = (cr->act->resp != NULL) ? ((DataPayload *)cr->act->resp)->data :
+                                    cr->act->ubuf;
+    had = cr->act->lastFrag;
+    if (dp->hdr.command == PARITY)
+        again = fec_hold(cr->act->fec, fnum, last, dp->data);
+    else if (! (again = fec_mark(cr->act->fec, fnum)))
+        memcpy(msg + FR_SIZE * (fnum - 1), dp->data, FR_SIZE);
+    if (fec_repair(cr->act->fec, msg))
+        cx->repaired++;
+    cr->act->lastFrag = fec_received(cr->act->fec, had);
+    if (! again && (had >= last || cr->act->lastFrag < last) &&
+            (dp->hdr.command != PARITY || cr->act->lastFrag >= last))
+        return;				/* the rest of the group is due */
+    cp = (ControlPayload *)srpc_malloc(CP_SIZE);
+    cp_complete(cp, cr->ep.subport, FACK, seqno, cr->act->lastFrag, nfrags);
+    crecord_setPayload(cr, cp, CP_SIZE, ATTEMPTS, TICKS);
+    (void)send_payload(cx, &cr->ep, cp, CP_SIZE);
+    crecord_setState(cr, ST_FACK_SENT);
 }
 
-/* continuously reads messages from UDP port */
-static void *reader(UNUSED void *args) {
+/*
+ * process the `n'-byte packet in `buf', received from `c_addr' on the
+ * socket of `cx', as the reader does for each packet it reads
+ * returns `buf' if it may be reused, or NULL if it has been retained
+ */
+static char *receive(Context *cx, char *buf, int n,
+                     struct sockaddr_in *c_addr) {
     DataPayload *dp;
-    char buf[10240];
-    struct sockaddr_in c_addr;
-    socklen_t len;
-    int n;
+    AsyncCall *fin;
+    RpcQuery dq;
+    RpcDispatch dispatch = NULL;
+    void *darg = NULL;
+    SRecord *dsvc = NULL;
+    unsigned short cmd;
+    unsigned long sb;
+    unsigned long seqno;
+    unsigned char fnum;
+    unsigned char nfrags;
+    unsigned long st;
+    RpcEndpoint ep;
+    CRecord *cr;
 
-    debugf("reader thread started\n");
-    for(;;) {
-        unsigned short cmd;
-        unsigned long sb;
-        unsigned long seqno;
-        unsigned char fnum;
-        unsigned char nfrags;
-        char *sp;
-        unsigned short pt;
-        RpcEndpoint ep;
-        CRecord *cr;
-
-        len = sizeof(c_addr);
-        memset(&c_addr, 0, len);
-        n = recvfrom(my_sock, buf, sizeof(buf), 0,
-                     (struct sockaddr *)&c_addr, &len);
-        if (n < 0)
-            continue;
-        buf[n] = '\0';
-        dp = (DataPayload *)buf;
-        cmd = ntohs(dp->hdr.command);
-        sb = ntohl(dp->hdr.subport);
-        seqno = ntohl(dp->hdr.seqno);
-        fnum = dp->hdr.fnum;
-        nfrags = dp->hdr.nfrags;
-        sp = inet_ntoa(c_addr.sin_addr);
-        pt = ntohs(c_addr.sin_port);
-        if (cmd >= CMD_LOW && cmd <= CMD_HIGH) {
-            logf("%s from %s:%05u:%08lx; seqno = %ld, frag/nfrag = %u/%u\n",
-                 cmdnames[cmd], sp, pt, sb, seqno, fnum, nfrags);
-        } else {
-            errorf("Illegal command received: %d\n", cmd);
-            continue;
+    if (n < (int)sizeof(PayloadHeader))
+        return buf;
+    dp = (DataPayload *)buf;
+    cmd = dp->hdr.command;
+    sb = ntohl(dp->hdr.subport);
+    seqno = ntohl(dp->hdr.seqno);
+    fnum = dp->hdr.fnum;
+    nfrags = dp->hdr.nfrags;
+    if (cmd < CMD_LOW || cmd > CMD_HIGH) {
+        errorf("Illegal command received: %d\n", cmd);
+        return buf;
+    }
+    logf("%s from %s:%05u:%08lx; seqno = %ld, frag/nfrag = %u/%u\n",
+         cmdnames[cmd], inet_ntoa(c_addr->sin_addr),
+         ntohs(c_addr->sin_port), sb, seqno, fnum, nfrags);
+    endpoint_complete(&ep, c_addr, sb);
+    ctable_lock(cx->ct);
+    cx->received++;
+    cr = ctable_look_ep(cx->ct, &ep);
+    if (cr != NULL && cr->peer != NULL)
+        peer_heard(cr->peer, ep.addr.sin_port);
+    st = (cr != NULL && nfrags == 1) ? cr->state : 0;
+    /*
+     * header prediction: the next query on an idle connection and the
+     * response to an outstanding call are by far the most common
+     * packets, and are handled here without the general checks below
+     */
+    if (cmd == QUERY && st == ST_IDLE && (seqno - cr->seqno) == 1) {
+        cx->predicted++;
+        cr->seqno = seqno;
+        if (accept_query(cx, cr, dp, dp, seqno - 1, &dq, &dsvc))
+            buf = NULL;
+    } else if ((st == ST_AWAITING_RESPONSE || st == ST_QUERY_SENT) &&
+               cmd == RESPONSE && seqno == cr->seqno) {
+        cx->predicted++;
+        if (! posted_copy(cr, dp, fnum)) {
+            cr->act->resp = dp;		/* retained in place */
+            buf = NULL;
         }
-        endpoint_complete(&ep, &c_addr, sb);
-        ctable_lock();
-        cr = ctable_look_ep(&ep);
-        switch (cmd) {
-        case CONNECT: {
-            RpcEndpoint *nep;
-            ConnectPayload *conp = (ConnectPayload *)dp;
-            ControlPayload *p;
-            int newcr = 0;
-            SRecord *sr;
-            sr = stable_lookup(conp->sname);
-            if (sr == NULL)
-                break;
-            if (cr == NULL) {
-                nep = endpoint_duplicate(&ep);
-                cr = crecord_create(nep, seqno);
-                crecord_setCID(cr, gen_conn_id());
-                newcr = 1;
-            } else if (cr->state != ST_IDLE) {
-                fprintf(stderr,
-                        "%s from %s:%05u:%08lx; seqno = %ld, frag/nfrag = %u/%u\n",
-                        cmdnames[cmd], sp, pt, sb, seqno, fnum, nfrags);
-                crecord_dump(cr, "connectrqst");
-            }
-            if (newcr || cr->state == ST_IDLE) {
-                if (newcr) {
-                    p = (ControlPayload *)malloc(CP_SIZE);
-                    cp_complete(p, nep->subport, CACK, seqno, 1, 1);
-                    crecord_setPayload(cr, p, CP_SIZE, ATTEMPTS, TICKS);
-                }
-                crecord_setService(cr, sr);
-                (void) send_payload(cr->ep, cr->pl, cr->size);
-                crecord_setState(cr, ST_IDLE);
-            }
-            if (newcr)
-                ctable_insert(cr);
+        response_done(cx, cr, fnum, nfrags);
+    } else switch (cmd) {
+    case CONNECT: {
+        ConnectPayload *conp = (ConnectPayload *)dp;
+        ControlPayload cp;
+        int newcr = 0;
+        SRecord *sr;
+        buf[n - 1] = '\0';		/* sender includes the '\0' */
+        sr = stable_lookup(cx->st, conp->sname);
+        if (sr == NULL)
             break;
+        if (cr == NULL) {
+            cr = crecord_create(&ep, seqno);
+            if (cr == NULL)
+                break;
+            crecord_setCID(cr, gen_conn_id(cx));
+            newcr = 1;
+        } else if (cr->state != ST_IDLE) {
+            fprintf(stderr,
+                    "%s from %s:%05u:%08lx; seqno = %ld, frag/nfrag = %u/%u\n",
+                    cmdnames[cmd], inet_ntoa(c_addr->sin_addr),
+                    ntohs(c_addr->sin_port), sb, seqno, fnum, nfrags);
+            crecord_dump(cr, "connectrqst");
         }
-        case CACK: {
-            if ((cr != NULL)) {
-                if (seqno == cr->seqno)
-                    crecord_setState(cr, ST_IDLE);
-            }
-            break;
+        if (newcr || cr->state == ST_IDLE) {
+            cp_complete(&cp, ep.subport, CACK, seqno, 1, 1);
+            crecord_setService(cr, sr);
+            (void) send_payload(cx, &cr->ep, &cp, CP_SIZE);
+            crecord_setState(cr, ST_IDLE);
+        }
+        if (newcr)
+            ctable_insert(cx->ct, cr);
+        break;
+    }
+    case CACK: {
+        if ((cr != NULL)) {
+            if (seqno == cr->seqno)
+                crecord_setState(cr, ST_IDLE);
         }
+        break;
+    }
 #define NEW 2
 #define OLD 1
 #define ILL 0
-        case QUERY: {
-            DataPayload *p = NULL;
-            ControlPayload *cp = NULL;
-            int dplen, cplen;
-            unsigned long state;
-            int accept = ILL;
+    case QUERY: {
+        DataPayload *p = NULL;
+        unsigned long state;
+        unsigned long oseqno;
+        int accept = ILL;
 
-            if (cr == NULL)
-                break;
-            state = cr->state;
-            if ((seqno - cr->seqno) == 1 &&
-                    (state == ST_IDLE || state == ST_RESPONSE_SENT)) {
-                accept = NEW;
-                cr->seqno = seqno;
-                p = (DataPayload *)malloc(n);
-                dplen = n;
-                memcpy(p, buf, n);
-            } else if (seqno == cr->seqno && state == ST_FACK_SENT &&
-                       (fnum - cr->lastFrag) == 1 &&
-                       fnum == nfrags) {
-                void *tp;
-                unsigned short flen = ntohs(dp->dhdr.flen);
-                accept = NEW;
-                p = (DataPayload *)cr->resp;
-                dplen = sizeof(PayloadHeader) + sizeof(DataHeader) +
-                        ntohs(dp->dhdr.tlen);
-                cr->resp = NULL;
-                tp = (void *)&(p->data[FR_SIZE * (fnum - 1)]);
-                memcpy(tp, dp->data, flen);
-            } else if (seqno == cr->seqno &&
-                       (state == ST_QACK_SENT || state == ST_RESPONSE_SENT)) {
-                accept = OLD;
-            }
-            switch (accept) {
-            case NEW:
-                cplen = CP_SIZE;
-                cp = (ControlPayload *)malloc(cplen);
-                cp_complete(cp, ep.subport, QACK, seqno, fnum, nfrags);
-                crecord_setPayload(cr, cp, cplen, ATTEMPTS, TICKS);
-                (void)send_payload(cr->ep, cp, cplen);
-                tsl_append(cr->svc->s_queue, cr->ep, p, dplen);
-                crecord_setState(cr, ST_QACK_SENT);
-                break;
-            case OLD:
-                (void)send_payload(cr->ep, cr->pl, cr->size);
-                crecord_setState(cr, state);
-                break;
-            case ILL:
-                break;
-            }
+        if (cr == NULL)
             break;
+        state = cr->state;
+        oseqno = cr->seqno;
+        if ((seqno - cr->seqno) == 1 &&
+                (state == ST_IDLE || state == ST_RESPONSE_SENT)) {
+            accept = NEW;
+            cr->seqno = seqno;
+            p = dp;			/* queued in place */
+        } else if (seqno == cr->seqno && state == ST_FACK_SENT &&
+                   (fnum - cr->act->lastFrag) == 1 &&
+                   fnum == nfrags) {
+            void *tp;
+            unsigned short flen = ntohs(dp->dhdr.flen);
+            accept = NEW;
+            p = (DataPayload *)cr->act->resp;
+            cr->act->resp = NULL;
+            tp = (void *)&(p->data[FR_SIZE * (fnum - 1)]);
+            memcpy(tp, dp->data, flen);
+        } else if (seqno == cr->seqno &&
+                   (state == ST_QACK_SENT || state == ST_RESPONSE_SENT)) {
+            accept = OLD;
         }
-        case QACK: {
-            if (cr != NULL) {
-                if (seqno == cr->seqno)
-                    crecord_setState(cr, ST_AWAITING_RESPONSE);
-            }
+        switch (accept) {
+        case NEW:
+            if (accept_query(cx, cr, p, dp, oseqno, &dq, &dsvc) &&
+                    p == dp)
+                buf = NULL;
+            break;
+        case OLD:
+            (void)send_payload(cx, &cr->ep, cr->act->pl, cr->act->size);
+            crecord_setState(cr, state);
+            break;
+        case ILL:
             break;
         }
-        case RESPONSE: {
-            DataPayload *p = NULL;
-            ControlPayload *cp = NULL;
-            int cplen;
-            unsigned long st;
-            unsigned short flen = ntohs(dp->dhdr.flen);
+        break;
+    }
+    case QACK: {
+        /*
+         * a QACK may arrive after the response it preceded - the
+         * server's reader transmits it once the table is unlocked,
+         * by which time a worker may already have responded
+         */
+        if (cr != NULL) {
+            if (seqno == cr->seqno && cr->state == ST_QUERY_SENT)
+                crecord_setState(cr, ST_AWAITING_RESPONSE);
+        }
+        break;
+    }
+    case RESPONSE: {
+        DataPayload *p = NULL;
+        unsigned short flen = ntohs(dp->dhdr.flen);
 
-            if (cr == NULL || seqno != cr->seqno)
-                break;
-            st = cr->state;
-            if (st == ST_QUERY_SENT || st == ST_AWAITING_RESPONSE) {
-                p = (DataPayload *)malloc(n);
-                memcpy(p, buf, n);
-                cr->resp = p;
-            } else if (st == ST_FACK_SENT && (fnum - cr->lastFrag) == 1 &&
-                       fnum == nfrags) {
-                p = (DataPayload *)cr->resp;
-                memcpy(&(p->data[FR_SIZE * (fnum -1)]), dp->data, flen);
-                cr->lastFrag = fnum;
-            } else
-                break;
-            cplen = CP_SIZE;
-            cp = (ControlPayload *)malloc(cplen);
-            cp_complete(cp, ep.subport, RACK, seqno, fnum, nfrags);
-            crecord_setPayload(cr, cp, cplen, ATTEMPTS, TICKS);
-            (void)send_payload(cr->ep, cp, cplen);
-            crecord_setState(cr, ST_IDLE);
+        if (cr == NULL || seqno != cr->seqno)
             break;
-        }
-        case RACK: {
-            if (cr != NULL) {
-                if (seqno == cr->seqno)
-                    crecord_setState(cr, ST_IDLE);
+        st = cr->state;
+        if (st == ST_QUERY_SENT || st == ST_AWAITING_RESPONSE) {
+            if (! posted_copy(cr, dp, fnum)) {
+                cr->act->resp = dp;		/* retained in place */
+                buf = NULL;
             }
+        } else if (st == ST_FACK_SENT && (fnum - cr->act->lastFrag) == 1 &&
+                   fnum == nfrags) {
+            if (cr->act->resp == NULL) {
+                if (! posted_copy(cr, dp, fnum))
+                    break;
+            } else {
+                p = (DataPayload *)cr->act->resp;
+                memcpy(&(p->data[FR_SIZE * (fnum -1)]), dp->data, flen);
+            }
+            cr->act->lastFrag = fnum;
+        } else
             break;
+        response_done(cx, cr, fnum, nfrags);
+        break;
+    }
+    case RACK: {
+        if (cr != NULL) {
+            if (seqno == cr->seqno)
+                crecord_setState(cr, ST_IDLE);
         }
-        case DISCONNECT: {
-            ControlPayload cp;		/* always send a DACK */
-
-            cp_complete(&cp, ep.subport, DACK, seqno, 1, 1);
-            (void)send_payload(&ep, &cp, CP_SIZE);
-            if (cr != NULL) {
+        break;
+    }
+    case DISCONNECT: {
+        ControlPayload cp;		/* always send a DACK */
+
+        cp_complete(&cp, ep.subport, DACK, seqno, 1, 1);
+        (void)send_payload(cx, &ep, &cp, CP_SIZE);
+        if (cr != NULL) {
+            crecord_setState(cr, ST_TIMEDOUT);
+            if (cr->act != NULL && cr->act->async != NULL)
+                async_finish(cx, cr, 0);
+        }
+        break;
+    }
+    case DACK: {
+        if (cr != NULL) {
+            if (seqno == cr->seqno)
                 crecord_setState(cr, ST_TIMEDOUT);
-            }
-            break;
         }
-        case DACK: {
-            if (cr != NULL) {
-                if (seqno == cr->seqno)
-                    crecord_setState(cr, ST_TIMEDOUT);
-            }
+        break;
+    }
+    case FRAGMENT: {
+        DataPayload *p = NULL;
+        ControlPayload *cp = NULL;
+        int dplen, cplen;
+        unsigned long st;
+        int accept = ILL;
+        unsigned short tlen = ntohs(dp->dhdr.tlen);
+        unsigned short flen = ntohs(dp->dhdr.flen);
+        int isQ, isR;
+
+        if (cr == NULL)
+            break;
+        if (dp->hdr.group != 0) {
+            group_receive(cx, cr, dp, n);
             break;
         }
-        case FRAGMENT: {
-            DataPayload *p = NULL;
-            ControlPayload *cp = NULL;
-            int dplen, cplen;
-            unsigned long st;
-            int accept = ILL;
-            unsigned short tlen = ntohs(dp->dhdr.tlen);
-            unsigned short flen = ntohs(dp->dhdr.flen);
-            int isQ, isR;
-
-            if (cr == NULL)
-                break;
-            st = cr->state;
-            isQ = (st == ST_IDLE || st == ST_RESPONSE_SENT) &&
-                  (seqno - cr->seqno) == 1 && fnum == 1;
-            isR = (st == ST_QUERY_SENT || st == ST_AWAITING_RESPONSE) &&
-                  seqno == cr->seqno && fnum == 1;
-            if (isQ || isR) {
+        st = cr->state;
+        isQ = (st == ST_IDLE || st == ST_RESPONSE_SENT) &&
+              (seqno - cr->seqno) == 1 && fnum == 1;
+        isR = (st == ST_QUERY_SENT || st == ST_AWAITING_RESPONSE) &&
+              seqno == cr->seqno && fnum == 1;
+        if (isR && posted_copy(cr, dp, fnum)) {
+            accept = NEW;
+        } else if ((isQ && crecord_activate(cr)) || isR) {
+            accept = NEW;
+            cr->seqno = seqno;
+            dplen = sizeof(PayloadHeader) + sizeof(DataHeader) + tlen;
+            cr->act->resp = srpc_malloc(dplen);
+            p = (DataPayload *)cr->act->resp;
+            memcpy(p, buf, n);
+        } else if (seqno == cr->seqno && st == ST_FACK_SENT &&
+                   (fnum - cr->act->lastFrag) == 1) {
+            void *tp;
+            if (cr->act->resp != NULL) {
                 accept = NEW;
-                cr->seqno = seqno;
-                dplen = sizeof(PayloadHeader) + sizeof(DataHeader) + tlen;
-                cr->resp = malloc(dplen);
-                p = (DataPayload *)cr->resp;
-                memcpy(p, buf, n);
-            } else if (seqno == cr->seqno && st == ST_FACK_SENT &&
-                       (fnum - cr->lastFrag) == 1) {
-                void *tp;
-                accept = NEW;
-                p = (DataPayload *)cr->resp;
+                p = (DataPayload *)cr->act->resp;
                 tp = (void *)&(p->data[FR_SIZE * (fnum - 1)]);
                 memcpy(tp, dp->data, flen);
-            } else if (seqno == cr->seqno && st == ST_FACK_SENT &&
-                       fnum == cr->lastFrag) {
-                accept = OLD;
-            }
-            switch (accept) {
-            case NEW:
-                cr->lastFrag = fnum;
-                cplen = CP_SIZE;
-                cp = (ControlPayload *)malloc(cplen);
-                cp_complete(cp, ep.subport, FACK, seqno, fnum, nfrags);
-                crecord_setPayload(cr, cp, cplen, ATTEMPTS, TICKS);
-                (void)send_payload(cr->ep, cp, cplen);
-                crecord_setState(cr, ST_FACK_SENT);
-                break;
-            case OLD:
-                (void)send_payload(cr->ep, cr->pl, cr->size);
-                crecord_setState(cr, st);
-                break;
-            case ILL:
-                break;
-            }
-            break;
+            } else if (posted_copy(cr, dp, fnum))
+                accept = NEW;
+        } else if (seqno == cr->seqno && st == ST_FACK_SENT &&
+                   fnum == cr->act->lastFrag) {
+            accept = OLD;
         }
-        case FACK: {
-            if (cr != NULL) {
-                if (seqno == cr->seqno && cr->state == ST_FRAGMENT_SENT
-                        && fnum == cr->lastFrag) {
-                    crecord_setState(cr, ST_FACK_RECEIVED);
-                }
-            }
+        switch (accept) {
+        case NEW:
+            cr->act->lastFrag = fnum;
+            cplen = CP_SIZE;
+            cp = (ControlPayload *)srpc_malloc(cplen);
+            cp_complete(cp, ep.subport, FACK, seqno, fnum, nfrags);
+            crecord_setPayload(cr, cp, cplen, ATTEMPTS, TICKS);
+            (void)send_payload(cx, &cr->ep, cp, cplen);
+            crecord_setState(cr, ST_FACK_SENT);
             break;
-        }
-        case PING: {
-            ControlPayload cp;
-
-            if (cr != NULL) {
-                cp_complete(&cp, ep.subport, PACK, seqno, 1, 1);
-                (void)send_payload(&ep, &cp, CP_SIZE);
-            }
+        case OLD:
+            (void)send_payload(cx, &cr->ep, cr->act->pl, cr->act->size);
+            crecord_setState(cr, st);
+            break;
+        case ILL:
             break;
         }
-        case PACK: {
-            if (cr != NULL) {
-                crecord_setState(cr, cr->state);	/* resets ping data */
+        break;
+    }
+    case FACK: {
+        if (cr != NULL) {
+            /* with parity groups, the sender resumes after `fnum' */
+            if (seqno == cr->seqno && cr->state == ST_FRAGMENT_SENT &&
+                    (fnum == cr->act->lastFrag ||
+                     (cr->group > 0 && fnum + 1 >= cr->act->firstFrag &&
+                      fnum < cr->act->lastFrag))) {
+                stripe_acked(cx, cr, fnum);
+                cr->act->lastFrag = fnum;
+                crecord_setState(cr, ST_FACK_RECEIVED);
+                if (cr->act->async != NULL)	/* send the next packet */
+                    async_send(cx, cr, (DataPayload *)cr->act->pl, fnum + 1);
             }
-            break;
         }
-        case SEQNO: {
-            ControlPayload *cp;
+        break;
+    }
+    case PARITY: {
+        if (cr != NULL)
+            group_receive(cx, cr, dp, n);
+        break;
+    }
+    case PING: {
+        ControlPayload cp;
 
-            if (cr != NULL) {
-                unsigned long st = cr->state;
-                if (st == ST_IDLE || st == ST_RESPONSE_SENT) {
-                    cp = (ControlPayload *)malloc(CP_SIZE);
-                    cp_complete(cp, ep.subport, SACK, seqno, 1, 1);
-                    crecord_setPayload(cr, cp, CP_SIZE, ATTEMPTS, TICKS);
-                    (void)send_payload(cr->ep, cp, CP_SIZE);
-                    cr->seqno = seqno;
-                    crecord_setState(cr, ST_IDLE);
-                }
-            }
-            break;
+        /*
+         * answered even without the connection, as the PING vouches
+         * for all of the sender's connections to this endpoint, but
+         * marked, so that the sender times out the connection itself
+         */
+        cp_complete(&cp, ep.subport, PACK, seqno, (cr != NULL) ? 1 : 0, 1);
+        (void)send_payload(cx, &ep, &cp, CP_SIZE);
+        break;
+    }
+    case PACK: {
+        if (cr != NULL && dp->hdr.fnum == 0 &&	/* unknown there */
+                ! crecord_unacked(cr->state) && cr->state != ST_TIMEDOUT) {
+#ifdef LOG
+            crecord_dump(cr, "Unknown to endpoint: ");
+#endif /* LOG */
+            crecord_setState(cr, ST_TIMEDOUT);
+            if (cr->act != NULL && cr->act->async != NULL)
+                async_finish(cx, cr, 0);
         }
-        case SACK: {
-            if (cr != NULL && cr->state == ST_SEQNO_SENT) {
+        break;
+    }
+    case SEQNO: {
+        ControlPayload cp;
+
+        if (cr != NULL) {
+            unsigned long st = cr->state;
+            if (st == ST_IDLE || st == ST_RESPONSE_SENT) {
+                cp_complete(&cp, ep.subport, SACK, seqno, 1, 1);
+                (void)send_payload(cx, &cr->ep, &cp, CP_SIZE);
+                cr->seqno = seqno;
                 crecord_setState(cr, ST_IDLE);
             }
-            break;
         }
-        default: {
-            break;
+        break;
+    }
+    case SACK: {
+        if (cr != NULL && cr->state == ST_SEQNO_SENT) {
+            crecord_setState(cr, ST_IDLE);
+            if (cr->act != NULL && cr->act->async != NULL &&
+                    ! async_begin(cx, cr))
+                async_finish(cx, cr, 0);
+        }
+        break;
+    }
+    default: {
+        break;
+    }
+    }
+    if (dsvc != NULL) {
+        dispatch = dsvc->s_dispatch;
+        darg = dsvc->s_dispatchArg;
+    }
+    fin = cx->done;
+    cx->done = NULL;
+    ctable_unlock(cx->ct);
+    if (fin != NULL)
+        async_deliver(fin);
+    if (dsvc != NULL)
+        dispatched(dsvc, dispatch, darg, &dq);
+    return buf;
+}
+
+/*
+ * read a packet for `cx' in busy-poll mode: the transport is polled without
+ * blocking until a packet arrives, or until it has been idle for the
+ * backoff, if any, after which the reader blocks in the usual way
+ * returns as transport_recv()
+ */
+static int busy_recv(Context *cx, char *buf, struct sockaddr_in *c_addr) {
+    unsigned long backoff, start = 0, i;
+    int n;
+
+    backoff = 1000 * (unsigned long)__atomic_load_n(&cx->backoff,
+                                                    __ATOMIC_RELAXED);
+    for (i = 0; __atomic_load_n(&cx->busy, __ATOMIC_RELAXED); i++) {
+        n = transport_recv(cx->tp, buf, PKT_SIZE, c_addr, 0);
+        if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            return n;
+        if (backoff > 0) {
+            if (start == 0)
+                start = spin_clock();
+            else if (spin_clock() - start >= backoff)
+                break;
         }
+        spin_pause(i);
+    }
+    return transport_recv(cx->tp, buf, PKT_SIZE, c_addr, 1);
+}
+
+/*
+ * continuously reads messages from UDP port
+ *
+ * each datagram is received into a PKT_SIZE buffer from srpc_malloc(); a
+ * single-fragment query is queued to its service in the buffer into which
+ * it was received, and the reader takes a fresh buffer for the next
+ * datagram - receive buffers thus circulate between the reader's cache of
+ * PKT_SIZE buffers and the workers that release them
+ */
+static void *reader(void *args) {
+    Context *cx = (Context *)args;
+    char *buf = NULL;
+    struct sockaddr_in c_addr;
+    int n;
+
+    debugf("reader thread started\n");
+    for(;;) {
+        if (buf == NULL && (buf = (char *)srpc_malloc(PKT_SIZE)) == NULL) {
+            nanosleep(&one_tick, NULL);
+            continue;
         }
-        ctable_unlock();
+        memset(&c_addr, 0, sizeof(c_addr));
+        if (__atomic_load_n(&cx->busy, __ATOMIC_RELAXED))
+            n = busy_recv(cx, buf, &c_addr);
+        else
+            n = transport_recv(cx->tp, buf, PKT_SIZE, &c_addr, 1);
+        buf = receive(cx, buf, n, &c_addr);
     }
     return NULL;
 }
@@ -507,39 +1166,48 @@ static void *reader(UNUSED void *args) {
  * from the table
  */
 #define TICKS_TIL_PURGE 10
-static void *timer(UNUSED void *args) {
+static void *timer(void *args) {
+    Context *cx = (Context *)args;
     CRecord *retry, *timed, *ping, *purge, *cr;
+    PTable *pt = ctable_peers(cx->ct);
+    AsyncCall *fin;
     int counter = 0;
 
     debugf("timer thread started\n");
     for (;;) {
         if (nanosleep(&one_tick, NULL) != 0)
             break;
-        ctable_lock();
+        ctable_lock(cx->ct);
         if ((++counter % 500) == 0) {
             counter = 0;
 #ifdef VLOG
             logvf("Dump of connection table\n");
-            ctable_dump("LOGV> ");
+            ctable_dump(cx->ct, "LOGV> ");
 #endif /* VLOG */
         }
-        ctable_scan(&retry, &timed, &ping, &purge);
+        ptable_tick(pt);
+        ctable_scan(cx->ct, &retry, &timed, &ping, &purge);
         while (purge != NULL) {
             cr = purge->link;
-            ctable_remove(purge);
+            if (purge->act != NULL && purge->act->async != NULL)
+                async_finish(cx, purge, 0);
+            ctable_remove(cx->ct, purge);
             crecord_destroy(purge);
             purge = cr;
         }
         while (timed != NULL) {
             cr = timed->link;
             crecord_setState(timed, ST_TIMEDOUT);
+            if (timed->act != NULL && timed->act->async != NULL)
+                async_finish(cx, timed, 0);
             timed = cr;
         }
         while (ping != NULL) {
             ControlPayload pl;
             cr = ping->link;
-            cp_complete(&pl, ping->ep->subport, PING, ping->seqno, 1, 1);
-            (void)send_payload(ping->ep, &pl, CP_SIZE);
+            cp_complete(&pl, ping->ep.subport, PING, ping->seqno, 1, 1);
+            (void)send_payload(cx, &ping->ep, &pl, CP_SIZE);
+            cx->pinged++;
             ping = cr;
         }
         while (retry != NULL) {
@@ -551,34 +1219,131 @@ static void *timer(UNUSED void *args) {
             case ST_DISCONNECT_SENT:
             case ST_FRAGMENT_SENT:
             case ST_SEQNO_SENT:
-                (void)send_payload(retry->ep, retry->pl, retry->size);
+                if (retry->peer != NULL &&
+                        ! peer_retry(pt, retry->peer, retry->act->sentAt)) {
+                    retry->act->nattempts++;	/* deferred to the next tick */
+                    retry->act->ticks /= 2;
+                    retry->act->ticksLeft = 1;
+                    break;
+                }
+                if (retry->state == ST_FRAGMENT_SENT)
+                    stripe_lost(cx, retry);
+                (void)send_payload(cx, &retry->ep, retry->act->pl,
+                                   retry->act->size);
+                cx->retried++;
                 break;
             }
             retry = cr;
         }
-        ctable_unlock();
+        fin = cx->done;
+        cx->done = NULL;
+        ctable_unlock(cx->ct);
+        if (fin != NULL)
+            async_deliver(fin);
     }
     return NULL;
 }
 
-static int common_init(unsigned short port) {
-    socklen_t len = sizeof(struct sockaddr_in);
+/*
+ * start a thread running `fn' for `cx', pinned to the context's CPU
+ * returns 1 if successful, 0 otherwise
+ */
+static int start_thread(pthread_t *thr, void *(*fn)(void *), Context *cx) {
+    pthread_attr_t attr;
+    int ans;
+#ifdef HAVE_CPU_AFFINITY
+    cpu_set_t set;
+#endif /* HAVE_CPU_AFFINITY */
+
+    pthread_attr_init(&attr);
+#ifdef HAVE_CPU_AFFINITY
+    /* a CPU that the process may not use is ignored */
+    if (affinity_usable(cx->cpu)) {
+        CPU_ZERO(&set);
+        CPU_SET(cx->cpu, &set);
+        (void)pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    }
+#endif /* HAVE_CPU_AFFINITY */
+    ans = pthread_create(thr, &attr, fn, cx);
+    pthread_attr_destroy(&attr);
+    return (ans == 0);
+}
+
+/*
+ * returns a UDP transport on `port', with the configured buffer sizes
+ */
+static Transport *udp_open(unsigned short port) {
+    return transport_udp(port, __atomic_load_n(&rcvBuf, __ATOMIC_RELAXED),
+                         __atomic_load_n(&sndBuf, __ATOMIC_RELAXED));
+}
+
+/*
+ * stop the thread `thr' started by start_thread()
+ */
+static void stop_thread(pthread_t thr) {
+    void *status;
+
+    pthread_cancel(thr);
+    pthread_join(thr, &status);
+}
 
-    memset(&my_addr, 0, len);
-    my_addr.sin_family = AF_INET;
-    my_addr.sin_port = htons(port);
-    if ((my_sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0 ||
-            bind(my_sock, (struct sockaddr *)&my_addr, sizeof(my_addr)) < 0)
+/*
+ * attach `tp' to `cx' and start its reader and timer; should the timer
+ * not start, the reader is stopped again
+ * returns 1 if successful, 0 otherwise
+ */
+static int common_init(Context *cx, Transport *tp) {
+    if (tp == NULL)
         return 0;
-    getsockname(my_sock, (struct sockaddr *)&my_addr, &len);
-    my_port = ntohs(my_addr.sin_port);
-    if (pthread_create(&readThread, NULL, reader, NULL))
+    cx->tp = tp;
+    cx->port = tp->port;
+    if (! start_thread(&cx->readThread, reader, cx))
         return 0;
-    if (pthread_create(&timerThread, NULL, timer, NULL))
+    if (! start_thread(&cx->timerThread, timer, cx)) {
+        stop_thread(cx->readThread);
         return 0;
+    }
     return 1;
 }
 
+/*
+ * create a context on transport `tp' whose threads are pinned to `cpu', if
+ * it is not -1, and add it to contexts[]; if the context cannot be
+ * created, whatever was set up for it is undone and `tp' is closed
+ * returns the context if successful, NULL otherwise
+ */
+static Context *context_create(Transport *tp, int cpu) {
+    Context *cx = NULL;
+
+    pthread_mutex_lock(&ctxMutex);
+    if (ncontexts < MAX_CONTEXTS &&
+            (cx = (Context *)malloc(sizeof(Context))) != NULL) {
+        memset(cx, 0, sizeof(Context));
+        cx->index = ncontexts;
+        cx->cpu = cpu;
+        cx->ct = ctable_create();
+        cx->st = stable_new();
+        if (cx->ct != NULL && cx->st != NULL && common_init(cx, tp)) {
+            contexts[cx->index] = cx;
+            __atomic_store_n(&ncontexts, ncontexts + 1, __ATOMIC_RELEASE);
+            pthread_mutex_unlock(&ctxMutex);
+            return cx;
+        }
+        if (cx->ct != NULL)
+            ctable_destroy(cx->ct);
+        if (cx->st != NULL)
+            stable_free(cx->st);
+        free(cx);
+        cx = NULL;
+    }
+    if (tp != NULL)
+        transport_close(tp);
+    pthread_mutex_unlock(&ctxMutex);
+    return cx;
+}
+
+#define DEFAULT (contexts[0])
+
 /*
  * obtain most globally visible IPv4 address for this host
  *
@@ -672,14 +1437,119 @@ int rpc_init(unsigned short port) {
     char *s = getenv("CACHE_IPV4_ADDRESS");
 
     debugf("rpc_init() entered\n");
-    ctable_init();
-    stable_init();
+    if (ncontexts > 0)			/* already initialized */
+        return 0;
     if (s != NULL) {
         strcpy(my_address, s);
     } else {
         get_ipv4_addr(my_address);
     }
-    return common_init(port);
+    return (context_create(udp_open(port), -1) != NULL);
+}
+
+RpcContext rpc_context_create(unsigned short port, int cpu) {
+    if (ncontexts == 0)			/* rpc_init() must come first */
+        return NULL;
+    return (RpcContext)context_create(udp_open(port), cpu);
+}
+
+RpcContext rpc_context_create_xdp(unsigned short port, int cpu,
+                                  const char *ifname, unsigned queue,
+                                  int flags) {
+    Transport *tp;
+
+    if (ncontexts == 0)			/* rpc_init() must come first */
+        return NULL;
+    tp = transport_xdp(port, __atomic_load_n(&rcvBuf, __ATOMIC_RELAXED),
+                       __atomic_load_n(&sndBuf, __ATOMIC_RELAXED),
+                       ifname, queue, (flags & RPC_XDP_NATIVE) != 0);
+    if (tp == NULL)
+        return NULL;
+    return (RpcContext)context_create(tp, cpu);
+}
+
+RpcContext rpc_context_default(void) {
+    return (RpcContext)DEFAULT;
+}
+
+int rpc_context_pin(RpcContext ctx, int readerCpu, int timerCpu) {
+    Context *cx = (Context *)ctx;
+
+    if (cx == NULL)
+        return 0;
+    if (! affinity_pin(cx->readThread, readerCpu) ||
+            ! affinity_pin(cx->timerThread, timerCpu))
+        return 0;
+    cx->cpu = readerCpu;
+    return 1;
+}
+
+int rpc_context_busy_poll(RpcContext ctx, unsigned usecs, unsigned backoff) {
+    Context *cx = (Context *)ctx;
+    int ans;
+
+    if (cx == NULL)
+        return 0;
+    ans = transport_busy_poll(cx->tp, usecs);
+    __atomic_store_n(&cx->backoff, backoff, __ATOMIC_RELAXED);
+    __atomic_store_n(&cx->busy, usecs, __ATOMIC_RELAXED);
+    return ans;
+}
+
+/*
+ * returns the IPv4 address of the interface `ifname', or 0 if it has none
+ */
+static in_addr_t if_address(const char *ifname) {
+    struct ifaddrs *ifaddr, *ifa;
+    in_addr_t addr = 0;
+
+    if (getifaddrs(&ifaddr) == -1)
+        return 0;
+    for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
+        if (ifa->ifa_addr != NULL && ifa->ifa_addr->sa_family == AF_INET &&
+                strcmp(ifa->ifa_name, ifname) == 0) {
+            addr = ((struct sockaddr_in *)ifa->ifa_addr)->sin_addr.s_addr;
+            break;
+        }
+    }
+    freeifaddrs(ifaddr);
+    return addr;
+}
+
+int rpc_context_paths(RpcContext ctx, const char *ifnames) {
+    Context *cx = (Context *)ctx;
+    unsigned ifindex[MAX_PATHS];
+    char buf[MAX_PATHS * (IF_NAMESIZE + 1)];
+    char *name, *p;
+    in_addr_t src = 0;
+    unsigned n = 0;
+
+    if (cx == NULL)
+        return 0;
+    if (ifnames != NULL && *ifnames != '\0') {
+        if (cx->tp->ops->send_via == NULL ||
+                strlen(ifnames) >= sizeof(buf))
+            return 0;
+        strcpy(buf, ifnames);
+        for (name = strtok_r(buf, ",", &p); name != NULL;
+                name = strtok_r(NULL, ",", &p)) {
+            if (n == MAX_PATHS || (ifindex[n] = if_nametoindex(name)) == 0)
+                return 0;
+            if (n++ == 0 && (src = if_address(name)) == 0)
+                return 0;
+        }
+    }
+    ctable_lock(cx->ct);
+    memcpy(cx->ifindex, ifindex, n * sizeof(unsigned));
+    cx->npaths = n;
+    cx->tp->src = src;
+    ptable_paths(ctable_peers(cx->ct), n);
+    ctable_unlock(cx->ct);
+    return 1;
+}
+
+int rpc_pin_thread(int cpu) {
+    return affinity_pin(pthread_self(), cpu);
 }
 
 /*
@@ -712,103 +1582,282 @@ int rpc_init(unsigned short port) {
  *
  */
 int rpc_reinit(unsigned short port) {
+    Context *cx = DEFAULT;
+
+    ctable_purge(cx->ct);
+    transport_close(cx->tp);
+    return common_init(cx, udp_open(port));
+}
+
+int rpc_set_allocator(void *(*mallocf)(size_t), void (*freef)(void *)) {
+    return srpc_set_allocator(mallocf, freef);
+}
+
+int rpc_socket_config(int rcvbytes, int sndbytes) {
+    if (rcvbytes < 0 || sndbytes < 0)
+        return 0;
+    __atomic_store_n(&rcvBuf, rcvbytes, __ATOMIC_RELAXED);
+    __atomic_store_n(&sndBuf, sndbytes, __ATOMIC_RELAXED);
+    return 1;
+}
+
+int rpc_congestion_config(int flags) {
+    int pflags = 0;
+
+    if ((flags & ~(RPC_CC_WINDOW | RPC_CC_PACING)) != 0)
+        return 0;
+    if (flags & RPC_CC_WINDOW)
+        pflags |= PEER_WINDOW;
+    if (flags & RPC_CC_PACING)
+        pflags |= PEER_PACING;
+    peer_config(pflags);
+    return 1;
+}
+
+int rpc_loss_config(unsigned percent) {
+    if (percent > 100)
+        return 0;
+    __atomic_store_n(&lossPercent, percent, __ATOMIC_RELAXED);
+    return 1;
+}
+
+int rpc_arena_config(size_t regionSize, int flags) {
+    int aflags = 0;
 
-    ctable_purge();
-    close(my_sock);
-    return common_init(port);
+    if (flags & RPC_ARENA_HUGEPAGES)
+        aflags |= ARENA_HUGEPAGES;
+    if (flags & RPC_ARENA_MLOCK)
+        aflags |= ARENA_MLOCK;
+    return arena_config(regionSize, aflags);
 }
 
 void rpc_suspend() {
-    ctable_lock();
+    ctable_lock(DEFAULT->ct);
 }
 
 void rpc_resume() {
-    ctable_unlock();
+    ctable_unlock(DEFAULT->ct);
 }
 
 void rpc_details(char *ipaddr, unsigned short *port) {
+    rpc_context_details((RpcContext)DEFAULT, ipaddr, port);
+}
+
+void rpc_context_details(RpcContext ctx, char *ipaddr, unsigned short *port) {
     strcpy(ipaddr, my_address);
-    *port = my_port;
+    *port = (ctx == NULL) ? 0 : ((Context *)ctx)->port;
 }
 
-/*
- * this routine needs to be rewritten to use gethostinfo
- */
 void rpc_reverselu(char *ipaddr, char *hostname) {
-    struct hostent *hp;
-    struct in_addr addr;
+    struct sockaddr_in addr;
 
-    inet_aton(ipaddr, &addr);
-    if ((hp = gethostbyaddr((void *)&addr, sizeof(addr), AF_INET)) != NULL)
-        strcpy(hostname, hp->h_name);
-    else
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    if (inet_aton(ipaddr, &addr.sin_addr) == 0 ||
+            getnameinfo((struct sockaddr *)&addr, sizeof(addr),
+                        hostname, NI_MAXHOST, NULL, 0, NI_NAMEREQD) != 0)
         strcpy(hostname, ipaddr);
 }
 
-static RpcEndpoint *rpc_socket(char *host, unsigned short port,
-                               unsigned long subport) {
-    RpcEndpoint *s;
-    struct hostent *hp = gethostbyname(host);
+int rpc_resolve(char *hosts[], int n) {
+    return resolve_async(hosts, n);
+}
 
-    if (hp == NULL)
-        s = NULL;
-    else
-        s = (RpcEndpoint *)malloc(sizeof(RpcEndpoint));
-    if (s != NULL) {
-        memset(&s->addr, 0, sizeof(struct sockaddr_in));
-        memcpy(&(s->addr).sin_addr, hp->h_addr_list[0], hp->h_length);
-        (s->addr).sin_family = AF_INET;
-        (s->addr).sin_port = htons(port);
+/*
+ * fill in the address of `s' for host:port; called without the table lock,
+ * since the lookup may take a long time
+ */
+static int rpc_socket(RpcEndpoint *s, char *host, unsigned short port) {
+    memset(&s->addr, 0, sizeof(struct sockaddr_in));
+    if (! resolve_host(host, &s->addr))
+        return 0;
+    (s->addr).sin_family = AF_INET;
+    (s->addr).sin_port = htons(port);
 #ifdef HAVE_SOCKADDR_LEN
-        (s->addr).sin_len = sizeof(struct sockaddr_in);
+    (s->addr).sin_len = sizeof(struct sockaddr_in);
 #endif /* HAVE_SOCKADDR_LEN */
-        s->subport = subport;
-    }
-    return s;
+    return 1;
 }
 
-RpcConnection rpc_connect(char *host, unsigned short port,
-                          char *svcName, unsigned long seqno) {
+/*
+ * send a CONNECT for `svcName' to `nep' and insert a record for the new
+ * connection into the table; called with the table locked
+ * returns the connection's identifier, or 0 if it could not be created
+ */
+static unsigned long connect_send(Context *cx, RpcEndpoint *nep,
+                                  char *svcName, unsigned long seqno) {
     ConnectPayload *buf;
-    RpcEndpoint *nep;
-    int len = sizeof(PayloadHeader) + 1;	/* room for '\0' */
     CRecord *cr;
-    unsigned long subport;
-    unsigned long states[2] = {ST_IDLE, ST_TIMEDOUT};
-    unsigned long id = 0;
-
-    ctable_lock();
-    subport = ctable_newSubport();
-    nep = rpc_socket(host, port, subport);
-    if (nep != NULL) {
-        id = gen_conn_id();
-        len += strlen(svcName);			/* room for svcName */
-        buf = (ConnectPayload *)malloc(len);
-        cp_complete((ControlPayload *)buf, nep->subport, CONNECT, seqno, 1, 1);
-        strcpy(buf->sname, svcName);
-        cr = crecord_create(nep, seqno);
-        crecord_setCID(cr, id);
-        crecord_setPayload(cr, buf, len, ATTEMPTS, TICKS);
+    int len = sizeof(PayloadHeader) + 1;	/* room for '\0' */
+    unsigned long id;
+
+    if ((cr = crecord_create(nep, seqno)) == NULL)
+        return 0;
+    if (! crecord_activate(cr)) {
+        crecord_destroy(cr);
+        return 0;
+    }
+    id = gen_conn_id(cx);
+    len += strlen(svcName);			/* room for svcName */
+    buf = (ConnectPayload *)srpc_malloc(len);
+    cp_complete((ControlPayload *)buf, nep->subport, CONNECT, seqno, 1, 1);
+    strcpy(buf->sname, svcName);
+    crecord_setCID(cr, id);
+    crecord_setPayload(cr, buf, len, ATTEMPTS, TICKS);
 #ifdef LOG
-        dumpsockNpacket(&(nep->addr), (DataPayload *)buf, "rpc_connect");
+    dumpsockNpacket(&(nep->addr), (DataPayload *)buf, "rpc_connect");
 #endif /* LOG */
-        (void) send_payload(nep, buf, len);
-        crecord_setState(cr, ST_CONNECT_SENT);
-        ctable_insert(cr);
-        if (crecord_waitForState(cr, states, 2) == ST_TIMEDOUT) {
-            ctable_remove(cr);
-            crecord_destroy(cr);
-            id = 0;
-        }
-        ctable_unlock();
+    (void) send_payload(cx, &cr->ep, buf, len);
+    crecord_setState(cr, ST_CONNECT_SENT);
+    ctable_insert(cx->ct, cr);
+    return id;
+}
+
+/*
+ * wait for the CONNECT sent for connection `id' to be accepted; a record
+ * that timed out is removed, unless the timer has already purged it while
+ * the caller was waiting for another connection; called with the table
+ * locked
+ * returns `id' if the connection was accepted, 0 otherwise
+ */
+static unsigned long connect_wait(Context *cx, unsigned long id) {
+    CRecord *cr;
+    unsigned long states[2] = {ST_IDLE, ST_TIMEDOUT};
+
+    if (id == 0 || (cr = ctable_look_id(cx->ct, id)) == NULL)
+        return 0;
+    if (crecord_waitForState(cr, states, 2) == ST_TIMEDOUT) {
+        ctable_remove(cx->ct, cr);
+        crecord_destroy(cr);
+        return 0;
     }
+    return id;
+}
+
+RpcConnection rpc_connect(char *host, unsigned short port,
+                          char *svcName, unsigned long seqno) {
+    return rpc_context_connect((RpcContext)DEFAULT, host, port, svcName,
+                               seqno);
+}
+
+RpcConnection rpc_context_connect(RpcContext ctx, char *host,
+                                  unsigned short port, char *svcName,
+                                  unsigned long seqno) {
+    Context *cx = (Context *)ctx;
+    RpcEndpoint nep;
+    unsigned long id;
+
+    if (cx == NULL || ! rpc_socket(&nep, host, port))
+        return (RpcConnection)0;
+    ctable_lock(cx->ct);
+    nep.subport = ctable_newSubport(cx->ct);
+    id = connect_wait(cx, connect_send(cx, &nep, svcName, seqno));
+    ctable_unlock(cx->ct);
     return (RpcConnection)id;
 }
 
+int rpc_connect_many(RpcTarget targets[], int n, unsigned long seqno) {
+    return rpc_context_connect_many((RpcContext)DEFAULT, targets, n, seqno);
+}
+
+int rpc_context_connect_many(RpcContext ctx, RpcTarget targets[], int n,
+                             unsigned long seqno) {
+    Context *cx = (Context *)ctx;
+    RpcEndpoint *eps;
+    char **hosts;
+    int *ok;
+    int i, first, count = 0;
+
+    for (i = 0; i < n; i++)
+        targets[i].rpc = (RpcConnection)0;
+    if (cx == NULL)
+        return 0;
+    eps = (RpcEndpoint *)malloc(n * sizeof(RpcEndpoint));
+    hosts = (char **)malloc(n * sizeof(char *));
+    ok = (int *)malloc(n * sizeof(int));
+    if (eps == NULL || hosts == NULL || ok == NULL) {
+        free(eps);
+        free(hosts);
+        free(ok);
+        return 0;
+    }
+    for (i = 0; i < n; i++)
+        hosts[i] = targets[i].host;
+    resolve_many(hosts, n, ok);			/* fills the cache */
+    for (i = 0; i < n; i++)
+        ok[i] = ok[i] && rpc_socket(&eps[i], targets[i].host, targets[i].port);
+    ctable_lock(cx->ct);
+    for (i = 0, first = 0; i < n; i++) {
+        if (ok[i]) {
+            eps[i].subport = ctable_newSubport(cx->ct);
+            targets[i].rpc = (RpcConnection)connect_send(cx, &eps[i],
+                             targets[i].svcName, seqno);
+        }
+        if (i + 1 - first >= CONNECT_WINDOW) {	/* window full - wait */
+            targets[first].rpc = (RpcConnection)connect_wait(cx,
+                                 (unsigned long)targets[first].rpc);
+            count += (targets[first++].rpc != NULL);
+        }
+    }
+    for (; first < n; first++) {
+        targets[first].rpc = (RpcConnection)connect_wait(cx,
+                             (unsigned long)targets[first].rpc);
+        count += (targets[first].rpc != NULL);
+    }
+    ctable_unlock(cx->ct);
+    free(eps);
+    free(hosts);
+    free(ok);
+    return count;
+}
+
 #define SEQNO_LIMIT 1000000000
 #define SEQNO_START 0
-int rpc_call(RpcConnection rpc, const struct qdecl *q, unsigned qlen,
-             void *resp, unsigned rsize, unsigned *rlen) {
+/*
+ * read the transport of `cx' in the calling thread until the state of `cr'
+ * becomes one of the `n' `states' or its poll time expires, so that the
+ * caller processes its own response instead of being woken by the reader;
+ * packets for other connections are processed just as the reader would
+ * must be called with the table locked; returns with it locked
+ */
+static void poll_own(Context *cx, CRecord *cr, unsigned long *states, int n) {
+    unsigned long budget = 1000 * (unsigned long)cr->poll;
+    unsigned long start = spin_clock(), st, i;
+    struct sockaddr_in c_addr;
+    char *buf = NULL;
+    int j, k;
+
+    ctable_unlock(cx->ct);		/* also transmits the query */
+    for (i = 0; spin_clock() - start < budget; i++) {
+        st = __atomic_load_n(&cr->state, __ATOMIC_ACQUIRE);
+        for (j = 0; j < n; j++)
+            if (st == states[j])
+                break;
+        if (j < n)
+            break;
+        if (buf == NULL && (buf = (char *)srpc_malloc(PKT_SIZE)) == NULL)
+            break;
+        memset(&c_addr, 0, sizeof(c_addr));
+        k = transport_recv(cx->tp, buf, PKT_SIZE, &c_addr, 0);
+        if (k >= 0)
+            buf = receive(cx, buf, k, &c_addr);
+        else
+            spin_pause(i);
+    }
+    srpc_free(buf);
+    ctable_lock(cx->ct);
+}
+
+/*
+ * common body of rpc_call() and rpc_call_borrow()
+ * if `ubuf' is non-NULL, it is posted so that the reader writes the response
+ * directly into it; otherwise, or if the response does not fit in `usize'
+ * bytes, the response is left in a library buffer returned via `rbuf'
+ * returns 1 if a response was received, 0 otherwise
+ */
+static int call(RpcConnection rpc, const struct qdecl *q, unsigned qlen,
+                void *ubuf, unsigned usize, unsigned *rlen,
+                DataPayload **rbuf) {
     DataPayload *buf;
     RpcEndpoint *ep;
     unsigned short size = sizeof(PayloadHeader) + sizeof(DataHeader) + qlen;
@@ -816,192 +1865,489 @@ int rpc_call(RpcConnection rpc, const struct qdecl *q, unsigned qlen,
     unsigned long qstates[2] = {ST_IDLE, ST_TIMEDOUT};
     unsigned long fstates[2] = {ST_FACK_RECEIVED, ST_TIMEDOUT};
     int result = 0;
+    Context *cx;
     CRecord *cr;
     unsigned char fnum;
     unsigned char nfrags;
-    unsigned blen;
     unsigned char *cp = (unsigned char *)q->buf;
 
     if (q->size < (int)qlen) {
         fprintf(stderr, "rpc_call() - buffer overrun by caller\n");
         return result;
     }
-    ctable_lock();
-    if ((cr = ctable_look_id((unsigned long)rpc)) == NULL) {
-        ctable_unlock();
+    if ((cx = conn_context(rpc)) == NULL)
+        return result;
+    ctable_lock(cx->ct);
+    if ((cr = ctable_look_id(cx->ct, (unsigned long)rpc)) == NULL ||
+            (cr = await_window(cx, cr)) == NULL) {
+        ctable_unlock(cx->ct);
         return result;
     }
-    ep = cr->ep;
+    ep = &cr->ep;
     if (cr->state == ST_IDLE) {
+        /* held across ST_IDLE until the response has been collected */
+        if (! crecord_activate(cr)) {
+            ctable_unlock(cx->ct);
+            return result;
+        }
+        cr->act->held = 1;
         if (cr->seqno >= SEQNO_LIMIT) {
             ControlPayload *cp;
             cr->seqno = SEQNO_START;
-            cp = (ControlPayload *)malloc(CP_SIZE);
+            cp = (ControlPayload *)srpc_malloc(CP_SIZE);
             cp_complete(cp, ep->subport, SEQNO, SEQNO_START, 1, 1);
             crecord_setPayload(cr, cp, CP_SIZE, ATTEMPTS, TICKS);
-            (void)send_payload(ep, cp, CP_SIZE);
+            (void)send_payload(cx, ep, cp, CP_SIZE);
             crecord_setState(cr, ST_SEQNO_SENT);
             if (crecord_waitForState(cr, qstates, 2) == ST_TIMEDOUT) {
-                ctable_unlock();
+                ctable_unlock(cx->ct);
                 return result;
             }
         }
         cr->seqno++;
         seqno = cr->seqno;
         nfrags = (qlen - 1) / FR_SIZE + 1;
-        for (fnum = 1; fnum < nfrags; fnum++) {
-            size = sizeof(PayloadHeader) + sizeof(DataHeader) + FR_SIZE;
-            buf = (DataPayload *)malloc(size);
-            cp_complete((ControlPayload *)buf, ep->subport, FRAGMENT,
-                        seqno, fnum, nfrags);
-            buf->dhdr.tlen = htons(qlen);
-            buf->dhdr.flen = htons(FR_SIZE);
-            memcpy(buf->data, &(cp[FR_SIZE*(fnum-1)]), FR_SIZE);
-            cr->lastFrag = fnum;
-            crecord_setPayload(cr, buf, size, ATTEMPTS, TICKS);
-            (void)send_payload(ep, buf, size);
-            crecord_setState(cr, ST_FRAGMENT_SENT);
+        /* one transmit buffer carries every fragment and the final query */
+        if ((buf = (DataPayload *)srpc_malloc(PKT_SIZE)) == NULL) {
+            cr->act->held = 0;
+            crecord_release(cr);
+            ctable_unlock(cx->ct);
+            return result;
+        }
+        for (fnum = 1; fnum < nfrags; fnum = cr->act->lastFrag + 1) {
+            send_group(cx, cr, buf, QUERY, cp, qlen, fnum, nfrags);
             if (crecord_waitForState(cr, fstates, 2) == ST_TIMEDOUT) {
-                ctable_unlock();
+                ctable_unlock(cx->ct);
                 return result;
             }
         }
-        blen = qlen - FR_SIZE * (nfrags - 1);
-        size = sizeof(PayloadHeader) + sizeof(DataHeader) + blen;
-        buf = (DataPayload *)malloc(size);
-        cp_complete((ControlPayload *)buf, ep->subport, QUERY,
-                    seqno, fnum, nfrags);
-        buf->dhdr.tlen = htons(qlen);
-        buf->dhdr.flen = htons(blen);
-        memcpy(buf->data, &(cp[FR_SIZE*(fnum-1)]), blen);
+        size = data_packet(buf, ep->subport, QUERY, seqno, cp, qlen,
+                           fnum, nfrags);
+        buf->hdr.group = cr->group;
         crecord_setPayload(cr, buf, size, ATTEMPTS, TICKS);
-        (void)send_payload(ep, buf, size);
+        cr->act->ubuf = (unsigned char *)ubuf;
+        cr->act->ulen = usize;
+        (void)send_data(cx, cr, buf, size, 0);
         crecord_setState(cr, ST_QUERY_SENT);
-        if (crecord_waitForState(cr, qstates, 2) == ST_TIMEDOUT) {
-            ctable_unlock();
-            return result;
+        if (cr->poll > 0)
+            poll_own(cx, cr, qstates, 2);
+        if (crecord_waitForState(cr, qstates, 2) == ST_IDLE) {
+            *rbuf = (DataPayload *)cr->act->resp;
+            cr->act->resp = NULL;
+            if (*rbuf != NULL)
+                *rlen = ntohs((*rbuf)->dhdr.tlen);
+            else
+                *rlen = cr->act->ulen;
+            result = 1;
         }
-        buf = (DataPayload *)cr->resp;
-        cr->resp = NULL;
-        if (cr->state == ST_IDLE) {
-            size = ntohs(buf->dhdr.tlen);
-            if (size <= rsize) {
-                memcpy(resp, buf->data, size);
-                *rlen = size;
-                result = 1;
-            } else
-                result = 0;
-        }
-        free(buf);
+        cr->act->ubuf = NULL;
+        cr->act->held = 0;
+        crecord_release(cr);
+    }
+    ctable_unlock(cx->ct);
+    return result;
+}
+
+int rpc_call(RpcConnection rpc, const struct qdecl *q, unsigned qlen,
+             void *resp, unsigned rsize, unsigned *rlen) {
+    DataPayload *rbuf = NULL;
+    unsigned n;
+    int result;
+
+    result = call(rpc, q, qlen, resp, rsize, &n, &rbuf);
+    if (rbuf != NULL) {			/* not written in place */
+        if (n <= rsize)
+            memcpy(resp, rbuf->data, n);
+        else
+            result = 0;
+        srpc_free(rbuf);
     }
-    ctable_unlock();
+    if (result)
+        *rlen = n;
     return result;
 }
 
+RpcBuffer rpc_call_borrow(RpcConnection rpc, const struct qdecl *q,
+                          unsigned qlen, void **resp, unsigned *rlen) {
+    DataPayload *rbuf = NULL;
+
+    if (! call(rpc, q, qlen, NULL, 0, rlen, &rbuf))
+        return NULL;
+    *resp = (void *)rbuf->data;
+    return (RpcBuffer)rbuf;
+}
+
+void rpc_call_release(RpcBuffer buf) {
+    srpc_free(buf);
+}
+
+RpcCall rpc_call_async(RpcConnection rpc, const struct qdecl *q,
+                       unsigned qlen, void *resp, unsigned rsize,
+                       RpcCallback cb, RpcCQ cq, void *arg) {
+    AsyncCall *ac;
+    Context *cx;
+    CRecord *cr;
+    int started;
+
+    if (q->size < (int)qlen) {
+        fprintf(stderr, "rpc_call_async() - buffer overrun by caller\n");
+        return NULL;
+    }
+    if ((cb == NULL && cq == NULL) || (cx = conn_context(rpc)) == NULL)
+        return NULL;
+    if ((ac = (AsyncCall *)srpc_malloc(sizeof(AsyncCall))) == NULL)
+        return NULL;
+    ac->ev.call = (RpcCall)ac;
+    ac->ev.arg = arg;
+    ac->ev.status = 0;
+    ac->ev.resp = resp;
+    ac->ev.rlen = 0;
+    ac->cb = cb;
+    ac->cq = cq;
+    ac->qlen = qlen;
+    ac->last = QUERY;
+    ac->fnum = 0;
+    ac->nfrags = (qlen - 1) / FR_SIZE + 1;
+    ctable_lock(cx->ct);
+    cr = ctable_look_id(cx->ct, (unsigned long)rpc);
+    if (cr == NULL || cr->state != ST_IDLE ||
+            (cr->act != NULL && cr->act->async != NULL) ||
+            ! crecord_activate(cr)) {
+        ctable_unlock(cx->ct);
+        srpc_free(ac);
+        return NULL;
+    }
+    cr->act->async = ac;
+    cr->act->ubuf = (unsigned char *)resp;
+    cr->act->ulen = rsize;
+    if (ac->nfrags == 1 && cr->seqno < SEQNO_LIMIT) {
+        /* sent at once, so the caller's query need not be copied */
+        ac->query = (unsigned char *)q->buf;
+        started = async_begin(cx, cr);
+        ac->query = NULL;
+    } else if ((ac->query = (unsigned char *)srpc_malloc(qlen)) == NULL) {
+        started = 0;
+    } else {
+        memcpy(ac->query, q->buf, qlen);
+        if (cr->seqno >= SEQNO_LIMIT) {
+            ControlPayload *cp;
+            cr->seqno = SEQNO_START;
+            if ((cp = (ControlPayload *)srpc_malloc(CP_SIZE)) == NULL) {
+                started = 0;
+            } else {
+                cp_complete(cp, cr->ep.subport, SEQNO, SEQNO_START, 1, 1);
+                crecord_setPayload(cr, cp, CP_SIZE, ATTEMPTS, TICKS);
+                (void)send_payload(cx, &cr->ep, cp, CP_SIZE);
+                crecord_setState(cr, ST_SEQNO_SENT);
+                started = 1;	/* the SACK sends the query */
+            }
+        } else
+            started = async_begin(cx, cr);
+    }
+    if (! started) {
+        cr->act->async = NULL;
+        cr->act->ubuf = NULL;
+        crecord_release(cr);
+        srpc_free(ac->query);
+        srpc_free(ac);
+        ac = NULL;
+    }
+    ctable_unlock(cx->ct);
+    return (RpcCall)ac;
+}
+
 /* disconnect from target
  */
 void rpc_disconnect(RpcConnection rpc) {
     CRecord *cr;
     ControlPayload *cp;
     RpcEndpoint *ep;
+    Context *cx;
     //unsigned long states[1] = {ST_TIMEDOUT};
 
-    ctable_lock();
-    if ((cr = ctable_look_id((unsigned long)rpc)) == NULL) {
-        ctable_unlock();
+    if ((cx = conn_context(rpc)) == NULL)
+        return;
+    ctable_lock(cx->ct);
+    if ((cr = ctable_look_id(cx->ct, (unsigned long)rpc)) == NULL ||
+            ! crecord_activate(cr)) {
+        ctable_unlock(cx->ct);
         return;
     }
-    ep = cr->ep;
-    cp = (ControlPayload *)malloc(CP_SIZE);
+    ep = &cr->ep;
+    cp = (ControlPayload *)srpc_malloc(CP_SIZE);
     cp_complete(cp, ep->subport, DISCONNECT, cr->seqno, 1, 1);
     crecord_setPayload(cr, cp, CP_SIZE, ATTEMPTS, TICKS);
-    (void) send_payload(ep, cp, CP_SIZE);
+    (void) send_payload(cx, ep, cp, CP_SIZE);
     crecord_setState(cr, ST_DISCONNECT_SENT);
     //(void) crecord_waitForState(cr, states, 1);
-    ctable_unlock();
+    ctable_unlock(cx->ct);
 }
 
 RpcService *rpc_offer(char *svcName) {
-    SRecord *s = stable_create(svcName);
+    return rpc_context_offer((RpcContext)DEFAULT, svcName);
+}
+
+RpcService rpc_context_offer(RpcContext ctx, char *svcName) {
+    Context *cx = (Context *)ctx;
+    SRecord *s;
+
+    if (cx == NULL)
+        return NULL;
+    if ((s = stable_create(cx->st, svcName)) != NULL)
+        s->s_ctx = cx;
     return (RpcService) s;
 }
 
+int rpc_serve_inline(RpcService rps, RpcInlineHandler handler, void *arg) {
+    SRecord *sr = (SRecord *)rps;
+
+    if (sr == NULL)
+        return 0;
+    ctable_lock(sr->s_ctx->ct);
+    sr->s_inlineArg = arg;
+    sr->s_inline = handler;
+    ctable_unlock(sr->s_ctx->ct);
+    return 1;
+}
+
+int rpc_serve_async(RpcService rps, RpcDispatch dispatch, void *arg) {
+    SRecord *sr = (SRecord *)rps;
+    unsigned self;
+
+    if (sr == NULL)
+        return 0;
+    ctable_lock(sr->s_ctx->ct);
+    sr->s_dispatchArg = arg;
+    sr->s_dispatch = dispatch;
+    ctable_unlock(sr->s_ctx->ct);
+    /* calls accepted before the change, but for the caller's own */
+    self = (dispatching == sr);
+    while (__atomic_load_n(&sr->s_dispatching, __ATOMIC_ACQUIRE) > self)
+        sched_yield();
+    return 1;
+}
+
+int rpc_connection_spin(RpcConnection rpc, unsigned usecs) {
+    Context *cx;
+    CRecord *cr;
+
+    if ((cx = conn_context(rpc)) == NULL)
+        return 0;
+    ctable_lock(cx->ct);
+    if ((cr = ctable_look_id(cx->ct, (unsigned long)rpc)) != NULL)
+        crecord_setSpin(cr, usecs);
+    ctable_unlock(cx->ct);
+    return (cr != NULL);
+}
+
+int rpc_connection_poll(RpcConnection rpc, unsigned usecs) {
+    Context *cx;
+    CRecord *cr;
+
+    if ((cx = conn_context(rpc)) == NULL)
+        return 0;
+    ctable_lock(cx->ct);
+    if ((cr = ctable_look_id(cx->ct, (unsigned long)rpc)) != NULL)
+        cr->poll = (usecs < 65535) ? usecs : 65535;
+    ctable_unlock(cx->ct);
+    return (cr != NULL);
+}
+
+int rpc_connection_parity(RpcConnection rpc, unsigned group) {
+    Context *cx;
+    CRecord *cr;
+
+    if (group > MAX_GROUP || (cx = conn_context(rpc)) == NULL)
+        return 0;
+    ctable_lock(cx->ct);
+    if ((cr = ctable_look_id(cx->ct, (unsigned long)rpc)) != NULL)
+        cr->group = (unsigned char)group;
+    ctable_unlock(cx->ct);
+    return (cr != NULL);
+}
+
+int rpc_connection_idle(RpcConnection rpc) {
+    Context *cx;
+    CRecord *cr;
+    int ans;
+
+    if ((cx = conn_context(rpc)) == NULL)
+        return 0;
+    ctable_lock(cx->ct);
+    cr = ctable_look_id(cx->ct, (unsigned long)rpc);
+    ans = (cr != NULL && cr->state == ST_IDLE);
+    ctable_unlock(cx->ct);
+    return ans;
+}
+
+int rpc_service_spin(RpcService rps, unsigned usecs) {
+    SRecord *sr = (SRecord *)rps;
+
+    if (sr == NULL)
+        return 0;
+    squeue_spin(sr->s_queue, usecs);
+    return 1;
+}
+
+void rpc_stats(RpcStats *st) {
+    unsigned long n, nsecs, max, waits, deferred, sent, failed;
+    unsigned i, nc = __atomic_load_n(&ncontexts, __ATOMIC_ACQUIRE);
+
+    st->pktsSent = 0;
+    st->pktsDeferred = 0;
+    st->sendFailures = 0;
+    st->pktsReceived = 0;
+    st->pktsPredicted = 0;
+    st->pktsRetried = 0;
+    st->pktsDropped = 0;
+    st->lockHolds = 0;
+    st->lockNsecs = 0;
+    st->lockMaxNsecs = 0;
+    st->windowWaits = 0;
+    st->retriesDeferred = 0;
+    st->fragsRepaired = 0;
+    st->pingsSent = 0;
+    for (i = 0; i < nc; i++) {
+        Context *cx = contexts[i];
+        ctable_lock(cx->ct);
+        st->pktsReceived += cx->received;
+        st->pktsPredicted += cx->predicted;
+        st->pktsRetried += cx->retried;
+        st->fragsRepaired += cx->repaired;
+        st->pingsSent += cx->pinged;
+        ptable_stats(ctable_peers(cx->ct), &waits, &deferred);
+        st->windowWaits += waits;
+        st->retriesDeferred += deferred;
+        ctable_unlock(cx->ct);
+        st->pktsDropped += transport_dropped(cx->tp);
+        outbox_stats(cx->tp, &sent, &deferred, &failed);
+        st->pktsSent += sent;
+        st->pktsDeferred += deferred;
+        st->sendFailures += failed;
+        ctable_stats(cx->ct, &n, &nsecs, &max);
+        st->lockHolds += n;
+        st->lockNsecs += nsecs;
+        if (max > st->lockMaxNsecs)
+            st->lockMaxNsecs = max;
+    }
+}
+
 void rpc_withdraw(UNUSED RpcService rps) {
     /* do nothing for now */
 }
 
-unsigned rpc_query(RpcService rps, RpcEndpoint *ep, void *qb, unsigned len) {
+RpcBuffer rpc_query_borrow(RpcService rps, RpcEndpoint *ep, void **qb,
+                           unsigned *len) {
     DataPayload *dp;
     RpcEndpoint *tep;
     SRecord *sr = (SRecord *)rps;
-    int size;
-    unsigned n;
 
-    tsl_remove(sr->s_queue, (void **)&tep, (void **)&dp, &size);
+    squeue_get(sr->s_queue, (void **)&tep, (void **)&dp);
     *ep = *tep;
-    n = ntohs(dp->dhdr.tlen);
+    *qb = (void *)dp->data;
+    *len = ntohs(dp->dhdr.tlen);
+    return (RpcBuffer)dp;
+}
+
+#define BATCH_MAX 64
+unsigned rpc_query_batch(RpcService rps, RpcQuery *qs, unsigned max) {
+    void *teps[BATCH_MAX];
+    void *dps[BATCH_MAX];
+    unsigned long stamps[BATCH_MAX];
+    unsigned long now;
+    SRecord *sr = (SRecord *)rps;
+    unsigned i, n;
+
+    if (max > BATCH_MAX)
+        max = BATCH_MAX;
+    n = squeue_get_batch(sr->s_queue, teps, dps, stamps, max);
+    now = squeue_clock();
+    for (i = 0; i < n; i++) {
+        DataPayload *dp = (DataPayload *)dps[i];
+        qs[i].ep = *(RpcEndpoint *)teps[i];
+        qs[i].buf = (RpcBuffer)dp;
+        qs[i].data = (void *)dp->data;
+        qs[i].len = ntohs(dp->dhdr.tlen);
+        qs[i].wait = (now > stamps[i]) ? now - stamps[i] : 0;
+    }
+    return n;
+}
+
+void rpc_query_release(RpcBuffer buf) {
+    srpc_free(buf);
+}
+
+unsigned rpc_query(RpcService rps, RpcEndpoint *ep, void *qb, unsigned len) {
+    RpcBuffer buf;
+    void *data;
+    unsigned n;
+
+    if ((buf = rpc_query_borrow(rps, ep, &data, &n)) == NULL)
+        return 0;
     if (n <= len)
-        memcpy(qb, dp->data, n);
+        memcpy(qb, data, n);
     else
         n = 0;
-    free(dp);
+    rpc_query_release(buf);
     return n;
 }
 
-int rpc_response(UNUSED RpcService rps, RpcEndpoint *ep, void *rb,
+int rpc_response(RpcService rps, RpcEndpoint *ep, void *rb,
                  unsigned len) {
     DataPayload *dp;
-
+    SRecord *sr = (SRecord *)rps;
+    Context *cx = (sr != NULL) ? sr->s_ctx : DEFAULT;
     int ans = 0;
     CRecord *cr;
     unsigned char *cp = (unsigned char *)rb;
     unsigned char fnum, nfrags;
-    int size, blen;
+    int size;
     unsigned long fstates[2] = {ST_FACK_RECEIVED, ST_TIMEDOUT};
 
-    ctable_lock();
-    cr = ctable_look_ep(ep);
+    if (len == 0 || len > MSG_SIZE - DP_HDR_SIZE)	/* tlen is 16 bits */
+        return 0;
+    ctable_lock(cx->ct);
+    cr = ctable_look_ep(cx->ct, ep);
+    if (cr != NULL && cr->state == ST_QACK_SENT && ! on_system_thread(cx))
+        cr = await_window(cx, cr);
     if (cr != NULL && cr->state == ST_QACK_SENT) {
         nfrags = (len - 1) / FR_SIZE + 1;
-        for (fnum = 1; fnum  < nfrags; fnum++) {
-            size = sizeof(PayloadHeader) + sizeof(DataHeader) + FR_SIZE;
-            dp = (DataPayload *)malloc(size);
-            cp_complete((ControlPayload *)dp, ep->subport, FRAGMENT,
-                        cr->seqno, fnum, nfrags);
-            dp->dhdr.tlen = htons(len);
-            dp->dhdr.flen = htons(FR_SIZE);
-            memcpy(dp->data, &(cp[FR_SIZE*(fnum-1)]), FR_SIZE);
-            cr->lastFrag = fnum;
-            crecord_setPayload(cr, dp, size, ATTEMPTS, TICKS);
-            (void)send_payload(ep, dp, size);
-            crecord_setState(cr, ST_FRAGMENT_SENT);
+        /* one transmit buffer carries every fragment and the response */
+        if ((dp = (DataPayload *)srpc_malloc(PKT_SIZE)) == NULL) {
+            ctable_unlock(cx->ct);
+            return 0;
+        }
+        if (nfrags > 1 && on_system_thread(cx)) {
+            ans = respond_async(cx, cr, dp, cp, len, nfrags);
+            ctable_unlock(cx->ct);
+            return ans;
+        }
+        for (fnum = 1; fnum < nfrags; fnum = cr->act->lastFrag + 1) {
+            send_group(cx, cr, dp, RESPONSE, cp, len, fnum, nfrags);
             if (crecord_waitForState(cr, fstates, 2) == ST_TIMEDOUT) {
-                ctable_unlock();
+                ctable_unlock(cx->ct);
                 return 0;
             }
         }
-        blen = len - FR_SIZE * (nfrags - 1);
-        size = sizeof(PayloadHeader) + sizeof(DataHeader) + blen;
-        dp = (DataPayload *)malloc(size);
-        cp_complete((ControlPayload *)dp, ep->subport, RESPONSE,
-                    cr->seqno, fnum, nfrags);
-        dp->dhdr.tlen = htons(len);
-        dp->dhdr.flen = htons(blen);
-        memcpy(dp->data, &(cp[FR_SIZE*(fnum-1)]), blen);
+        size = data_packet(dp, ep->subport, RESPONSE, cr->seqno, cp, len,
+                           fnum, nfrags);
         crecord_setPayload(cr, dp, size, ATTEMPTS, TICKS);
-        (void)send_payload(cr->ep, dp, size);
+        (void)send_data(cx, cr, dp, size, 0);
         crecord_setState(cr, ST_RESPONSE_SENT);
         ans = 1;
     }
-    ctable_unlock();
+    ctable_unlock(cx->ct);
     return ans;
 }
 
 void rpc_shutdown(void) {
     void *status;
+    unsigned i;
 
-    pthread_cancel(timerThread);
-    pthread_cancel(readThread);
-    pthread_join(timerThread, &status);
-    pthread_join(readThread, &status);
+    for (i = 0; i < ncontexts; i++) {
+        pthread_cancel(contexts[i]->timerThread);
+        pthread_cancel(contexts[i]->readThread);
+        pthread_join(contexts[i]->timerThread, &status);
+        pthread_join(contexts[i]->readThread, &status);
+    }
 }
@@ -37,9 +37,27 @@
 #define _SRPC_H_
 
 #include "endpoint.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 typedef void *RpcConnection;
 typedef void *RpcService;
+typedef void *RpcBuffer;
+typedef void *RpcPool;
+typedef void *RpcContext;
+
+/*
+ * a connection to be established by rpc_connect_many()
+ */
+typedef struct rpc_target {
+    char *host;
+    unsigned short port;
+    char *svcName;
+    RpcConnection rpc;		/* set by rpc_connect_many(), NULL if failed */
+} RpcTarget;
 
 /*
  * query descriptor needed to detect buffer overrun problem
@@ -64,6 +82,172 @@ struct qdecl {
  */
 int rpc_init(unsigned short port);
 
+/*
+ * replace the allocator used for the library's packet and message buffers
+ * must be called before rpc_init(); if either function is NULL, the
+ * built-in thread-caching size-class allocator is used
+ * returns 1 if successful, 0 if buffers have already been allocated, as
+ * they are from rpc_init() on, in which case the allocator is unchanged
+ */
+int rpc_set_allocator(void *(*mallocf)(size_t), void (*freef)(void *));
+
+/*
+ * set the sizes, in bytes, of the receive and send buffers of the sockets
+ * of contexts created afterwards, and of the socket made by rpc_reinit();
+ * 0 leaves the system default, and the defaults are SOCKET_RCVBUF and
+ * SOCKET_SNDBUF (see srpcdefs.h); a size above the system limit is granted
+ * only to a process permitted SO_RCVBUFFORCE and SO_SNDBUFFORCE
+ * must be called before rpc_init() to affect the default context
+ * returns 1 if successful, 0 if a size is negative
+ */
+int rpc_socket_config(int rcvbytes, int sndbytes);
+
+/*
+ * configure the arena from which packet and message buffers are carved
+ * `regionSize' is the size of each mapped region (rounded up to a multiple
+ * of 2 MB); `flags' is a combination of the following
+ * must be called before rpc_init()
+ * returns 1 if successful, 0 if `regionSize' is unusable
+ */
+#define RPC_ARENA_HUGEPAGES 0x1	/* back regions with explicit huge pages */
+#define RPC_ARENA_MLOCK 0x2	/* lock regions into memory */
+int rpc_arena_config(size_t regionSize, int flags);
+
+/*
+ * select the congestion control applied to each remote host: the packets
+ * outstanding to a host, from all of a context's connections to it, are
+ * limited by an AIMD window, halved when the timer must retransmit a
+ * packet sent to the host since it was last cut, which also bounds the
+ * retransmissions to the host in each tick; calls and responses made by
+ * application threads wait for room in the window, and their packets are
+ * paced at a little more than a window per round trip time
+ * `flags' is a combination of the following, both by default; 0 restores
+ * the earlier behaviour, in which every packet is sent at once
+ * returns 1 if successful, 0 if `flags' is not recognized
+ */
+#define RPC_CC_WINDOW 0x1	/* limit packets outstanding to each host */
+#define RPC_CC_PACING 0x2	/* pace data packets to each host */
+int rpc_congestion_config(int flags);
+
+/*
+ * discard, instead of transmitting, `percent' percent of the packets sent
+ * by this process, chosen at random, to simulate a lossy network for
+ * testing; the default is 0, or 5 if built with -DDROP_1_IN_20
+ * returns 1 if successful, 0 if `percent' exceeds 100
+ */
+int rpc_loss_config(unsigned percent);
+
+/*
+ * the following methods create and use RPC contexts
+ *
+ * a context is an independent instance of the RPC system: a UDP socket
+ * with its own connection and service tables and its own reader and timer
+ * threads, sharing no locks with other contexts; a process may create one
+ * context per core, so that the connections and services of each core are
+ * handled on that core
+ *
+ * rpc_init() creates the default context, which is used by rpc_connect(),
+ * rpc_offer() and the other calls that do not name a context; calls that
+ * take a connection or service use the context from which it came
+ */
+
+/*
+ * create a context bound to `port' if non-zero, otherwise to a port
+ * assigned dynamically; if `cpu' is not -1, its threads are pinned to that
+ * CPU, where the system supports it
+ * at most MAX_CONTEXTS (see srpcdefs.h) contexts, including the default,
+ * may exist; must be called after rpc_init()
+ * returns the context if successful, NULL otherwise
+ */
+RpcContext rpc_context_create(unsigned short port, int cpu);
+
+/*
+ * create a context, as rpc_context_create(), whose packets are received
+ * through an AF_XDP socket on queue `queue' of interface `ifname': a small
+ * XDP program attached to the interface redirects the UDP datagrams for
+ * `port' into memory shared with the context's reader, bypassing the
+ * socket layer, and responses to peers heard from on the interface are
+ * transmitted through the same socket; other packets, including those to
+ * peers not yet heard from, go through a UDP socket bound to `port'
+ * the program is attached in generic (SKB) mode, which works with any
+ * interface, including veth pairs, unless `flags' includes
+ * RPC_XDP_NATIVE, which requires driver support; one such context may be
+ * created for each interface, `port' must be non-zero, and the program is
+ * detached when the process exits
+ * requires the system to have been built with HAVE_AF_XDP, and the
+ * process to have CAP_NET_ADMIN and CAP_BPF (or CAP_SYS_ADMIN)
+ * returns the context if successful, NULL otherwise
+ */
+#define RPC_XDP_NATIVE 0x1	/* attach the XDP program in driver mode */
+
+RpcContext rpc_context_create_xdp(unsigned short port, int cpu,
+                                  const char *ifname, unsigned queue,
+                                  int flags);
+
+/*
+ * returns the default context, or NULL before rpc_init()
+ */
+RpcContext rpc_context_default(void);
+
+/*
+ * pin the reader thread of `ctx' to `readerCpu' and its timer thread to
+ * `timerCpu', as for a context created with a CPU; memory that the reader
+ * obtains for packets and connection records is thereafter taken from the
+ * NUMA node of `readerCpu', where the system supports it
+ * returns 1 if successful, 0 if a CPU is unusable or pinning is unsupported
+ */
+int rpc_context_pin(RpcContext ctx, int readerCpu, int timerCpu);
+
+/*
+ * put `ctx' in a low-latency mode in which its socket is busy-polled by
+ * the kernel for up to `usecs' microseconds (SO_BUSY_POLL, with
+ * SO_PREFER_BUSY_POLL where available) and its reader polls the socket
+ * without blocking, sleeping only once the socket has been idle for
+ * `backoff' microseconds; a `backoff' of 0 keeps the reader polling, which
+ * occupies a CPU; a `usecs' of 0 restores the usual blocking reader
+ * a change is seen by the reader after the next packet arrives
+ * returns 1 if successful, 0 if the kernel does not support or permit
+ * busy polling, in which case the reader still polls
+ */
+int rpc_context_busy_poll(RpcContext ctx, unsigned usecs, unsigned backoff);
+
+/*
+ * stripe the fragments that `ctx' sends across the local interfaces named
+ * in the comma-separated list `ifnames' (at most MAX_PATHS of them), each
+ * remote host's share of each interface weighted by the round trip time
+ * and losses observed over it; every packet leaves with the IPv4 address
+ * of the first interface as its source, so that receivers see one endpoint,
+ * and every reply returns by the first interface's link; this mode therefore
+ * needs anti-spoofing disabled for that address along every other path -
+ * uRPF or BCP38 filters on its routers, and strict rp_filter on the hosts
+ * at either end - or the packets sent on those paths are dropped; a NULL
+ * or empty list stops striping
+ * returns 1 if successful, 0 if an interface is unknown, has no IPv4
+ * address or the transport cannot choose an interface per packet
+ */
+int rpc_context_paths(RpcContext ctx, const char *ifnames);
+
+/*
+ * pin the calling thread to `cpu', so that the buffers it allocates come
+ * from the NUMA node of that CPU
+ * returns 1 if successful, 0 if the CPU is unusable or pinning unsupported
+ */
+int rpc_pin_thread(int cpu);
+
+/*
+ * as rpc_details(), rpc_connect(), rpc_connect_many() and rpc_offer(),
+ * respectively, in context `ctx'; a NULL `ctx', as from a failed
+ * rpc_context_create(), fails: no connection or service is returned, and
+ * the port given by rpc_context_details() is 0
+ */
+void rpc_context_details(RpcContext ctx, char *ipaddr, unsigned short *port);
+RpcConnection rpc_context_connect(RpcContext ctx, char *host,
+                                  unsigned short port, char *svcName,
+                                  unsigned long seqno);
+int rpc_context_connect_many(RpcContext ctx, RpcTarget targets[], int n,
+                             unsigned long seqno);
+RpcService rpc_context_offer(RpcContext ctx, char *svcName);
+
 /*
  * the following methods are used by RPC clients
  */
@@ -78,6 +262,15 @@ void rpc_details(char *ipaddr, unsigned short *port);
  */
 void rpc_reverselu(char *ipaddr, char *hostname);
 
+/*
+ * begin looking up the addresses of `n' hosts in the background, so that
+ * later calls to rpc_connect() for them need not wait for the resolver;
+ * lookups are remembered for RESOLVE_TTL seconds (see srpcdefs.h), and are
+ * never made while the RPC system's locks are held
+ * returns 1 if the lookups were started, 0 otherwise
+ */
+int rpc_resolve(char *hosts[], int n);
+
 /*
  * send connect message to host:port with initial sequence number
  * svcName indicates the offered service of interest
@@ -87,15 +280,129 @@ void rpc_reverselu(char *ipaddr, char *hostname);
 RpcConnection rpc_connect(char *host, unsigned short port,
                           char *svcName, unsigned long seqno);
 
+/*
+ * as rpc_connect(), for each of `n' targets at once; the hosts are looked
+ * up concurrently, and up to CONNECT_WINDOW (see srpcdefs.h) connect
+ * messages are outstanding at a time, so that bringing up many connections
+ * takes little longer than bringing up one
+ * returns the number of connections established; targets[i].rpc is the
+ * connection to the i'th target, or NULL if it failed
+ */
+int rpc_connect_many(RpcTarget targets[], int n, unsigned long seqno);
+
+/*
+ * a pool of connections to one service, kept ready for use so that the
+ * first call on a connection need not wait for it to be established
+ *
+ * rpc_pool_create() starts a thread that establishes `warm' connections to
+ * svcName on host:port, and replaces them as they are taken
+ * returns the pool if successful, NULL otherwise
+ */
+RpcPool rpc_pool_create(char *host, unsigned short port, char *svcName,
+                        unsigned warm);
+
+/*
+ * take a connection from the pool; if none is ready, one is established
+ * as by rpc_connect()
+ * returns the connection if successful, NULL otherwise
+ */
+RpcConnection rpc_pool_get(RpcPool pool);
+
+/*
+ * return a connection obtained from rpc_pool_get() to the pool; if the
+ * pool already holds `warm' connections, it is disconnected instead
+ */
+void rpc_pool_put(RpcPool pool, RpcConnection rpc);
+
+/*
+ * stop replenishing the pool, disconnect its connections, and free it
+ */
+void rpc_pool_destroy(RpcPool pool);
+
 /*
  * make the next RPC call, waiting until response received
  * must be invoked as rpc_call(rpc, Q_Arg(query), qlen, resp, rsize, &rlen)
  * upon successful return, resp contains rlen bytes of data
+ * `resp' is posted with the call, so the response is written directly into
+ * it as it arrives
  * returns 1 if successful, 0 otherwise
  */
 int rpc_call(RpcConnection rpc, const struct qdecl *query, unsigned qlen,
              void *resp, unsigned rsize, unsigned *rlen);
 
+/*
+ * as rpc_call(), but the response is not copied into a caller's buffer
+ * upon successful return, *resp points to the response data, *rlen is its
+ * length
+ *
+ * the response data belongs to the returned buffer, and remains valid
+ * until the buffer is returned with rpc_call_release()
+ * returns NULL if unsuccessful
+ */
+RpcBuffer rpc_call_borrow(RpcConnection rpc, const struct qdecl *query,
+                          unsigned qlen, void **resp, unsigned *rlen);
+
+/*
+ * return a buffer obtained from rpc_call_borrow() to the RPC system
+ */
+void rpc_call_release(RpcBuffer buf);
+
+/*
+ * the following methods are used by RPC clients to make calls without
+ * blocking; completion is reported by a callback or through a completion
+ * queue
+ */
+
+typedef void *RpcCall;
+typedef void *RpcCQ;
+
+/*
+ * the completion of an asynchronous call
+ */
+typedef struct rpc_event {
+    RpcCall call;	/* as returned by rpc_call_async() */
+    void *arg;		/* as given to rpc_call_async() */
+    int status;		/* 1 if successful, 0 otherwise */
+    void *resp;		/* the response buffer given to rpc_call_async() */
+    unsigned rlen;	/* length of the response, if successful */
+} RpcEvent;
+
+/*
+ * invoked from one of the RPC system's threads when a call completes; it
+ * must not block, and so must not call rpc_call(), but it may start further
+ * asynchronous calls
+ */
+typedef void (*RpcCallback)(RpcEvent *ev);
+
+/*
+ * create/destroy a completion queue
+ * rpc_cq_create() returns NULL if error
+ */
+RpcCQ rpc_cq_create(void);
+void rpc_cq_destroy(RpcCQ cq);
+
+/*
+ * start the next RPC call on `rpc' without waiting for the response;
+ * arguments are as for rpc_call(), except that the query is copied if
+ * necessary, and `resp' must remain valid until the call completes
+ *
+ * on completion, `cb' is invoked if it is not NULL; otherwise, an event is
+ * posted to `cq'; `arg' is returned in the event
+ *
+ * as with rpc_call(), a connection carries one call at a time
+ * returns a handle for the call, or NULL if it could not be started
+ */
+RpcCall rpc_call_async(RpcConnection rpc, const struct qdecl *query,
+                       unsigned qlen, void *resp, unsigned rsize,
+                       RpcCallback cb, RpcCQ cq, void *arg);
+
+/*
+ * wait up to `timeout' milliseconds (forever if negative) for completed
+ * calls on `cq', returning up to `max' of them in `events'
+ * returns the number of events returned, 0 if the timeout expired
+ */
+int rpc_poll(RpcCQ cq, RpcEvent *events, int max, int timeout);
+
 /*
  * disconnect from target
  * no return
@@ -132,14 +439,222 @@ void rpc_withdraw(RpcService rps);
  */
 unsigned rpc_query(RpcService rps, RpcEndpoint *ep, void *qb, unsigned len);
 
+/*
+ * obtain the next query message from `rps' without copying it - blocks
+ * until message available
+ * upon return, ep has opaque sender information
+ *              *qb points to the query data, *len is its length
+ *
+ * the query data belongs to the returned buffer, and remains valid until
+ * the buffer is returned with rpc_query_release()
+ * returns NULL if there is some massive failure in the system
+ */
+RpcBuffer rpc_query_borrow(RpcService rps, RpcEndpoint *ep, void **qb,
+                           unsigned *len);
+
+/*
+ * a query obtained by rpc_query_batch()
+ */
+typedef struct rpc_query {
+    RpcEndpoint ep;	/* opaque sender information */
+    RpcBuffer buf;	/* to be returned with rpc_query_release() */
+    void *data;		/* query data, owned by `buf' */
+    unsigned len;	/* length of query data */
+    unsigned long wait;	/* microseconds spent queued (coarse) */
+} RpcQuery;
+
+/*
+ * obtain up to `max' query messages from `rps' without copying them -
+ * blocks until at least one message available
+ * upon return, qs[0..n-1] describe the messages, where n is the function
+ * value; each qs[i].buf must be returned with rpc_query_release()
+ *
+ * at most 64 messages are returned by each call
+ */
+unsigned rpc_query_batch(RpcService rps, RpcQuery *qs, unsigned max);
+
+/*
+ * return a buffer obtained from rpc_query_borrow() or rpc_query_batch() to
+ * the RPC system
+ */
+void rpc_query_release(RpcBuffer buf);
+
 /*
  * send the next response message to the ep
- * rb contains the response to return to the caller
+ * rb contains the response to return to the caller, of 1 to
+ * 65535 bytes
  * returns 1 if successful
- * returns 0 if there is a massive failure in the system
+ * returns 0 if `len' is out of range, or if there is a massive failure in
+ * the system
  */
 int rpc_response(RpcService rps, RpcEndpoint *ep, void *rb, unsigned len);
 
+/*
+ * the following method runs a managed pool of worker threads for a service
+ */
+
+/*
+ * a handler for rpc_serve(): processes the query of `qlen' bytes in `query',
+ * received from `ep', placing the response in `resp', which has room for
+ * `rsize' bytes; `arg' is the value given to rpc_serve()
+ * returns the length of the response; 0 indicates that the handler has
+ * responded itself, using rpc_response()
+ */
+typedef unsigned (*RpcHandler)(void *arg, RpcEndpoint *ep, void *query,
+                               unsigned qlen, void *resp, unsigned rsize);
+
+/*
+ * options for rpc_serve(); a zero field selects the default
+ */
+typedef struct rpc_serve_options {
+    unsigned minThreads;	/* workers kept running (1) */
+    unsigned maxThreads;	/* most workers started (minThreads, <= 64) */
+    unsigned targetWait;	/* queue wait, usecs, that grows pool (1000) */
+    int firstCpu;		/* workers pinned to firstCpu ... */
+    unsigned ncpus;		/* ... firstCpu+ncpus-1 in turn (unpinned) */
+} RpcServeOptions;
+
+/*
+ * process the queries for `rps' by invoking `handler' in a pool of worker
+ * threads; the calling thread becomes one of the workers, and the pool
+ * grows and shrinks between minThreads and maxThreads according to the
+ * time queries wait to be processed; `opts' may be NULL
+ *
+ * if opts->ncpus is not zero, worker i, including the calling thread as
+ * worker 0, is pinned to CPU firstCpu + i % ncpus (see rpc_pin_thread())
+ *
+ * does not return unless the pool cannot be started, in which case it
+ * returns 0
+ */
+int rpc_serve(RpcService rps, RpcHandler handler, void *arg,
+              RpcServeOptions *opts);
+
+/*
+ * a handler for rpc_serve_inline(): may process the query of `qlen' bytes
+ * in `query', received from `ep', placing the response in `resp', which
+ * has room for `rsize' bytes, and its length in `*rlen'; `arg' is the
+ * value given to rpc_serve_inline()
+ * returns 1 if it has answered the query, in which case the response is
+ * sent, or 0 if it has not, in which case the query is queued for the
+ * service's workers in the usual way; a `*rlen' greater than `rsize' is
+ * treated as 0
+ */
+typedef int (*RpcInlineHandler)(void *arg, RpcEndpoint *ep, void *query,
+                                unsigned qlen, void *resp, unsigned rsize,
+                                unsigned *rlen);
+
+/*
+ * register `handler' to be run by the RPC system's reader thread as each
+ * query for `rps' arrives, so that the response is sent without handing
+ * the query to a worker thread; a NULL handler cancels the registration
+ *
+ * the handler must not block and must not invoke any of the rpc_*()
+ * methods, as it runs with the connection table locked; `rsize' is limited
+ * to a single fragment (1024 bytes)
+ * returns 1 if successful, 0 otherwise
+ */
+int rpc_serve_inline(RpcService rps, RpcInlineHandler handler, void *arg);
+
+/*
+ * receives a query handed over by the reader thread; `q' describes it as
+ * for rpc_query_batch(), and is only valid for the duration of the call
+ */
+typedef void (*RpcDispatch)(void *arg, RpcQuery *q);
+
+/*
+ * hand each query for `rps' to `dispatch' as it arrives, instead of queueing
+ * it for rpc_query() and its variants; a NULL dispatch restores queueing
+ *
+ * dispatch is invoked by the reader thread once the connection table has
+ * been released; it must not block, and becomes responsible for responding
+ * to the query with rpc_response() - immediately or later, from any thread -
+ * and for returning q->buf with rpc_query_release()
+ *
+ * a response sent from the reader thread does not wait for its fragments
+ * to be acknowledged, so rpc_response() returns once the first is sent
+ *
+ * a query is handed to the dispatch set when it was accepted, so a change
+ * waits until the calls already handed to the previous dispatch have
+ * returned - other than the caller's own, if it is made from one of them -
+ * after which that dispatch's `arg' may be freed
+ * returns 1 if successful, 0 otherwise
+ */
+int rpc_serve_async(RpcService rps, RpcDispatch dispatch, void *arg);
+
+/*
+ * the following methods tune how threads wait for responses and queries
+ *
+ * a thread blocked in rpc_call() or rpc_connect() on a connection, or in
+ * rpc_query() and its variants on a service, first polls for up to `usecs'
+ * microseconds before sleeping; the time actually spent is calibrated from
+ * its recent waits, so waits that are usually longer are not polled at all
+ * the default is SPIN_USECS (see srpcdefs.h), or 0 on a uniprocessor; 0
+ * makes the thread sleep at once
+ * returns 1 if successful, 0 otherwise
+ */
+int rpc_connection_spin(RpcConnection rpc, unsigned usecs);
+int rpc_service_spin(RpcService rps, unsigned usecs);
+
+/*
+ * a thread blocked in rpc_call() on connection `rpc' reads the socket of
+ * its context itself for up to `usecs' microseconds, processing whatever
+ * arrives as the reader would, rather than waiting for the reader to hand
+ * it its response; intended for contexts in busy-poll mode (see
+ * rpc_context_busy_poll()), where it saves the wakeup of the caller
+ * the default is 0, leaving reception to the reader; at most 65535
+ * returns 1 if successful, 0 otherwise
+ */
+int rpc_connection_poll(RpcConnection rpc, unsigned usecs);
+
+/*
+ * send the fragments of messages on connection `rpc' in parity groups of
+ * `group' fragments, each followed by a packet holding their XOR, from
+ * which the receiver rebuilds any one fragment of the group that is lost
+ * rather than waiting for it to be retransmitted; the server sends its
+ * responses on the connection in groups of the same size
+ * this costs one packet in `group' + 1, and helps on links that lose
+ * packets at random; the default is 0, sending each fragment singly and
+ * waiting for it to be acknowledged; a group and its parity packet must
+ * fit the outbox in which they are built (OUTBOX_SLOTS - 1 fragments, 15
+ * by default)
+ * returns 1 if successful, 0 otherwise
+ */
+int rpc_connection_parity(RpcConnection rpc, unsigned group);
+
+/*
+ * returns 1 if connection `rpc' is established and has no call
+ * outstanding, 0 otherwise
+ */
+int rpc_connection_idle(RpcConnection rpc);
+
+/*
+ * counters maintained by the RPC system since it started
+ */
+typedef struct rpc_stats {
+    unsigned long pktsSent;	/* packets transmitted */
+    unsigned long pktsDeferred;	/* of those, built with the table locked */
+    unsigned long pktsReceived;	/* packets read by the reader thread */
+    unsigned long pktsPredicted;/* of those, handled by its fast path */
+    unsigned long lockHolds;	/* times the connection table was locked */
+    unsigned long lockNsecs;	/* total time for which it was held */
+    unsigned long lockMaxNsecs;	/* longest single hold */
+    unsigned long pktsRetried;	/* retransmitted after a timeout */
+    unsigned long pktsDropped;	/* discarded by the kernel, socket full */
+    unsigned long sendFailures;	/* transmissions refused by the kernel */
+    unsigned long windowWaits;	/* senders waited for congestion window */
+    unsigned long retriesDeferred;/* retransmissions put off a tick */
+    unsigned long fragsRepaired;/* lost fragments rebuilt from parity */
+    unsigned long pingsSent;	/* keepalives, one per remote endpoint */
+} RpcStats;
+
+/*
+ * obtain the current values of the RPC system's counters
+ * pktsDropped, which counts datagrams that arrived while a socket's
+ * receive buffer was full, is only available where the kernel supports
+ * SO_RXQ_OVFL, and is brought up to date as each packet is read
+ */
+void rpc_stats(RpcStats *st);
+
 /*
  * the following methods are used to prevent parent and child processes from
  * colliding over the same port numbers
@@ -169,4 +684,8 @@ int rpc_reinit(unsigned short port);
  */
 void rpc_shutdown(void);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* _SRPC_H_ */
@@ -0,0 +1,465 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * srpc.hpp - C++20 interface to the simple RPC system
+ *
+ * header-only: the C API wrapped in move-only RAII types, with buffers
+ * described by std::span, plus co_await-able calls and queries that are
+ * resumed directly by the RPC system's own threads, so that no thread is
+ * parked for each outstanding call
+ *
+ * a coroutine resumed by the RPC system runs on its reader (or timer)
+ * thread until its next suspension; it must not block there, and in
+ * particular must not use the blocking Connection::call()
+ */
+#ifndef _SRPC_HPP_
+#define _SRPC_HPP_
+
+#include "srpc.h"
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <utility>
+
+namespace srpc {
+
+/*
+ * initialize/shutdown the RPC system; see rpc_init() and rpc_shutdown()
+ */
+inline bool init(unsigned short port = 0) {
+    return rpc_init(port) != 0;
+}
+
+inline void shutdown() {
+    rpc_shutdown();
+}
+
+/*
+ * the outcome of a call: whether it succeeded, and the length of the
+ * response written to the caller's buffer
+ */
+struct Result {
+    bool ok = false;
+    std::size_t len = 0;
+
+    explicit operator bool() const noexcept {
+        return ok;
+    }
+};
+
+/*
+ * a fire-and-forget coroutine: it starts running at once, and its frame is
+ * freed when it finishes
+ */
+struct Task {
+    struct promise_type {
+        Task get_return_object() noexcept {
+            return {};
+        }
+        std::suspend_never initial_suspend() noexcept {
+            return {};
+        }
+        std::suspend_never final_suspend() noexcept {
+            return {};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept {
+            std::terminate();
+        }
+    };
+};
+
+namespace detail {
+
+inline qdecl query_decl(std::span<const std::byte> q) noexcept {
+    return {static_cast<int>(q.size()),
+            const_cast<char *>(reinterpret_cast<const char *>(q.data()))};
+}
+
+} // namespace detail
+
+/*
+ * a connection to a remote service; see rpc_connect()
+ */
+class Connection {
+public:
+    /*
+     * awaitable returned by Connection::async_call()
+     */
+    class CallOp {
+    public:
+        CallOp(RpcConnection rpc, std::span<const std::byte> query,
+               std::span<std::byte> resp) noexcept
+            : rpc_(rpc), query_(query), resp_(resp) {}
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> h) noexcept {
+            qdecl q = detail::query_decl(query_);
+
+            handle_ = h;
+            /* once started, *this may be resumed, and destroyed, at once */
+            return rpc_call_async(rpc_, &q, query_.size(), resp_.data(),
+                                  resp_.size(), &CallOp::complete, nullptr,
+                                  this) != nullptr;
+        }
+
+        Result await_resume() const noexcept {
+            return result_;
+        }
+
+    private:
+        static void complete(RpcEvent *ev) {
+            CallOp *op = static_cast<CallOp *>(ev->arg);
+
+            op->result_ = {ev->status != 0, ev->rlen};
+            op->handle_.resume();
+        }
+
+        RpcConnection rpc_;
+        std::span<const std::byte> query_;
+        std::span<std::byte> resp_;
+        std::coroutine_handle<> handle_;
+        Result result_;
+    };
+
+    Connection() noexcept = default;
+
+    Connection(const char *host, unsigned short port, const char *service,
+               unsigned long seqno = 0)
+        : rpc_(rpc_connect(const_cast<char *>(host), port,
+                           const_cast<char *>(service), seqno)) {}
+
+    Connection(Connection &&other) noexcept
+        : rpc_(std::exchange(other.rpc_, nullptr)) {}
+
+    Connection &operator=(Connection &&other) noexcept {
+        if (this != &other) {
+            reset();
+            rpc_ = std::exchange(other.rpc_, nullptr);
+        }
+        return *this;
+    }
+
+    Connection(const Connection &) = delete;
+    Connection &operator=(const Connection &) = delete;
+
+    ~Connection() {
+        reset();
+    }
+
+    explicit operator bool() const noexcept {
+        return rpc_ != nullptr;
+    }
+
+    RpcConnection get() const noexcept {
+        return rpc_;
+    }
+
+    void reset() noexcept {
+        if (rpc_ != nullptr)
+            rpc_disconnect(std::exchange(rpc_, nullptr));
+    }
+
+    /*
+     * make the next call, waiting for the response to be written to `resp'
+     */
+    Result call(std::span<const std::byte> query,
+                std::span<std::byte> resp) const noexcept {
+        qdecl q = detail::query_decl(query);
+        unsigned rlen = 0;
+
+        if (! rpc_call(rpc_, &q, query.size(), resp.data(), resp.size(),
+                       &rlen))
+            return {};
+        return {true, rlen};
+    }
+
+    /*
+     * make the next call from a coroutine: co_await yields its Result
+     * `query' need only remain valid until the call is started, `resp'
+     * until it completes; one call at a time per connection
+     */
+    CallOp async_call(std::span<const std::byte> query,
+                      std::span<std::byte> resp) const noexcept {
+        return CallOp(rpc_, query, resp);
+    }
+
+private:
+    RpcConnection rpc_ = nullptr;
+};
+
+/*
+ * a query received by a Service; its buffer is returned to the RPC system
+ * when the Query is destroyed
+ */
+class Query {
+public:
+    Query() noexcept = default;
+
+    explicit Query(const RpcQuery &q) noexcept
+        : ep_(q.ep), buf_(q.buf),
+          data_(static_cast<const std::byte *>(q.data), q.len) {}
+
+    Query(Query &&other) noexcept
+        : ep_(other.ep_), buf_(std::exchange(other.buf_, nullptr)),
+          data_(std::exchange(other.data_, {})) {}
+
+    Query &operator=(Query &&other) noexcept {
+        if (this != &other) {
+            reset();
+            ep_ = other.ep_;
+            buf_ = std::exchange(other.buf_, nullptr);
+            data_ = std::exchange(other.data_, {});
+        }
+        return *this;
+    }
+
+    Query(const Query &) = delete;
+    Query &operator=(const Query &) = delete;
+
+    ~Query() {
+        reset();
+    }
+
+    explicit operator bool() const noexcept {
+        return buf_ != nullptr;
+    }
+
+    std::span<const std::byte> data() const noexcept {
+        return data_;
+    }
+
+    RpcEndpoint *endpoint() noexcept {
+        return &ep_;
+    }
+
+    void reset() noexcept {
+        if (buf_ != nullptr)
+            rpc_query_release(std::exchange(buf_, nullptr));
+        data_ = {};
+    }
+
+private:
+    RpcEndpoint ep_{};
+    RpcBuffer buf_ = nullptr;
+    std::span<const std::byte> data_;
+};
+
+/*
+ * a service offered to clients; see rpc_offer()
+ *
+ * a Blocking service is served by threads calling query(); a Coroutines
+ * service has its queries handed over by the reader thread (see
+ * rpc_serve_async()) to coroutines awaiting next(); reset() waits for any
+ * handover in progress, then resumes the coroutines still awaiting with an
+ * empty Query
+ */
+class Service {
+    struct State;
+
+public:
+    enum Mode { Blocking, Coroutines };
+
+    /*
+     * awaitable returned by Service::next()
+     */
+    class QueryOp {
+    public:
+        explicit QueryOp(Service::State *state) noexcept : state_(state) {}
+
+        bool await_ready() const noexcept {
+            return state_ == nullptr;
+        }
+
+        bool await_suspend(std::coroutine_handle<> h) {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+
+            if (state_->closed)
+                return false;
+            if (! state_->ready.empty()) {
+                query_ = std::move(state_->ready.front());
+                state_->ready.pop_front();
+                return false;
+            }
+            handle_ = h;
+            state_->waiters.push_back(this);
+            return true;
+        }
+
+        Query await_resume() noexcept {
+            return std::move(query_);
+        }
+
+    private:
+        friend class Service;
+
+        Service::State *state_;
+        std::coroutine_handle<> handle_;
+        Query query_;
+    };
+
+    Service() noexcept = default;
+
+    explicit Service(const char *name, Mode mode = Blocking)
+        : rps_(static_cast<RpcService>(rpc_offer(const_cast<char *>(name)))) {
+        if (rps_ != nullptr && mode == Coroutines) {
+            state_ = std::make_unique<State>();
+            if (! rpc_serve_async(rps_, &Service::dispatch, state_.get()))
+                state_.reset();
+        }
+    }
+
+    Service(Service &&other) noexcept
+        : rps_(std::exchange(other.rps_, nullptr)),
+          state_(std::move(other.state_)) {}
+
+    Service &operator=(Service &&other) noexcept {
+        if (this != &other) {
+            reset();
+            rps_ = std::exchange(other.rps_, nullptr);
+            state_ = std::move(other.state_);
+        }
+        return *this;
+    }
+
+    Service(const Service &) = delete;
+    Service &operator=(const Service &) = delete;
+
+    ~Service() {
+        reset();
+    }
+
+    explicit operator bool() const noexcept {
+        return rps_ != nullptr;
+    }
+
+    RpcService get() const noexcept {
+        return rps_;
+    }
+
+    void reset() noexcept {
+        if (rps_ == nullptr)
+            return;
+        if (state_ != nullptr) {
+            /* returns once no handover to dispatch() is in progress */
+            (void)rpc_serve_async(rps_, nullptr, nullptr);
+            close(*state_);
+        }
+        rpc_withdraw(std::exchange(rps_, nullptr));
+        state_.reset();
+    }
+
+    /*
+     * wait for the next query to a Blocking service
+     */
+    Query query() const noexcept {
+        RpcQuery q;
+
+        if (rpc_query_batch(rps_, &q, 1) == 0)
+            return {};
+        return Query(q);
+    }
+
+    /*
+     * obtain the next query to a Coroutines service: co_await yields it;
+     * it yields an empty Query at once if the service is Blocking, or
+     * could not be served by coroutines, or has been reset
+     */
+    QueryOp next() const noexcept {
+        return QueryOp(state_.get());
+    }
+
+    /*
+     * send the response to `q'; the Query may then be destroyed
+     */
+    bool respond(Query &q, std::span<const std::byte> resp) const noexcept {
+        return rpc_response(rps_, q.endpoint(),
+                            const_cast<std::byte *>(resp.data()),
+                            resp.size()) != 0;
+    }
+
+private:
+    struct State {
+        std::mutex mutex;
+        std::deque<Query> ready;	/* received, not yet awaited */
+        std::deque<QueryOp *> waiters;	/* awaiting, in order */
+        bool closed = false;		/* no more queries will arrive */
+    };
+
+    /*
+     * release the queries not yet awaited, and resume each coroutine still
+     * awaiting with an empty Query
+     */
+    static void close(State &state) {
+        std::deque<QueryOp *> waiters;
+        std::deque<Query> ready;
+
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.closed = true;
+            waiters.swap(state.waiters);
+            ready.swap(state.ready);
+        }
+        ready.clear();
+        for (QueryOp *op : waiters)
+            op->handle_.resume();
+    }
+
+    static void dispatch(void *arg, RpcQuery *q) {
+        State *state = static_cast<State *>(arg);
+        std::unique_lock<std::mutex> lock(state->mutex);
+
+        if (state->waiters.empty()) {
+            state->ready.emplace_back(*q);
+            return;
+        }
+        QueryOp *op = state->waiters.front();
+        state->waiters.pop_front();
+        lock.unlock();
+        op->query_ = Query(*q);
+        op->handle_.resume();
+    }
+
+    RpcService rps_ = nullptr;
+    std::unique_ptr<State> state_;
+};
+
+} // namespace srpc
+
+#endif /* _SRPC_HPP_ */
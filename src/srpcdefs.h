@@ -55,4 +55,152 @@
  */
 #define FR_SIZE 1024
 
+/*
+ * the following specifies the size of each region mapped for the packet
+ * and message buffer arena; it is rounded up to a multiple of 2 MB and may
+ * be changed using -DARENA_SIZE=value within CFLAGS or by rpc_arena_config()
+ */
+#ifndef ARENA_SIZE
+#define ARENA_SIZE (8 * 1024 * 1024)
+#endif /* ARENA_SIZE */
+
+/*
+ * the following specifies the number of queries that may be queued for a
+ * service awaiting workers; when the queue is full, queries are not
+ * acknowledged, so that clients retry them; it is rounded up to a power of
+ * two, and may be changed using -DSQUEUE_SIZE=value within CFLAGS
+ */
+#ifndef SQUEUE_SIZE
+#define SQUEUE_SIZE 1024
+#endif /* SQUEUE_SIZE */
+
+/*
+ * the following specifies the longest time, in microseconds, that a thread
+ * waiting for a response or a query polls for it before sleeping; the time
+ * actually spent is calibrated from recent waits, and spinning is disabled
+ * on uniprocessors; it may be changed using -DSPIN_USECS=value within
+ * CFLAGS, or for a connection or service with rpc_connection_spin() and
+ * rpc_service_spin()
+ */
+#ifndef SPIN_USECS
+#define SPIN_USECS 50
+#endif /* SPIN_USECS */
+
+/*
+ * the following specifies the number of packets that a thread's outbox
+ * first holds of those it builds while holding the connection table lock,
+ * for transmission once it has released it; the outbox doubles when full,
+ * and parity groups are limited to fit it (see rpc_connection_parity()) -
+ * may be changed using -DOUTBOX_SLOTS=value within CFLAGS
+ */
+#ifndef OUTBOX_SLOTS
+#define OUTBOX_SLOTS 16
+#endif /* OUTBOX_SLOTS */
+
+/*
+ * the following specify how long, in seconds, a resolved host name is
+ * remembered, and the largest number of threads used to resolve a batch of
+ * names given to rpc_resolve() - may be changed using -DRESOLVE_TTL=value
+ * and -DRESOLVE_THREADS=value within CFLAGS
+ */
+#ifndef RESOLVE_TTL
+#define RESOLVE_TTL 60
+#endif /* RESOLVE_TTL */
+#ifndef RESOLVE_THREADS
+#define RESOLVE_THREADS 8
+#endif /* RESOLVE_THREADS */
+
+/*
+ * the following specifies the largest number of connections that
+ * rpc_connect_many() will have awaiting acceptance at once - may be changed
+ * using -DCONNECT_WINDOW=value within CFLAGS
+ */
+#ifndef CONNECT_WINDOW
+#define CONNECT_WINDOW 256
+#endif /* CONNECT_WINDOW */
+
+/*
+ * the following specifies the largest number of RPC contexts, including
+ * the default context, that a process may create - may be changed using
+ * -DMAX_CONTEXTS=value within CFLAGS; at most 255
+ */
+#ifndef MAX_CONTEXTS
+#define MAX_CONTEXTS 64
+#endif /* MAX_CONTEXTS */
+
+/*
+ * the following specifies the largest number of NUMA nodes for which the
+ * packet arena and the buffer and connection record slabs keep separate
+ * memory; threads on further nodes share that of node 0 - may be changed
+ * using -DMAX_NODES=value within CFLAGS; at most 64
+ */
+#ifndef MAX_NODES
+#define MAX_NODES 8
+#endif /* MAX_NODES */
+
+/*
+ * the following specify the sizes, in bytes, of the receive and send
+ * buffers of each socket; 0 leaves the system default - may be changed
+ * using -DSOCKET_RCVBUF=value and -DSOCKET_SNDBUF=value within CFLAGS, or
+ * by rpc_socket_config()
+ */
+#ifndef SOCKET_RCVBUF
+#define SOCKET_RCVBUF 0
+#endif /* SOCKET_RCVBUF */
+#ifndef SOCKET_SNDBUF
+#define SOCKET_SNDBUF 0
+#endif /* SOCKET_SNDBUF */
+
+/*
+ * the following specifies the number of 2 KB frames in the memory shared
+ * with the kernel by each XDP context, half of which receive packets and
+ * half of which transmit them; must be a power of 2 - may be changed using
+ * -DXDP_FRAMES=value within CFLAGS
+ */
+#ifndef XDP_FRAMES
+#define XDP_FRAMES 4096
+#endif /* XDP_FRAMES */
+
+/*
+ * the following specify, in packets, the initial and largest congestion
+ * windows kept for each remote host (see peer.h), and, in ticks, the
+ * longest that a sender waits for room in a window before sending anyway -
+ * may be changed using -D<symbol>=value within CFLAGS
+ */
+#ifndef CC_INITIAL_WINDOW
+#define CC_INITIAL_WINDOW 16
+#endif /* CC_INITIAL_WINDOW */
+#ifndef CC_MAX_WINDOW
+#define CC_MAX_WINDOW 256
+#endif /* CC_MAX_WINDOW */
+#ifndef CC_MAX_WAIT
+#define CC_MAX_WAIT 50
+#endif /* CC_MAX_WAIT */
+
+/*
+ * the following specify, in ticks, the shortest and longest intervals of
+ * silence after which a remote endpoint is pinged, as the interval adapts
+ * to its liveness (see peer.h) - may be changed using -D<symbol>=value
+ * within CFLAGS
+ */
+#ifndef PING_MIN_TICKS
+#define PING_MIN_TICKS (10 * 50)	/* 10 seconds */
+#endif /* PING_MIN_TICKS */
+#ifndef PING_MAX_TICKS
+#define PING_MAX_TICKS (10 * 60 * 50)	/* 10 minutes */
+#endif /* PING_MAX_TICKS */
+
+/*
+ * the following specify the most local interfaces across which a context
+ * may stripe fragments, and the number of slots in the schedule that
+ * assigns groups of them to each (see path.h) - may be changed using
+ * -D<symbol>=value within CFLAGS
+ */
+#ifndef MAX_PATHS
+#define MAX_PATHS 4
+#endif /* MAX_PATHS */
+#ifndef PATH_SLOTS
+#define PATH_SLOTS 16
+#endif /* PATH_SLOTS */
+
 #endif /* _SRPCDEFS_H_ */
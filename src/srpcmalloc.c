@@ -30,126 +30,165 @@
  */
 
 /*
- * srpcmalloc - simple malloc and free for use with the SRPC system
+ * srpcmalloc - thread-caching size-class malloc and free for use with the
+ *              SRPC system
  */
 
-#ifndef HEAP_SIZE
-#define HEAP_SIZE 10240000
-#endif /* HEAP_SIZE */
-
-#ifndef ALIGNMENT
-#define ALIGNMENT sizeof(void *)
-#endif /* ALIGNMENT */
-
 #include "srpcmalloc.h"
+#include "payload.h"
+#include "slab.h"
+#include "arena.h"
+#include "affinity.h"
+#include "srpcdefs.h"
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <pthread.h>
 
-typedef struct hole {
-    size_t size;			/* size of hole NOT including size field */
-    struct hole *next;		/* pointer to next hole in the list */
-} Hole;
+/*
+ * every buffer is preceded by a header naming the slab for its class and
+ * NUMA node, to which it is returned by whichever thread frees it; NULL
+ * indicates that the buffer came from malloc(); the header keeps buffers
+ * aligned as malloc() does
+ */
+typedef union mhdr {
+    Slab slab;
+    max_align_t align;
+} MHdr;
 
-static unsigned char heap[HEAP_SIZE];	/* bytes to use for heap */
-static Hole *freeL = (Hole *)heap;
-static int init = 1;
-static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * size classes - the small classes hold control and connect payloads, the
+ * PKT_SIZE class holds any single packet, and the MSG_SIZE class holds the
+ * largest message that can be reassembled from fragments
+ */
+static const size_t classes[] = {
+    32, 64, 128, 256, 512, PKT_SIZE, 4096, 16384, MSG_SIZE
+};
+#define NCLASSES (sizeof(classes) / sizeof(classes[0]))
+#define BLOCK_BYTES 65536	/* target size of each slab block */
+#define MIN_PER_BLOCK 4
 
-void *srpc_malloc(size_t size) {
-    size_t len = ((size - 1) / ALIGNMENT + 1) * ALIGNMENT + sizeof(size_t);
-    unsigned char *p, *result;
-    Hole *prev, *cur;
-
-    (void)pthread_mutex_lock(&mutex);
-    if (init) {
-        init = 0;
-        freeL->size = HEAP_SIZE;
-        freeL->next = NULL;
+static Slab slabs[MAX_NODES][NCLASSES];	/* blocks from each node's arena */
+static int nnodes;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static void *(*user_malloc)(size_t) = NULL;
+static void (*user_free)(void *) = NULL;
+static int fixed = 0;		/* the allocator may no longer be replaced */
+static pthread_mutex_t fixMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void init(void) {
+    unsigned i, n;
+    int j;
+
+    nnodes = affinity_nodes();
+    for (j = 0; j < nnodes; j++)
+        for (i = 0; i < NCLASSES; i++) {
+            n = BLOCK_BYTES / (sizeof(MHdr) + classes[i]);
+            if (n < MIN_PER_BLOCK)
+                n = MIN_PER_BLOCK;
+            slabs[j][i] = slab_create(sizeof(MHdr) + classes[i], n,
+                                      arena_alloc);
+        }
+}
+
+int srpc_set_allocator(void *(*mallocf)(size_t), void (*freef)(void *)) {
+    int ans = 0;
+
+    pthread_mutex_lock(&fixMutex);
+    if (! fixed) {
+        if (mallocf == NULL || freef == NULL) {
+            user_malloc = NULL;
+            user_free = NULL;
+        } else {
+            user_malloc = mallocf;
+            user_free = freef;
+        }
+        ans = 1;
     }
-    result = NULL;
-    for (prev = NULL, cur = freeL; cur != NULL; prev = cur, cur = prev->next) {
-        if (cur->size >= len) {		/* FIRST FIT */
-            p = (unsigned char *)cur;	/* remember start of hole */
-            if ((cur->size - len) < sizeof(Hole)) {	/* remove from list */
-                if (prev == NULL)
-                    freeL = cur->next;
-                else
-                    prev->next = cur->next;
-            } else {			/* replace cur by remaining fragment */
-                Hole *frag = (Hole *)(p + len);
-                frag->size = cur->size -= len;
-                if (prev != NULL)
-                    prev->next = frag;
-                else
-                    freeL = frag;
-                frag->next = cur->next;
-                cur->size = len;
-            }
-            result = p + sizeof(size_t);
+    pthread_mutex_unlock(&fixMutex);
+    return ans;
+}
+
+/*
+ * fix the allocator before the first buffer is obtained, so that every
+ * buffer is freed by the allocator that provided it
+ */
+static void fix(void) {
+    pthread_mutex_lock(&fixMutex);
+    __atomic_store_n(&fixed, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&fixMutex);
+}
+
+void *srpc_malloc(size_t size) {
+    MHdr *h;
+    Slab s = NULL;
+    unsigned i;
+
+    if (! __atomic_load_n(&fixed, __ATOMIC_ACQUIRE))
+        fix();
+    if (user_malloc != NULL)
+        return user_malloc(size);
+    pthread_once(&once, init);
+    for (i = 0; i < NCLASSES; i++)
+        if (size <= classes[i]) {
+            s = slabs[affinity_node()][i];
             break;
         }
-    }
-    (void) pthread_mutex_unlock(&mutex);
-    return (void *)result;
+    if (s != NULL)
+        h = (MHdr *)slab_alloc(s);
+    else
+        h = (MHdr *)malloc(sizeof(MHdr) + size);
+    if (h == NULL)
+        return NULL;
+    h->slab = s;
+    return (void *)(h + 1);
 }
 
 void *srpc_calloc(size_t nmemb, size_t size) {
     void *ptr;
     size_t len;
 
-    len = nmemb * ((size - 1) /ALIGNMENT + 1) * ALIGNMENT;
+    if (size != 0 && nmemb > ((size_t)-1) / size)
+        return NULL;
+    len = nmemb * size;
     if ((ptr = srpc_malloc(len)) != NULL)
         (void) memset(ptr, 0, len);
     return (ptr);
 }
 
 void srpc_free(void *ptr) {
-    unsigned char *p = (unsigned char *)ptr - sizeof(size_t);
-    Hole *h = (Hole *)p;
-    Hole *prev, *cur;
+    MHdr *h;
 
-    if (ptr == NULL || p < heap || p >= (heap + HEAP_SIZE))
+    if (ptr == NULL)
+        return;
+    if (user_free != NULL) {
+        user_free(ptr);
         return;
-    /*
-     * find spot in list where freed node should go
-     */
-    (void) pthread_mutex_lock(&mutex);
-    for (prev = NULL, cur = freeL; cur < h; prev = cur, cur = prev->next)
-        ;
-    /*
-     * four possibilities at this juncture depending upon values for prev/cur
-     * NULL/NULL	free list was empty, simply add this node to list
-     * NULL/!NULL	either merge with cur or insert at beginning of list
-     * !NULL/NULL	either merge with prev or append to tail of list
-     * !NULL/!NULL	either merge with prev, merge with cur, or merge with both
-     */
-    if (cur == NULL) {		/* first attempt merger with cur */
-        h->next = NULL;		/* at tail of free list */
-    } else if ((p + h->size) == (unsigned char *)cur) {
-        h->size += cur->size;	/* merge with cur */
-        h->next = cur->next;
-    } else {
-        h->next = cur;		/* just link to cur */
-    }
-    if (prev == NULL) {		/* now attempt merger with prev */
-        freeL = h;		/* at head of free list */
-    } else if (((unsigned char *)prev + prev->size) == p) {
-        prev->size += h->size;	/* merge with prev */
-        prev->next = h->next;
-    } else {
-        prev->next = h;		/* just link to prev */
     }
-    (void) pthread_mutex_unlock(&mutex);
+    h = (MHdr *)ptr - 1;
+    if (h->slab != NULL)
+        slab_free(h->slab, h);
+    else
+        free(h);
 }
 
 void srpc_dump(void) {
-    Hole *p;
-    fprintf(stderr, "Current state of srpc_malloc free list\n");
-    (void) pthread_mutex_lock(&mutex);
-    for (p = freeL; p != NULL; p = p->next) {
-        fprintf(stderr, "chunk @ %p has %zd free bytes\n", p, p->size);
-    }
-    (void) pthread_mutex_unlock(&mutex);
+    char buf[48];
+    unsigned i;
+    int j;
+
+    fprintf(stderr, "Current state of srpc_malloc size classes\n");
+    pthread_once(&once, init);
+    for (j = 0; j < nnodes; j++)
+        for (i = 0; i < NCLASSES; i++) {
+            if (slabs[j][i] == NULL)
+                continue;
+            if (nnodes > 1)
+                sprintf(buf, "node %d class %zd", j, classes[i]);
+            else
+                sprintf(buf, "class %zd", classes[i]);
+            slab_dump(slabs[j][i], buf);
+        }
+    arena_dump();
 }
@@ -29,6 +29,23 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+/*
+ * srpcmalloc - size-class allocator for packet and message buffers used by
+ *              the SRPC system
+ *
+ * requests are rounded up to one of a small number of size classes chosen
+ * to fit SRPC's payloads: control payloads, a single packet (PKT_SIZE) and a
+ * fully reassembled message (MSG_SIZE); each class is a slab, so every
+ * thread keeps a cache of free buffers for each class it uses; the slabs
+ * obtain their blocks from the mmap-backed arena (see arena.h)
+ *
+ * every buffer is preceded by a header naming its class, so srpc_free() is
+ * O(1); requests larger than the largest class are passed to malloc()
+ *
+ * the allocator may be replaced by calling srpc_set_allocator() before the
+ * RPC system is initialized; buffers are aligned as those from malloc()
+ */
+
 #ifndef _SRPCMALLOC_H_
 #define _SRPCMALLOC_H_
 #include <stdlib.h>
@@ -39,6 +56,16 @@ void *srpc_calloc(size_t nmemb, size_t size);
 
 void srpc_free(void *ptr);
 
+/*
+ * direct calls to srpc_malloc()/srpc_free() to the supplied functions; if
+ * either is NULL, the size-class allocator is restored
+ *
+ * the allocator is fixed once srpc_malloc() has first been called, so that
+ * no buffer can be freed by an allocator other than the one it came from
+ * returns 1 if successful, 0 if the allocator is already fixed
+ */
+int srpc_set_allocator(void *(*mallocf)(size_t), void (*freef)(void *));
+
 void srpc_dump(void);
 
 #endif /* _SRPCMALLOC_H_ */
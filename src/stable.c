@@ -34,6 +34,7 @@
  */
 
 #include "stable.h"
+#include "srpcdefs.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -41,8 +42,10 @@
 
 #define STABLE_SIZE 13
 
-static SRecord *stable[STABLE_SIZE];	/* bucket listheads */
-static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+struct stable {
+    SRecord *buckets[STABLE_SIZE];	/* bucket listheads */
+    pthread_mutex_t mutex;
+};
 
 #define SHIFT 7
 static unsigned int hash(char *key) {
@@ -52,85 +55,101 @@ static unsigned int hash(char *key) {
     return h;
 }
 
-void stable_init() {
+STable *stable_new(void) {
+    STable *st;
     int i;
 
+    if ((st = (STable *)malloc(sizeof(STable))) == NULL)
+        return NULL;
     for (i = 0; i < STABLE_SIZE; i++)
-        stable[i] = NULL;
+        st->buckets[i] = NULL;
+    pthread_mutex_init(&st->mutex, NULL);
+    return st;
 }
 
-SRecord *stable_create(char *serviceName) {
+void stable_free(STable *st) {
+    pthread_mutex_destroy(&st->mutex);
+    free(st);
+}
+
+SRecord *stable_create(STable *st, char *serviceName) {
     SRecord *r;
     unsigned int hv;
 
-    if (stable_lookup(serviceName))
+    if (stable_lookup(st, serviceName))
         r = NULL;
     else {
         r = (SRecord *)malloc(sizeof(SRecord));
         if (r) {
             r->s_name = strdup(serviceName);
             r->s_next = NULL;
-            r->s_queue = tsl_create();
+            r->s_inline = NULL;
+            r->s_inlineArg = NULL;
+            r->s_dispatch = NULL;
+            r->s_dispatchArg = NULL;
+            r->s_dispatching = 0;
+            r->s_ctx = NULL;
+            r->s_queue = squeue_create(SQUEUE_SIZE);
             if (! r->s_queue) {
                 free(r->s_name);
                 free(r);
                 r = NULL;
             } else {
                 hv = hash(r->s_name);
-                pthread_mutex_lock(&mutex);
-                r->s_next = stable[hv];
-                stable[hv] = r;
-                pthread_mutex_unlock(&mutex);
+                pthread_mutex_lock(&st->mutex);
+                r->s_next = st->buckets[hv];
+                st->buckets[hv] = r;
+                pthread_mutex_unlock(&st->mutex);
             }
         }
     }
     return r;
 }
 
-SRecord *stable_lookup(char *name) {
+SRecord *stable_lookup(STable *st, char *name) {
     unsigned int hv = hash(name);
     SRecord *r, *ans = NULL;
 
-    pthread_mutex_lock(&mutex);
-    for (r = stable[hv]; r != NULL; r = r->s_next)
+    pthread_mutex_lock(&st->mutex);
+    for (r = st->buckets[hv]; r != NULL; r = r->s_next)
         if (strcmp(r->s_name, name) == 0) {
             ans = r;
             break;
         }
-    pthread_mutex_unlock(&mutex);
+    pthread_mutex_unlock(&st->mutex);
     return ans;
 }
 
-void stable_remove(SRecord *sr) {
+void stable_remove(STable *st, SRecord *sr) {
     SRecord *pr, *cu;
     unsigned int hv = hash(sr->s_name);
 
-    pthread_mutex_lock(&mutex);
-    for (pr = NULL, cu = stable[hv]; cu != NULL; pr = cu, cu = pr->s_next) {
+    pthread_mutex_lock(&st->mutex);
+    for (pr = NULL, cu = st->buckets[hv]; cu != NULL; pr = cu, cu = pr->s_next) {
         if (strcmp(sr->s_name, cu->s_name) == 0) {
             if (pr == NULL)
-                stable[hv] = cu->s_next;
+                st->buckets[hv] = cu->s_next;
             else
                 pr->s_next = cu->s_next;
             break;
         }
     }
-    pthread_mutex_unlock(&mutex);
-    /* should destroy the TSList before deallocating structure */
+    pthread_mutex_unlock(&st->mutex);
+    /* should destroy the SQueue before deallocating structure */
     free(sr);
 }
 
-void stable_dump(void) {
+void stable_dump(STable *st) {
     SRecord *p;
     int i;
 
-    pthread_mutex_lock(&mutex);
+    pthread_mutex_lock(&st->mutex);
     printf("Service table:");
     for (i = 0; i < STABLE_SIZE; i++) {
-        for (p = stable[i]; p != NULL; p = p->s_next) {
+        for (p = st->buckets[i]; p != NULL; p = p->s_next) {
             printf(" %s", p->s_name);
         }
     }
     printf("\n");
-    pthread_mutex_unlock(&mutex);
+    pthread_mutex_unlock(&st->mutex);
 }
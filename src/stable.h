@@ -31,27 +31,49 @@
 
 /*
  * interface and data structures associated table holding offered services
+ * each RPC context (see srpc.h) has its own table
  */
 #ifndef _STABLE_H_
 #define _STABLE_H_
 
-#include "tslist.h"
+#include "squeue.h"
+#include "endpoint.h"
+
+struct rpc_query;
+struct context;
+
+typedef struct stable STable;
 
 typedef struct s_record {
     struct s_record *s_next;
     char *s_name;
-    TSList s_queue;
+    SQueue s_queue;
+    /* handler run by the reader thread, NULL if none (see rpc_serve_inline) */
+    int (*s_inline)(void *, RpcEndpoint *, void *, unsigned, void *, unsigned,
+                    unsigned *);
+    void *s_inlineArg;
+    /* receives each query instead of s_queue, NULL if none (rpc_serve_async) */
+    void (*s_dispatch)(void *, struct rpc_query *);
+    void *s_dispatchArg;
+    unsigned s_dispatching;	/* calls to a dispatch in progress */
+    struct context *s_ctx;	/* context offering the service */
 } SRecord;
 
 /*
- * initialize the data structures for holding offered services
+ * create an empty table for holding offered services
+ * returns NULL if error
  */
-void stable_init();
+STable *stable_new(void);
 
 /*
  * create a new offered service; return NULL if error or if record exists
  */
-SRecord *stable_create(char *serviceName);
+SRecord *stable_create(STable *st, char *serviceName);
+
+/*
+ * destroy a table in which no service has been offered
+ */
+void stable_free(STable *st);
 
 /*
  * lookup the service record associated with a particular 8-char service name
@@ -59,18 +81,18 @@ SRecord *stable_create(char *serviceName);
  * if successful, returns the associated service record
  * if not, returns NULL
  */
-SRecord *stable_lookup(char *name);
+SRecord *stable_lookup(STable *st, char *name);
 
 /*
  * destroy the service associated with a particular service name
  *
  * there is no return value
  */
-void stable_destroy(SRecord *sr);
+void stable_destroy(STable *st, SRecord *sr);
 
 /*
  * dump service table
  */
-void stable_dump(void);
+void stable_dump(STable *st);
 
 #endif /* _STABLE_H_ */
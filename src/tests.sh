@@ -1,15 +1,45 @@
 echo starting echoserver >/dev/tty
 ./echoserver&
+./echoserver -p 20001 -t 4 -c 0&
+./echoserver -p 20002 -i -r 1048576&
+./cppbench -S -p 20003&
+./echoserver -p 20004 -x 2&
 echo running conntest >/dev/tty
-./conntest -a 10
+./conntest -a 10 -m 500 -w 4
 echo running sinktest \(It takes a while ... \) >/dev/tty
 ./sinktest >/dev/null
+./sinktest -e -b -m 5000 >/dev/null
 echo running echoclient >/dev/tty
 ./echoclient <echoclient.c | diff - echoclient.c
+./echoclient -r 10 -b 50 -B 100 -P 100 <echoclient.c | diff - echoclient.c
 echo running sinkclient >/dev/tty
 ./sinkclient <sinkclient.c
 echo running sgenclient >/dev/tty
 ./sgenclient -l 10000 >/dev/null
 echo running mthclient >/dev/tty
 ./mthclient -t 4 -l 10000
-kill %1
+echo running mthclient against pooled echoserver >/dev/tty
+./mthclient -p 20001 -t 4 -l 10000
+echo running asyncclient >/dev/tty
+./asyncclient -c 4 -l 10000
+./asyncclient -c 4 -l 10000 -k
+echo running clients against inline echoserver >/dev/tty
+./echoclient -p 20002 <echoclient.c | diff - echoclient.c
+./sinktest -p 20002 -e -m 3000 >/dev/null
+echo running latbench >/dev/tty
+./latbench -l 5000
+./latbench -l 5000 -w 20
+echo running clients against per-context echoservers >/dev/tty
+./latbench -l 5000 -t 2 -x -p 20005
+./latbench -l 2000 -t 2 -P -p 20005
+./echoclient -p 20006 <echoclient.c | diff - echoclient.c
+echo running cppbench >/dev/tty
+./cppbench -c 4 -l 5000
+./echoclient -p 20003 <echoclient.c | diff - echoclient.c
+./sinktest -p 20003 -e -m 3000 >/dev/null
+echo running ccbench >/dev/tty
+./ccbench -l 20 -t 4 -g 4
+echo running allocbench >/dev/tty
+./allocbench -z
+./allocbench -z -b 5000
+kill %1 %2 %3 %4 %5
@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * transport.c - the UDP transport, and the entry points common to all
+ *               transports, for simple RPC system
+ */
+
+#include "transport.h"
+#include "srpcdefs.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#ifdef SO_RCVBUFFORCE
+#define RCVBUF_FORCE SO_RCVBUFFORCE
+#define SNDBUF_FORCE SO_SNDBUFFORCE
+#else
+#define RCVBUF_FORCE -1
+#define SNDBUF_FORCE -1
+#endif /* SO_RCVBUFFORCE */
+
+/*
+ * size the buffer of `sock' selected by `opt' to `bytes', if positive,
+ * trying `force' (SO_RCVBUFFORCE or SO_SNDBUFFORCE) first, so that a
+ * privileged process may exceed the system limit, if it is not -1
+ */
+static void size_buffer(int sock, int opt, int force, int bytes) {
+    if (bytes <= 0)
+        return;
+    if (force != -1 &&
+            setsockopt(sock, SOL_SOCKET, force, &bytes, sizeof(bytes)) == 0)
+        return;
+    if (setsockopt(sock, SOL_SOCKET, opt, &bytes, sizeof(bytes)) != 0) {
+        warningf("unable to set socket buffer size to %d\n", bytes);
+    }
+}
+
+int transport_udp_init(Transport *t, unsigned short port, int rcvbytes,
+                       int sndbytes) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    memset(&addr, 0, len);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    t->dropped = 0;
+    t->sent = 0;
+    t->deferred = 0;
+    t->failed = 0;
+    t->src = 0;
+    if ((t->fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+        return 0;
+    size_buffer(t->fd, SO_RCVBUF, RCVBUF_FORCE, rcvbytes);
+    size_buffer(t->fd, SO_SNDBUF, SNDBUF_FORCE, sndbytes);
+#ifdef SO_RXQ_OVFL
+    {
+        int on = 1;
+        (void)setsockopt(t->fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+    }
+#endif /* SO_RXQ_OVFL */
+    if (bind(t->fd, (struct sockaddr *)&addr, len) < 0 ||
+            getsockname(t->fd, (struct sockaddr *)&addr, &len) < 0) {
+        close(t->fd);
+        return 0;
+    }
+    t->port = ntohs(addr.sin_port);
+    return 1;
+}
+
+/*
+ * where the kernel supports SO_RXQ_OVFL, the number of datagrams that it
+ * has dropped on the socket for want of buffer space accompanies a packet
+ * whenever it is non-zero, and is recorded in the transport
+ */
+int transport_udp_recv(Transport *t, void *buf, unsigned size,
+                       struct sockaddr_in *from, int wait) {
+    int flags = wait ? 0 : MSG_DONTWAIT;
+#ifdef SO_RXQ_OVFL
+    char ctl[CMSG_SPACE(sizeof(unsigned int))];
+    struct cmsghdr *cm;
+    struct msghdr mh;
+    struct iovec iov;
+    unsigned int d;
+    int n;
+
+    iov.iov_base = buf;
+    iov.iov_len = size;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_name = from;
+    mh.msg_namelen = sizeof(*from);
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = ctl;
+    mh.msg_controllen = sizeof(ctl);
+    if ((n = recvmsg(t->fd, &mh, flags)) < 0)
+        return n;
+    for (cm = CMSG_FIRSTHDR(&mh); cm != NULL; cm = CMSG_NXTHDR(&mh, cm))
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_RXQ_OVFL) {
+            memcpy(&d, CMSG_DATA(cm), sizeof(d));
+            __atomic_store_n(&t->dropped, d, __ATOMIC_RELAXED);
+        }
+    return n;
+#else
+    socklen_t len = sizeof(*from);
+
+    return recvfrom(t->fd, buf, size, flags, (struct sockaddr *)from, &len);
+#endif /* SO_RXQ_OVFL */
+}
+
+int transport_udp_send(Transport *t, struct sockaddr_in *to, void *pkt,
+                       unsigned size) {
+    return sendto(t->fd, pkt, size, 0, (struct sockaddr *)to,
+                  sizeof(*to)) != -1;
+}
+
+/*
+ * the interface is named in an IP_PKTINFO control message, which also
+ * carries the source address, as the kernel would otherwise take that of
+ * the interface
+ */
+static int udp_send_via(Transport *t, struct sockaddr_in *to, void *pkt,
+                        unsigned size, unsigned ifindex) {
+#ifdef IP_PKTINFO
+    union {
+        struct cmsghdr cm;
+        char buf[CMSG_SPACE(sizeof(struct in_pktinfo))];
+    } ctl;
+    struct msghdr mh;
+    struct iovec iov;
+    struct cmsghdr *cm;
+    struct in_pktinfo pi;
+
+    iov.iov_base = pkt;
+    iov.iov_len = size;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_name = to;
+    mh.msg_namelen = sizeof(*to);
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = ctl.buf;
+    mh.msg_controllen = sizeof(ctl.buf);
+    cm = CMSG_FIRSTHDR(&mh);
+    cm->cmsg_level = IPPROTO_IP;
+    cm->cmsg_type = IP_PKTINFO;
+    cm->cmsg_len = CMSG_LEN(sizeof(pi));
+    memset(&pi, 0, sizeof(pi));
+    pi.ipi_ifindex = ifindex;
+    pi.ipi_spec_dst.s_addr = t->src;
+    memcpy(CMSG_DATA(cm), &pi, sizeof(pi));
+    if (sendmsg(t->fd, &mh, 0) != -1)
+        return 1;
+#else
+    (void)ifindex;
+#endif /* IP_PKTINFO */
+    return transport_udp_send(t, to, pkt, size);
+}
+
+static unsigned long udp_dropped(Transport *t) {
+    return __atomic_load_n(&t->dropped, __ATOMIC_RELAXED);
+}
+
+static void udp_close(Transport *t) {
+    close(t->fd);
+    free(t);
+}
+
+static const TransportOps udpOps = {
+    transport_udp_recv, transport_udp_send, udp_dropped, udp_close,
+    udp_send_via
+};
+
+Transport *transport_udp(unsigned short port, int rcvbytes, int sndbytes) {
+    Transport *t = (Transport *)malloc(sizeof(Transport));
+
+    if (t != NULL) {
+        t->ops = &udpOps;
+        if (! transport_udp_init(t, port, rcvbytes, sndbytes)) {
+            free(t);
+            t = NULL;
+        }
+    }
+    return t;
+}
+
+int transport_recv(Transport *t, void *buf, unsigned size,
+                   struct sockaddr_in *from, int wait) {
+    return t->ops->recv(t, buf, size, from, wait);
+}
+
+int transport_send(Transport *t, struct sockaddr_in *to, void *pkt,
+                   unsigned size) {
+    return t->ops->send(t, to, pkt, size);
+}
+
+int transport_send_via(Transport *t, struct sockaddr_in *to, void *pkt,
+                       unsigned size, unsigned ifindex) {
+    if (ifindex == 0 || t->ops->send_via == NULL)
+        return t->ops->send(t, to, pkt, size);
+    return t->ops->send_via(t, to, pkt, size, ifindex);
+}
+
+int transport_busy_poll(Transport *t, unsigned usecs) {
+    int ans = 1;
+    int v;
+
+#ifdef SO_BUSY_POLL
+    v = (int)usecs;
+    if (setsockopt(t->fd, SOL_SOCKET, SO_BUSY_POLL, &v, sizeof(v)) != 0)
+        ans = 0;
+#else
+    ans = 0;
+#endif /* SO_BUSY_POLL */
+#ifdef SO_PREFER_BUSY_POLL
+    v = (usecs > 0);
+    (void)setsockopt(t->fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &v, sizeof(v));
+#endif /* SO_PREFER_BUSY_POLL */
+    return ans;
+}
+
+unsigned long transport_dropped(Transport *t) {
+    return t->ops->dropped(t);
+}
+
+void transport_close(Transport *t) {
+    t->ops->close(t);
+}
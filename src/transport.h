@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * transport.h - packet transports for the SRPC system
+ *
+ * a context exchanges packets with its peers through a transport rather
+ * than directly through a socket, so that the protocol machinery above it
+ * is the same whatever carries the packets
+ *
+ * the UDP transport is a datagram socket bound to the context's port, and
+ * is always available; the XDP transport (see xdp.c), which requires
+ * HAVE_AF_XDP, receives the datagrams for the port through an AF_XDP
+ * socket, bypassing the socket layer, and transmits through it to the
+ * peers from which it has received, using a UDP transport on the same port
+ * for everything else
+ */
+
+#ifndef _TRANSPORT_H_
+#define _TRANSPORT_H_
+
+#include <netinet/in.h>
+
+typedef struct transport Transport;
+
+/*
+ * the operations that distinguish one kind of transport from another
+ */
+typedef struct transport_ops {
+    int (*recv)(Transport *t, void *buf, unsigned size,
+                struct sockaddr_in *from, int wait);
+    int (*send)(Transport *t, struct sockaddr_in *to, void *pkt,
+                unsigned size);
+    unsigned long (*dropped)(Transport *t);
+    void (*close)(Transport *t);
+    int (*send_via)(Transport *t, struct sockaddr_in *to, void *pkt,
+                    unsigned size, unsigned ifindex);	/* or NULL */
+} TransportOps;
+
+struct transport {
+    const TransportOps *ops;
+    int fd;			/* the UDP socket */
+    unsigned short port;	/* to which it is bound */
+    unsigned long dropped;	/* as last reported by SO_RXQ_OVFL */
+    in_addr_t src;		/* source address for transport_send_via() */
+    unsigned long sent;		/* packets transmitted (see outbox.h) */
+    unsigned long deferred;	/* of those, deferred by an outbox */
+    unsigned long failed;	/* of those, refused by the kernel */
+};
+
+/*
+ * open a UDP transport bound to `port', or to a port assigned dynamically
+ * if 0, with receive and send buffers of `rcvbytes' and `sndbytes' unless
+ * these are 0
+ * returns NULL if error
+ */
+Transport *transport_udp(unsigned short port, int rcvbytes, int sndbytes);
+
+/*
+ * open an XDP transport for `port' on queue `queue' of interface `ifname';
+ * the XDP program is attached in generic (SKB) mode, which works with any
+ * interface, or in driver mode if `native' is non-zero
+ * returns NULL if error, or if HAVE_AF_XDP was not defined
+ */
+Transport *transport_xdp(unsigned short port, int rcvbytes, int sndbytes,
+                         const char *ifname, unsigned queue, int native);
+
+/*
+ * read a packet of at most `size' bytes into `buf', filling in its source
+ * address in `from'; if `wait' is zero and no packet is waiting, fails at
+ * once with errno set to EAGAIN
+ * returns the length of the packet, or -1 if error
+ */
+int transport_recv(Transport *t, void *buf, unsigned size,
+                   struct sockaddr_in *from, int wait);
+
+/*
+ * transmit `size' bytes at `pkt' to `to'
+ * returns 1 if successful, 0 otherwise
+ */
+int transport_send(Transport *t, struct sockaddr_in *to, void *pkt,
+                   unsigned size);
+
+/*
+ * transmit as transport_send() does, but out of the interface whose index
+ * is `ifindex', with the transport's `src' as the source address; falls
+ * back to transport_send() if `ifindex' is 0, if the transport cannot
+ * choose the interface, or if the packet cannot leave by it
+ * returns 1 if successful, 0 otherwise
+ */
+int transport_send_via(Transport *t, struct sockaddr_in *to, void *pkt,
+                       unsigned size, unsigned ifindex);
+
+/*
+ * ask the kernel to busy-poll the transport's sockets for up to `usecs'
+ * microseconds when they are read; 0 restores the usual behaviour
+ * returns 1 if successful, 0 if unsupported or not permitted
+ */
+int transport_busy_poll(Transport *t, unsigned usecs);
+
+/*
+ * returns the number of packets for the transport that the kernel has
+ * dropped for want of buffer or ring space
+ */
+unsigned long transport_dropped(Transport *t);
+
+/*
+ * close the transport and release its resources
+ */
+void transport_close(Transport *t);
+
+/*
+ * the UDP operations, for use by transports that build upon a UDP socket;
+ * transport_udp_init() sets up `t' as transport_udp() does, returning 1 if
+ * successful, 0 otherwise
+ */
+int transport_udp_init(Transport *t, unsigned short port, int rcvbytes,
+                       int sndbytes);
+int transport_udp_recv(Transport *t, void *buf, unsigned size,
+                       struct sockaddr_in *from, int wait);
+int transport_udp_send(Transport *t, struct sockaddr_in *to, void *pkt,
+                       unsigned size);
+
+#endif /* _TRANSPORT_H_ */
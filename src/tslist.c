@@ -34,6 +34,7 @@
  */
 
 #include "tslist.h"
+#include "slab.h"
 #include <stdlib.h>
 #include <pthread.h>
 
@@ -52,6 +53,22 @@ typedef struct listhead {
     pthread_cond_t nonempty;
 } ListHead;
 
+#define ELEMENTS_PER_BLOCK 256
+
+static Slab elSlab = NULL;	/* elements for all lists */
+static pthread_once_t elOnce = PTHREAD_ONCE_INIT;
+
+static void elslab_init(void) {
+    elSlab = slab_create(sizeof(Element), ELEMENTS_PER_BLOCK, NULL);
+}
+
+static Element *element_alloc(void) {
+    pthread_once(&elOnce, elslab_init);
+    if (elSlab == NULL)
+        return NULL;
+    return (Element *)slab_alloc(elSlab);
+}
+
 /*
  * constructor
  * returns NULL if error
@@ -77,7 +94,7 @@ TSList tsl_create() {
  */
 int tsl_append(TSList tsl, void *a, void *b, int size) {
     ListHead *lh = (ListHead *)tsl;
-    Element *e = (Element *)malloc(sizeof(Element));
+    Element *e = element_alloc();
     if (e == NULL)
         return 0;
     e->addr = a;
@@ -99,7 +116,7 @@ int tsl_append(TSList tsl, void *a, void *b, int size) {
  * returns 0 if failure to prepend (malloc failure), otherwise 1 */
 int tsl_prepend(TSList tsl, void *a, void *b, int size) {
     ListHead *lh = (ListHead *)tsl;
-    Element *e = (Element *)malloc(sizeof(Element));
+    Element *e = element_alloc();
     if (e == NULL)
         return 0;
     e->addr = a;
@@ -134,7 +151,7 @@ void tsl_remove(TSList tsl, void **a, void **b, int *size) {
     *a = e->addr;
     *b = e->data;
     *size = e->size;
-    free(e);
+    slab_free(elSlab, e);
 }
 
 /* remove first element of the list if there, do not block, return 1/0 */
@@ -158,6 +175,6 @@ int tsl_remove_nb(TSList tsl, void **a, void **b, int *size) {
     *a = e->addr;
     *b = e->data;
     *size = e->size;
-    free(e);
+    slab_free(elSlab, e);
     return 1;
 }
@@ -0,0 +1,540 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * xdp.c - the XDP transport for simple RPC system
+ *
+ * an AF_XDP socket is bound to one queue of an interface, and a small XDP
+ * program attached to the interface redirects the IPv4 UDP datagrams for
+ * the transport's port into it through an XSKMAP; the socket shares with
+ * the kernel a UMEM of XDP_FRAMES frames, the first half of which are
+ * lent to the kernel through the fill ring to receive into, and the
+ * second half of which are kept on a free list for transmission
+ *
+ * the reader copies each datagram out of its frame, noting the MAC and
+ * IPv4 addresses of the peer and of this end, and returns the frame to the
+ * fill ring; packets to peers so noted are built in a free frame and put
+ * on the TX ring, and all others are sent through the UDP socket on the
+ * same port, which also receives whatever arrives on other interfaces
+ *
+ * the program is written directly as BPF instructions, so that neither
+ * libbpf nor a BPF compiler is needed, and is attached through a BPF link,
+ * so that it is detached when the process exits
+ */
+
+#include "transport.h"
+#include "srpcdefs.h"
+#include <stdlib.h>
+
+#ifdef HAVE_AF_XDP
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+
+#define FRAME_SIZE 2048
+#define RING_SIZE (XDP_FRAMES / 2)
+#define HDR_SIZE 42			/* Ethernet, IPv4 without options, UDP */
+#define MAX_QUEUES 64			/* entries in the XSKMAP */
+#define NEIGHBOURS 256			/* must be a power of 2 */
+
+/*
+ * the two ends of a conversation: the peer, and this end as the peer
+ * addressed it
+ */
+typedef struct neighbour {
+    in_addr_t peer;
+    in_addr_t self;
+    unsigned char peerMac[6];
+    unsigned char selfMac[6];
+} Neighbour;
+
+typedef struct ring {
+    unsigned *producer;
+    unsigned *consumer;
+    void *descs;
+    void *map;
+    size_t len;
+} Ring;
+
+typedef struct xdp {
+    Transport t;			/* must be first */
+    int xsk;
+    int xskmap;
+    int prog;
+    int link;
+    unsigned char *umem;
+    Ring fill, rx, tx, comp;
+    pthread_mutex_t rxLock;		/* guards rx and fill rings */
+    pthread_mutex_t txLock;		/* guards the rest of the following */
+    unsigned long frames[RING_SIZE];	/* free transmit frames */
+    unsigned nframes;
+    unsigned short ipid;
+    Neighbour nbrs[NEIGHBOURS];		/* direct-mapped, by peer address */
+} Xdp;
+
+static int bpf(int cmd, union bpf_attr *attr) {
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/*
+ * BPF instruction encodings, after those in the kernel's filter.h
+ */
+#define INSN(c, d, s, o, i) ((struct bpf_insn){.code=(c), .dst_reg=(d), \
+                                               .src_reg=(s), .off=(o), \
+                                               .imm=(i)})
+#define MOV_REG(d, s) INSN(BPF_ALU64|BPF_MOV|BPF_X, d, s, 0, 0)
+#define MOV_IMM(d, i) INSN(BPF_ALU64|BPF_MOV|BPF_K, d, 0, 0, i)
+#define ALU_IMM(op, d, i) INSN(BPF_ALU64|(op)|BPF_K, d, 0, 0, i)
+#define LDX(sz, d, s, o) INSN(BPF_LDX|(sz)|BPF_MEM, d, s, o, 0)
+#define JMP_REG(op, d, s, o) INSN(BPF_JMP|(op)|BPF_X, d, s, o, 0)
+#define JMP_IMM(op, d, i, o) INSN(BPF_JMP|(op)|BPF_K, d, 0, o, i)
+#define CALL(f) INSN(BPF_JMP|BPF_CALL, 0, 0, 0, f)
+#define EXIT() INSN(BPF_JMP|BPF_EXIT, 0, 0, 0, 0)
+#define PASS 0x7fff			/* jump to the XDP_PASS exit */
+
+/*
+ * load the XDP program that redirects the IPv4 UDP datagrams for `port',
+ * unfragmented and without options, to the socket in `xskmap' for the
+ * queue on which they arrived, and passes everything else to the stack
+ * returns the program's file descriptor, or -1 if error
+ */
+static int load_program(int xskmap, unsigned short port) {
+    struct bpf_insn prog[] = {
+        MOV_REG(BPF_REG_6, BPF_REG_1),
+        LDX(BPF_W, BPF_REG_2, BPF_REG_1, 0),		/* data */
+        LDX(BPF_W, BPF_REG_3, BPF_REG_1, 4),		/* data_end */
+        MOV_REG(BPF_REG_4, BPF_REG_2),
+        ALU_IMM(BPF_ADD, BPF_REG_4, HDR_SIZE),
+        JMP_REG(BPF_JGT, BPF_REG_4, BPF_REG_3, PASS),
+        LDX(BPF_H, BPF_REG_4, BPF_REG_2, 12),		/* ethertype */
+        JMP_IMM(BPF_JNE, BPF_REG_4, htons(0x0800), PASS),
+        LDX(BPF_B, BPF_REG_4, BPF_REG_2, 14),		/* version, IHL */
+        JMP_IMM(BPF_JNE, BPF_REG_4, 0x45, PASS),
+        LDX(BPF_B, BPF_REG_4, BPF_REG_2, 23),		/* protocol */
+        JMP_IMM(BPF_JNE, BPF_REG_4, 17, PASS),
+        LDX(BPF_H, BPF_REG_4, BPF_REG_2, 20),		/* fragment */
+        ALU_IMM(BPF_AND, BPF_REG_4, htons(0x3fff)),
+        JMP_IMM(BPF_JNE, BPF_REG_4, 0, PASS),
+        LDX(BPF_H, BPF_REG_4, BPF_REG_2, 36),		/* UDP dest port */
+        JMP_IMM(BPF_JNE, BPF_REG_4, htons(port), PASS),
+        LDX(BPF_W, BPF_REG_2, BPF_REG_6, 16),		/* rx_queue_index */
+        INSN(BPF_LD|BPF_DW|BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, xskmap),
+        INSN(0, 0, 0, 0, 0),
+        MOV_IMM(BPF_REG_3, XDP_PASS),		/* if no socket on queue */
+        CALL(BPF_FUNC_redirect_map),
+        EXIT(),
+        MOV_IMM(BPF_REG_0, XDP_PASS),		/* PASS */
+        EXIT()
+    };
+    unsigned n = sizeof(prog) / sizeof(prog[0]);
+    union bpf_attr attr;
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+        if (BPF_CLASS(prog[i].code) == BPF_JMP && prog[i].off == PASS)
+            prog[i].off = (n - 2) - (i + 1);
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.expected_attach_type = BPF_XDP;
+    attr.insn_cnt = n;
+    attr.insns = (unsigned long)prog;
+    attr.license = (unsigned long)"Dual BSD/GPL";
+    return bpf(BPF_PROG_LOAD, &attr);
+}
+
+/*
+ * map ring `r' of the socket at page offset `pgoff', with `entry'-byte
+ * descriptors laid out as `off' describes
+ * returns 1 if successful, 0 otherwise
+ */
+static int map_ring(Xdp *x, Ring *r, struct xdp_ring_offset *off,
+                    unsigned long pgoff, size_t entry) {
+    char *p;
+
+    r->len = off->desc + RING_SIZE * entry;
+    p = mmap(NULL, r->len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+             x->xsk, pgoff);
+    if (p == MAP_FAILED) {
+        r->map = NULL;
+        return 0;
+    }
+    r->map = p;
+    r->producer = (unsigned *)(p + off->producer);
+    r->consumer = (unsigned *)(p + off->consumer);
+    r->descs = p + off->desc;
+    return 1;
+}
+
+/*
+ * register the UMEM, create and map the rings, and lend the receive
+ * frames to the kernel
+ * returns 1 if successful, 0 otherwise
+ */
+static int setup_socket(Xdp *x) {
+    struct xdp_umem_reg mr;
+    struct xdp_mmap_offsets off;
+    socklen_t len = sizeof(off);
+    int n = RING_SIZE;
+    unsigned long *fill;
+    unsigned i;
+
+    x->umem = mmap(NULL, (size_t)XDP_FRAMES * FRAME_SIZE,
+                   PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (x->umem == MAP_FAILED) {
+        x->umem = NULL;
+        return 0;
+    }
+    memset(&mr, 0, sizeof(mr));
+    mr.addr = (unsigned long)x->umem;
+    mr.len = (unsigned long)XDP_FRAMES * FRAME_SIZE;
+    mr.chunk_size = FRAME_SIZE;
+    if (setsockopt(x->xsk, SOL_XDP, XDP_UMEM_REG, &mr, sizeof(mr)) != 0 ||
+        setsockopt(x->xsk, SOL_XDP, XDP_UMEM_FILL_RING, &n, sizeof(n)) != 0 ||
+        setsockopt(x->xsk, SOL_XDP, XDP_UMEM_COMPLETION_RING,
+                   &n, sizeof(n)) != 0 ||
+        setsockopt(x->xsk, SOL_XDP, XDP_RX_RING, &n, sizeof(n)) != 0 ||
+        setsockopt(x->xsk, SOL_XDP, XDP_TX_RING, &n, sizeof(n)) != 0 ||
+        getsockopt(x->xsk, SOL_XDP, XDP_MMAP_OFFSETS, &off, &len) != 0)
+        return 0;
+    if (! map_ring(x, &x->fill, &off.fr, XDP_UMEM_PGOFF_FILL_RING,
+                   sizeof(unsigned long)) ||
+        ! map_ring(x, &x->comp, &off.cr, XDP_UMEM_PGOFF_COMPLETION_RING,
+                   sizeof(unsigned long)) ||
+        ! map_ring(x, &x->rx, &off.rx, XDP_PGOFF_RX_RING,
+                   sizeof(struct xdp_desc)) ||
+        ! map_ring(x, &x->tx, &off.tx, XDP_PGOFF_TX_RING,
+                   sizeof(struct xdp_desc)))
+        return 0;
+    fill = (unsigned long *)x->fill.descs;
+    for (i = 0; i < RING_SIZE; i++) {
+        fill[i] = (unsigned long)i * FRAME_SIZE;
+        x->frames[i] = (unsigned long)(RING_SIZE + i) * FRAME_SIZE;
+    }
+    x->nframes = RING_SIZE;
+    __atomic_store_n(x->fill.producer, RING_SIZE, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/*
+ * create the XSKMAP holding the socket for `queue', load the program and
+ * attach it to interface `ifindex' in the mode given by `native'
+ * returns 1 if successful, 0 otherwise
+ */
+static int attach_program(Xdp *x, unsigned ifindex, unsigned queue,
+                          int native) {
+    union bpf_attr attr;
+    unsigned key = queue;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(unsigned);
+    attr.value_size = sizeof(int);
+    attr.max_entries = MAX_QUEUES;
+    if ((x->xskmap = bpf(BPF_MAP_CREATE, &attr)) < 0)
+        return 0;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = x->xskmap;
+    attr.key = (unsigned long)&key;
+    attr.value = (unsigned long)&x->xsk;
+    if (bpf(BPF_MAP_UPDATE_ELEM, &attr) != 0)
+        return 0;
+    if ((x->prog = load_program(x->xskmap, x->t.port)) < 0)
+        return 0;
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = x->prog;
+    attr.link_create.target_ifindex = ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = native ? XDP_FLAGS_DRV_MODE : XDP_FLAGS_SKB_MODE;
+    return ((x->link = bpf(BPF_LINK_CREATE, &attr)) >= 0);
+}
+
+static Neighbour *neighbour(Xdp *x, in_addr_t peer) {
+    unsigned h = ntohl(peer);
+
+    return &x->nbrs[(h ^ (h >> 8)) & (NEIGHBOURS - 1)];
+}
+
+/*
+ * note the addresses of both ends of the datagram in `frame'
+ */
+static void learn(Xdp *x, unsigned char *frame) {
+    Neighbour *nb;
+    in_addr_t peer, self;
+
+    memcpy(&peer, frame + 26, 4);
+    memcpy(&self, frame + 30, 4);
+    pthread_mutex_lock(&x->txLock);
+    nb = neighbour(x, peer);
+    nb->peer = peer;
+    nb->self = self;
+    memcpy(nb->peerMac, frame + 6, 6);
+    memcpy(nb->selfMac, frame, 6);
+    pthread_mutex_unlock(&x->txLock);
+}
+
+/*
+ * take the next datagram, if any, off the RX ring, as transport_recv()
+ * returns its length, or -1 if the ring is empty
+ */
+static int ring_recv(Xdp *x, void *buf, unsigned size,
+                     struct sockaddr_in *from) {
+    struct xdp_desc *d;
+    unsigned long *fill;
+    unsigned char *frame;
+    unsigned cons, prod, ulen;
+    int n = -1;
+
+    pthread_mutex_lock(&x->rxLock);
+    cons = *x->rx.consumer;
+    if (__atomic_load_n(x->rx.producer, __ATOMIC_ACQUIRE) != cons) {
+        d = (struct xdp_desc *)x->rx.descs + (cons & (RING_SIZE - 1));
+        frame = x->umem + d->addr;
+        ulen = (frame[38] << 8) | frame[39];	/* excludes Ethernet padding */
+        if (ulen < 8 || ulen - 8 > d->len - HDR_SIZE)
+            ulen = d->len - HDR_SIZE + 8;
+        n = (ulen - 8 > size) ? size : ulen - 8;
+        memcpy(buf, frame + HDR_SIZE, n);
+        from->sin_family = AF_INET;
+        memcpy(&from->sin_addr.s_addr, frame + 26, 4);
+        memcpy(&from->sin_port, frame + 34, 2);
+        learn(x, frame);
+        prod = *x->fill.producer;
+        fill = (unsigned long *)x->fill.descs;
+        fill[prod & (RING_SIZE - 1)] =
+            d->addr & ~(unsigned long)(FRAME_SIZE - 1);
+        __atomic_store_n(x->fill.producer, prod + 1, __ATOMIC_RELEASE);
+        __atomic_store_n(x->rx.consumer, cons + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&x->rxLock);
+    return n;
+}
+
+static int xdp_recv(Transport *t, void *buf, unsigned size,
+                    struct sockaddr_in *from, int wait) {
+    Xdp *x = (Xdp *)t;
+    struct pollfd fds[2];
+    int n;
+
+    for (;;) {
+        if ((n = ring_recv(x, buf, size, from)) >= 0)
+            return n;
+        n = transport_udp_recv(t, buf, size, from, 0);
+        if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            return n;
+        if (! wait)
+            return -1;
+        fds[0].fd = x->xsk;
+        fds[1].fd = t->fd;
+        fds[0].events = fds[1].events = POLLIN;
+        if (poll(fds, 2, -1) < 0 && errno != EINTR)
+            return -1;
+    }
+}
+
+static unsigned short ip_checksum(unsigned char *hdr) {
+    unsigned long sum = 0;
+    int i;
+
+    for (i = 0; i < 20; i += 2)
+        sum += (hdr[i] << 8) | hdr[i + 1];
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return (unsigned short)~sum;
+}
+
+/*
+ * build the datagram in a free frame and put it on the TX ring
+ * returns 1 if successful, 0 if the peer has not been heard from or no
+ * frame or ring slot is free
+ */
+static int ring_send(Xdp *x, struct sockaddr_in *to, void *pkt,
+                     unsigned size) {
+    struct xdp_desc *d;
+    Neighbour *nb;
+    unsigned long addr;
+    unsigned char *f;
+    unsigned cons, prod;
+    unsigned short v;
+
+    pthread_mutex_lock(&x->txLock);
+    cons = *x->comp.consumer;		/* reclaim transmitted frames */
+    prod = __atomic_load_n(x->comp.producer, __ATOMIC_ACQUIRE);
+    for (; cons != prod && x->nframes < RING_SIZE; cons++)
+        x->frames[x->nframes++] =
+            ((unsigned long *)x->comp.descs)[cons & (RING_SIZE - 1)];
+    __atomic_store_n(x->comp.consumer, cons, __ATOMIC_RELEASE);
+    nb = neighbour(x, to->sin_addr.s_addr);
+    prod = *x->tx.producer;
+    if (nb->peer != to->sin_addr.s_addr || x->nframes == 0 ||
+            prod - __atomic_load_n(x->tx.consumer, __ATOMIC_ACQUIRE)
+                == RING_SIZE) {
+        pthread_mutex_unlock(&x->txLock);
+        return 0;
+    }
+    addr = x->frames[--x->nframes];
+    f = x->umem + addr;
+    memcpy(f, nb->peerMac, 6);
+    memcpy(f + 6, nb->selfMac, 6);
+    f[12] = 0x08; f[13] = 0x00;
+    f[14] = 0x45; f[15] = 0;
+    v = htons(20 + 8 + size); memcpy(f + 16, &v, 2);
+    v = htons(x->ipid++); memcpy(f + 18, &v, 2);
+    f[20] = 0x40; f[21] = 0;		/* don't fragment */
+    f[22] = 64; f[23] = 17;
+    f[24] = f[25] = 0;
+    memcpy(f + 26, &nb->self, 4);
+    memcpy(f + 30, &nb->peer, 4);
+    v = htons(ip_checksum(f + 14)); memcpy(f + 24, &v, 2);
+    v = htons(x->t.port); memcpy(f + 34, &v, 2);
+    memcpy(f + 36, &to->sin_port, 2);
+    v = htons(8 + size); memcpy(f + 38, &v, 2);
+    f[40] = f[41] = 0;			/* no UDP checksum */
+    memcpy(f + HDR_SIZE, pkt, size);
+    d = (struct xdp_desc *)x->tx.descs + (prod & (RING_SIZE - 1));
+    d->addr = addr;
+    d->len = HDR_SIZE + size;
+    d->options = 0;
+    __atomic_store_n(x->tx.producer, prod + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&x->txLock);
+    (void)sendto(x->xsk, NULL, 0, MSG_DONTWAIT, NULL, 0);
+    return 1;
+}
+
+static int xdp_send(Transport *t, struct sockaddr_in *to, void *pkt,
+                    unsigned size) {
+    if (size <= FRAME_SIZE - HDR_SIZE && ring_send((Xdp *)t, to, pkt, size))
+        return 1;
+    return transport_udp_send(t, to, pkt, size);
+}
+
+/*
+ * the UDP socket's drops, plus the datagrams that the XDP program
+ * redirected but the socket could not take
+ */
+static unsigned long xdp_dropped(Transport *t) {
+    Xdp *x = (Xdp *)t;
+    struct xdp_statistics xs;
+    socklen_t len = sizeof(xs);
+    unsigned long n = __atomic_load_n(&t->dropped, __ATOMIC_RELAXED);
+
+    if (getsockopt(x->xsk, SOL_XDP, XDP_STATISTICS, &xs, &len) == 0)
+        n += xs.rx_dropped + xs.rx_ring_full;
+    return n;
+}
+
+static void xdp_close(Transport *t) {
+    Xdp *x = (Xdp *)t;
+    Ring *rings[4];
+    int i;
+
+    rings[0] = &x->fill; rings[1] = &x->comp;
+    rings[2] = &x->rx; rings[3] = &x->tx;
+    if (x->link >= 0)
+        close(x->link);			/* detaches the program */
+    if (x->prog >= 0)
+        close(x->prog);
+    if (x->xskmap >= 0)
+        close(x->xskmap);
+    for (i = 0; i < 4; i++)
+        if (rings[i]->map != NULL)
+            munmap(rings[i]->map, rings[i]->len);
+    if (x->xsk >= 0)
+        close(x->xsk);
+    if (x->umem != NULL)
+        munmap(x->umem, (size_t)XDP_FRAMES * FRAME_SIZE);
+    if (t->fd >= 0)
+        close(t->fd);
+    pthread_mutex_destroy(&x->rxLock);
+    pthread_mutex_destroy(&x->txLock);
+    free(x);
+}
+
+static const TransportOps xdpOps = {
+    xdp_recv, xdp_send, xdp_dropped, xdp_close, NULL
+};
+
+Transport *transport_xdp(unsigned short port, int rcvbytes, int sndbytes,
+                         const char *ifname, unsigned queue, int native) {
+    struct sockaddr_xdp sx;
+    unsigned ifindex;
+    Xdp *x;
+
+    if (port == 0 || queue >= MAX_QUEUES ||
+            (ifindex = if_nametoindex(ifname)) == 0)
+        return NULL;
+    if ((x = (Xdp *)malloc(sizeof(Xdp))) == NULL)
+        return NULL;
+    memset(x, 0, sizeof(Xdp));
+    x->t.ops = &xdpOps;
+    x->xsk = x->xskmap = x->prog = x->link = -1;
+    pthread_mutex_init(&x->rxLock, NULL);
+    pthread_mutex_init(&x->txLock, NULL);
+    if (! transport_udp_init(&x->t, port, rcvbytes, sndbytes)) {
+        x->t.fd = -1;
+        xdp_close(&x->t);
+        return NULL;
+    }
+    memset(&sx, 0, sizeof(sx));
+    sx.sxdp_family = AF_XDP;
+    sx.sxdp_ifindex = ifindex;
+    sx.sxdp_queue_id = queue;
+    sx.sxdp_flags = native ? 0 : XDP_COPY;
+    if ((x->xsk = socket(AF_XDP, SOCK_RAW, 0)) < 0 || ! setup_socket(x) ||
+            bind(x->xsk, (struct sockaddr *)&sx, sizeof(sx)) != 0 ||
+            ! attach_program(x, ifindex, queue, native)) {
+        warningf("unable to set up XDP on %s queue %u: %s\n", ifname, queue,
+                 strerror(errno));
+        xdp_close(&x->t);
+        return NULL;
+    }
+    return &x->t;
+}
+
+#else
+
+Transport *transport_xdp(unsigned short port, int rcvbytes, int sndbytes,
+                         const char *ifname, unsigned queue, int native) {
+    (void)port; (void)rcvbytes; (void)sndbytes;
+    (void)ifname; (void)queue; (void)native;
+    return NULL;
+}
+
+#endif /* HAVE_AF_XDP */